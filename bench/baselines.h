@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+    /// <summary>
+    /// A generational handle for the baseline containers below.
+    /// </summary>
+    struct baseline_key
+    {
+        uint32_t index;
+        uint32_t generation;
+    };
+
+    /// <summary>
+    /// Baseline: elements in a hash map keyed by a monotonically increasing
+    /// id. Ids are never reused, so stale keys simply fail to be found.
+    /// </summary>
+    template<class T, size_t N>
+    class unordered_map_baseline
+    {
+    public:
+        using value_type = T;
+        using key_type   = uint64_t;
+
+        static constexpr auto capacity = N;
+
+        unordered_map_baseline()
+            : m_next_id(1)
+            , m_data()
+        {
+            m_data.reserve(N);
+        }
+
+        size_t size() const noexcept { return m_data.size(); }
+
+        template<typename ... Args>
+        key_type emplace_back(Args&& ... args)
+        {
+            if (m_data.size() >= N)
+                throw std::out_of_range("unordered_map_baseline is full");
+            const key_type key = m_next_id++;
+            m_data.emplace(key, T(std::forward<Args>(args) ...));
+            return key;
+        }
+
+        T* try_get(key_type key)
+        {
+            auto found = m_data.find(key);
+            return (found != m_data.end()) ? std::addressof(found->second) : nullptr;
+        }
+
+        bool try_remove(key_type key)
+        {
+            return m_data.erase(key) > 0;
+        }
+
+        void clear()
+        {
+            m_data.clear();
+        }
+
+        template<typename F>
+        void for_each(F&& fn)
+        {
+            for (auto& pair : m_data)
+                fn(pair.second);
+        }
+
+        static key_type out_of_range_key(size_t offset)
+        {
+            return std::numeric_limits<key_type>::max() - offset;
+        }
+
+    private:
+        key_type                        m_next_id;
+        std::unordered_map<key_type, T> m_data;
+    };
+
+    /// <summary>
+    /// Baseline: a vector of always-constructed elements with a separate
+    /// free list and generation table. Removed slots keep a stale element.
+    /// Odd generations mark live slots.
+    /// </summary>
+    template<class T, size_t N>
+    class free_list_vector_baseline
+    {
+    public:
+        using value_type = T;
+        using key_type   = baseline_key;
+
+        static constexpr auto capacity = N;
+
+        free_list_vector_baseline()
+            : m_data()
+            , m_generations()
+            , m_free()
+        {
+            m_data.reserve(N);
+            m_generations.reserve(N);
+            m_free.reserve(N);
+        }
+
+        template<typename ... Args>
+        key_type emplace_back(Args&& ... args)
+        {
+            uint32_t index;
+            if (m_free.empty() == false)
+            {
+                index = m_free.back();
+                m_free.pop_back();
+                m_data[index] = T(std::forward<Args>(args) ...);
+            }
+            else if (m_data.size() < N)
+            {
+                index = static_cast<uint32_t>(m_data.size());
+                m_data.emplace_back(std::forward<Args>(args) ...);
+                m_generations.push_back(0);
+            }
+            else
+            {
+                throw std::out_of_range("free_list_vector_baseline is full");
+            }
+
+            return key_type{ index, ++m_generations[index] };
+        }
+
+        T* try_get(key_type key)
+        {
+            if (evaluate_key(key) == false)
+                return nullptr;
+            return std::addressof(m_data[key.index]);
+        }
+
+        bool try_remove(key_type key)
+        {
+            if (evaluate_key(key) == false)
+                return false;
+            ++m_generations[key.index];
+            m_free.push_back(key.index);
+            return true;
+        }
+
+        void clear()
+        {
+            m_free.clear();
+            for (uint32_t idx = 0; idx < m_data.size(); ++idx)
+            {
+                m_generations[idx] += (m_generations[idx] & 1);
+                m_free.push_back(static_cast<uint32_t>(m_data.size() - idx - 1));
+            }
+        }
+
+        template<typename F>
+        void for_each(F&& fn)
+        {
+            for (size_t idx = 0; idx < m_data.size(); ++idx)
+                if (m_generations[idx] & 1)
+                    fn(m_data[idx]);
+        }
+
+        static key_type out_of_range_key(size_t offset)
+        {
+            return key_type{ static_cast<uint32_t>(N + offset), 1 };
+        }
+
+    private:
+        bool evaluate_key(key_type key) const
+        {
+            if (key.index >= m_data.size())
+                return false;
+            return m_generations[key.index] == key.generation;
+        }
+
+        std::vector<T>        m_data;
+        std::vector<uint32_t> m_generations;
+        std::vector<uint32_t> m_free;
+    };
+
+    /// <summary>
+    /// Baseline: a vector of optional elements, each with a generation
+    /// counter stored inline next to it, and a free list of empty slots.
+    /// </summary>
+    template<class T, size_t N>
+    class optional_vector_baseline
+    {
+        struct slot_t
+        {
+            uint32_t generation;
+            std::optional<T> value;
+        };
+
+    public:
+        using value_type = T;
+        using key_type   = baseline_key;
+
+        static constexpr auto capacity = N;
+
+        optional_vector_baseline()
+            : m_slots()
+            , m_free()
+        {
+            m_slots.reserve(N);
+            m_free.reserve(N);
+        }
+
+        template<typename ... Args>
+        key_type emplace_back(Args&& ... args)
+        {
+            uint32_t index;
+            if (m_free.empty() == false)
+            {
+                index = m_free.back();
+                m_free.pop_back();
+            }
+            else if (m_slots.size() < N)
+            {
+                index = static_cast<uint32_t>(m_slots.size());
+                m_slots.emplace_back();
+            }
+            else
+            {
+                throw std::out_of_range("optional_vector_baseline is full");
+            }
+
+            slot_t& slot = m_slots[index];
+            slot.value.emplace(std::forward<Args>(args) ...);
+            return key_type{ index, ++slot.generation };
+        }
+
+        T* try_get(key_type key)
+        {
+            if (slot_t* slot = resolve_key(key))
+                return std::addressof(*slot->value);
+            return nullptr;
+        }
+
+        bool try_remove(key_type key)
+        {
+            slot_t* slot = resolve_key(key);
+            if (slot == nullptr)
+                return false;
+            slot->value.reset();
+            m_free.push_back(key.index);
+            return true;
+        }
+
+        void clear()
+        {
+            m_free.clear();
+            for (size_t idx = m_slots.size(); idx-- > 0;)
+            {
+                m_slots[idx].value.reset();
+                m_free.push_back(static_cast<uint32_t>(idx));
+            }
+        }
+
+        template<typename F>
+        void for_each(F&& fn)
+        {
+            for (auto& slot : m_slots)
+                if (slot.value.has_value())
+                    fn(*slot.value);
+        }
+
+        static key_type out_of_range_key(size_t offset)
+        {
+            return key_type{ static_cast<uint32_t>(N + offset), 1 };
+        }
+
+    private:
+        slot_t* resolve_key(key_type key)
+        {
+            if (key.index >= m_slots.size())
+                return nullptr;
+            slot_t& slot = m_slots[key.index];
+            if ((slot.value.has_value() == false) || (slot.generation != key.generation))
+                return nullptr;
+            return std::addressof(slot);
+        }
+
+        std::vector<slot_t>   m_slots;
+        std::vector<uint32_t> m_free;
+    };
+}
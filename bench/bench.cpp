@@ -0,0 +1,538 @@
+#include "bench.h"
+#include "baselines.h"
+#include "trace.h"
+
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+#include "../include/keyed_array.h"
+#include "../include/packed_array.h"
+#include "../include/push_array.h"
+#include "../include/raw_buffer.h"
+#include "../include/slot_array.h"
+#include "../include/versioned_key.h"
+
+using namespace bench;
+
+namespace
+{
+    // Small containers are benchmarked in batches so that each timed
+    // region performs at least this many operations
+    constexpr size_t target_ops = 4096;
+
+    inline size_t batch_copies(size_t n)
+    {
+        return std::max<size_t>(1, target_ops / std::max<size_t>(1, n));
+    }
+
+    template<typename T, typename = void>
+    struct has_out_of_range_key : std::false_type {};
+
+    template<typename T>
+    struct has_out_of_range_key<T, std::void_t<decltype(T::out_of_range_key(0))>>
+        : std::true_type {};
+
+    /// <summary>
+    /// Produces valid keys whose index lies outside of a container with
+    /// capacity n. Our keys can only be made by a container, so we borrow
+    /// them from a full container with the largest possible capacity.
+    /// Baseline containers construct such keys themselves.
+    /// </summary>
+    template<typename Container>
+    std::vector<typename Container::key_type> out_of_range_keys(size_t n, size_t count)
+    {
+        std::vector<typename Container::key_type> result;
+        result.reserve(count);
+
+        if constexpr (has_out_of_range_key<Container>::value)
+        {
+            for (size_t idx = 0; idx < count; ++idx)
+                result.push_back(Container::out_of_range_key(idx));
+        }
+        else
+        {
+            using source_type = nonstd::slot_array<char, 65535>;
+            static std::vector<nonstd::versioned_key> source_keys;
+
+            if (source_keys.empty())
+            {
+                auto source = std::make_unique<source_type>();
+                for (size_t idx = 0; idx < source->max_size(); ++idx)
+                    source_keys.push_back(source->emplace_back());
+            }
+
+            for (size_t idx = 0; idx < count; ++idx)
+                result.push_back(source_keys[n + (idx % (source_keys.size() - n))]);
+        }
+
+        return result;
+    }
+
+    template<typename Container>
+    using pool = std::vector<std::unique_ptr<Container>>;
+
+    template<typename Container>
+    pool<Container> make_pool(size_t copies)
+    {
+        pool<Container> result;
+        for (size_t idx = 0; idx < copies; ++idx)
+            result.push_back(std::make_unique<Container>());
+        return result;
+    }
+
+    /// <summary>
+    /// Benchmarks for the versioned key containers (slot_array, keyed_array)
+    /// and for the standard library baselines that stand in for them.
+    /// </summary>
+    template<typename Container, size_t Size>
+    void bench_keyed(runner& run, const char* name)
+    {
+        using key_type = typename Container::key_type;
+        using keys_type = std::vector<std::vector<key_type>>;
+
+        constexpr size_t n = Container::capacity;
+        if ((n == 0) || (run.enabled(name, n, Size) == false))
+            return;
+
+        const size_t copies = batch_copies(n);
+        const size_t ops = copies * n;
+        const auto order = shuffled_indices(n);
+
+        auto containers = make_pool<Container>(copies);
+        auto keys = keys_type(copies, std::vector<key_type>(n));
+        auto stale = keys_type(copies, std::vector<key_type>(n));
+        const auto foreign = out_of_range_keys<Container>(n, n);
+
+        auto fill = [&](keys_type& out)
+        {
+            for (size_t copy = 0; copy < copies; ++copy)
+                for (size_t idx = 0; idx < n; ++idx)
+                    out[copy][idx] =
+                        containers[copy]->template emplace_back<uint64_t>(uint64_t(idx));
+        };
+
+        auto clear = [&]
+        {
+            for (auto& container : containers)
+                container->clear();
+        };
+
+        run.measure(name, "emplace_back", n, Size, ops, clear, [&] { fill(keys); });
+        if constexpr (has_emplace_n<Container>::value)
+        {
+            run.measure(name, "emplace_n", n, Size, ops, clear,
+                [&]
+                {
+                    for (size_t copy = 0; copy < copies; ++copy)
+                        containers[copy]->emplace_n(n, keys[copy].data(), uint64_t(copy));
+                });
+        }
+        run.measure(name, "clear", n, Size, ops, [&] { clear(); fill(keys); }, clear);
+
+        run.measure(name, "try_remove", n, Size, ops,
+            [&] { clear(); fill(keys); },
+            [&]
+            {
+                for (size_t copy = 0; copy < copies; ++copy)
+                    for (size_t idx : order)
+                        do_not_optimize(containers[copy]->try_remove(keys[copy][idx]));
+            });
+
+        if constexpr (has_remove_many<Container>::value)
+        {
+            // Removes the same shuffled 30% of keys that a frame of cleanup might
+            const size_t doomed = (n * 3) / 10;
+            auto shuffled = keys_type(copies, std::vector<key_type>(doomed));
+            run.measure(name, "remove_many_30", n, Size, copies * doomed,
+                [&]
+                {
+                    clear();
+                    fill(keys);
+                    for (size_t copy = 0; copy < copies; ++copy)
+                        for (size_t idx = 0; idx < doomed; ++idx)
+                            shuffled[copy][idx] = keys[copy][order[idx]];
+                },
+                [&]
+                {
+                    for (size_t copy = 0; copy < copies; ++copy)
+                        do_not_optimize(containers[copy]->remove_many(
+                            shuffled[copy].data(), doomed));
+                });
+        }
+
+        // Build a full container with a generation of outdated keys
+        clear();
+        fill(stale);
+        clear();
+        fill(keys);
+
+        auto lookup = [&](const keys_type& source)
+        {
+            uint64_t sum = 0;
+            for (size_t copy = 0; copy < copies; ++copy)
+                for (size_t idx : order)
+                    if (auto* value = containers[copy]->try_get(source[copy][idx]))
+                        sum += value->value();
+            do_not_optimize(sum);
+        };
+
+        run.measure(name, "try_get_hit", n, Size, ops, [] {}, [&] { lookup(keys); });
+        run.measure(name, "try_get_stale", n, Size, ops, [] {}, [&] { lookup(stale); });
+
+        if constexpr (has_get_many<Container>::value)
+        {
+            // Resolves the same shuffled keys as try_get_hit, one batch per copy
+            using value_type = typename Container::value_type;
+            auto shuffled = keys_type(copies, std::vector<key_type>(n));
+            for (size_t copy = 0; copy < copies; ++copy)
+                for (size_t idx = 0; idx < n; ++idx)
+                    shuffled[copy][idx] = keys[copy][order[idx]];
+
+            auto results = std::vector<value_type*>(n);
+            run.measure(name, "get_many_hit", n, Size, ops, [] {},
+                [&]
+                {
+                    uint64_t sum = 0;
+                    for (size_t copy = 0; copy < copies; ++copy)
+                    {
+                        containers[copy]->get_many(shuffled[copy].data(), n, results.data());
+                        for (value_type* value : results)
+                            sum += value->value();
+                    }
+                    do_not_optimize(sum);
+                });
+        }
+
+        if constexpr (has_validate_many<Container>::value)
+        {
+            // Alternates live and stale keys, in shuffled order
+            auto mixed = keys_type(copies, std::vector<key_type>(n));
+            for (size_t copy = 0; copy < copies; ++copy)
+                for (size_t idx = 0; idx < n; ++idx)
+                    mixed[copy][idx] = ((idx % 2) == 0) ?
+                        keys[copy][order[idx]] : stale[copy][order[idx]];
+
+            auto valid = std::vector<uint64_t>((n + 63) / 64);
+            run.measure(name, "validate_many_mixed", n, Size, ops, [] {},
+                [&]
+                {
+                    size_t found = 0;
+                    for (size_t copy = 0; copy < copies; ++copy)
+                        found += containers[copy]->validate_many(
+                            mixed[copy].data(), n, valid.data());
+                    do_not_optimize(found);
+                });
+        }
+
+        run.measure(name, "try_get_out_of_range", n, Size, ops, [] {},
+            [&]
+            {
+                uint64_t sum = 0;
+                for (size_t copy = 0; copy < copies; ++copy)
+                    for (const auto& key : foreign)
+                        if (auto* value = containers[copy]->try_get(key))
+                            sum += value->value();
+                do_not_optimize(sum);
+            });
+
+        // Walking a side list of keys is how non-iterable containers are
+        // usually updated, so measure that for every container
+        run.measure(name, "iterate_keys", n, Size, ops, [] {},
+            [&]
+            {
+                uint64_t sum = 0;
+                for (size_t copy = 0; copy < copies; ++copy)
+                    for (const auto& key : keys[copy])
+                        sum += containers[copy]->try_get(key)->value();
+                do_not_optimize(sum);
+            });
+
+        if constexpr (is_iterable<Container>::value ||
+                      has_for_each<Container>::value ||
+                      has_for_each_occupied<Container>::value)
+        {
+            run.measure(name, "iterate", n, Size, ops, [] {},
+                [&]
+                {
+                    uint64_t sum = 0;
+                    for (auto& container : containers)
+                        visit_all(*container, [&](const auto& value) { sum += value.value(); });
+                    do_not_optimize(sum);
+                });
+        }
+    }
+
+    /// <summary>
+    /// Benchmarks for the index-addressed containers (packed_array, push_array).
+    /// </summary>
+    template<typename Container, size_t Size, bool Clearable>
+    void bench_indexed(runner& run, const char* name)
+    {
+        using value_type = typename Container::value_type;
+
+        constexpr size_t n = Container::capacity;
+        if ((n == 0) || (run.enabled(name, n, Size) == false))
+            return;
+
+        const size_t copies = batch_copies(n);
+        const size_t ops = copies * n;
+        const auto order = shuffled_indices(n);
+
+        auto containers = make_pool<Container>(copies);
+
+        auto fill = [&]
+        {
+            for (auto& container : containers)
+                for (size_t idx = 0; idx < n; ++idx)
+                    container->emplace_back(value_type(idx));
+        };
+
+        auto reset = [&]
+        {
+            for (auto& container : containers)
+                if constexpr (Clearable)
+                    container->clear();
+                else
+                    container = std::make_unique<Container>();
+        };
+
+        run.measure(name, "emplace_back", n, Size, ops, reset, fill);
+
+        if constexpr (Clearable)
+            run.measure(name, "clear", n, Size, ops, [&] { reset(); fill(); }, reset);
+
+        reset();
+        fill();
+
+        run.measure(name, "get", n, Size, ops, [] {},
+            [&]
+            {
+                uint64_t sum = 0;
+                for (auto& container : containers)
+                    for (size_t idx : order)
+                        sum += (*container)[idx].value();
+                do_not_optimize(sum);
+            });
+
+        run.measure(name, "iterate", n, Size, ops, [] {},
+            [&]
+            {
+                uint64_t sum = 0;
+                for (auto& container : containers)
+                    for (auto& value : *container)
+                        sum += value.value();
+                do_not_optimize(sum);
+            });
+    }
+
+    /// <summary>
+    /// Benchmarks for the raw_buffer backbone, which tracks nothing itself.
+    /// </summary>
+    template<size_t N, size_t Size>
+    void bench_raw_buffer(runner& run, const char* name)
+    {
+        using value_type = payload<Size>;
+        using buffer_type = nonstd::raw_buffer<value_type, N>;
+
+        if ((N == 0) || (run.enabled(name, N, Size) == false))
+            return;
+
+        const size_t copies = batch_copies(N);
+        const size_t ops = copies * N;
+        const auto order = shuffled_indices(N);
+
+        auto buffers = make_pool<buffer_type>(copies);
+        bool filled = false;
+
+        auto fill = [&]
+        {
+            if (filled == false)
+                for (auto& buffer : buffers)
+                    for (size_t idx = 0; idx < N; ++idx)
+                        buffer->emplace(idx, uint64_t(idx));
+            filled = true;
+        };
+
+        auto destroy = [&]
+        {
+            if (filled == true)
+                for (auto& buffer : buffers)
+                    for (size_t idx = 0; idx < N; ++idx)
+                        buffer->destroy(idx);
+            filled = false;
+        };
+
+        run.measure(name, "emplace", N, Size, ops, destroy, fill);
+        run.measure(name, "destroy", N, Size, ops, fill, destroy);
+
+        fill();
+
+        run.measure(name, "get", N, Size, ops, [] {},
+            [&]
+            {
+                uint64_t sum = 0;
+                for (auto& buffer : buffers)
+                    for (size_t idx : order)
+                        sum += (*buffer)[idx].value();
+                do_not_optimize(sum);
+            });
+
+        run.measure(name, "iterate", N, Size, ops, [] {},
+            [&]
+            {
+                uint64_t sum = 0;
+                for (auto& buffer : buffers)
+                    for (const auto* it = buffer->data(); it != (buffer->data() + N); ++it)
+                        sum += it->value();
+                do_not_optimize(sum);
+            });
+
+        destroy();
+    }
+
+    template<size_t N, size_t Size>
+    void bench_containers(runner& run)
+    {
+        using value_type = payload<Size>;
+
+        bench_keyed<nonstd::slot_array<value_type, N>, Size>(run, "slot_array");
+        bench_keyed<nonstd::keyed_array<value_type, N>, Size>(run, "keyed_array");
+        bench_keyed<unordered_map_baseline<value_type, N>, Size>(run, "std::unordered_map");
+        bench_keyed<free_list_vector_baseline<value_type, N>, Size>(run, "std::vector+free_list");
+        bench_keyed<optional_vector_baseline<value_type, N>, Size>(run, "std::vector<optional>");
+        bench_indexed<nonstd::packed_array<value_type, N>, Size, true>(run, "packed_array");
+        bench_indexed<nonstd::push_array<value_type, N>, Size, false>(run, "push_array");
+        bench_raw_buffer<N, Size>(run, "raw_buffer");
+    }
+
+    template<size_t N>
+    void bench_sizes(runner& run)
+    {
+        bench_containers<N, 8>(run);
+        bench_containers<N, 64>(run);
+        bench_containers<N, 256>(run);
+        bench_containers<N, 4096>(run);
+    }
+
+    template<size_t Size>
+    void replay_all(const std::vector<trace_op>& ops)
+    {
+        using value_type = payload<Size>;
+        constexpr size_t n = 65534;
+
+        std::printf("replaying %zu ops with sizeof(T) = %zu\n", ops.size(), Size);
+        replay_trace<nonstd::slot_array<value_type, n>>("slot_array", ops);
+        replay_trace<nonstd::keyed_array<value_type, n>>("keyed_array", ops);
+        replay_trace<unordered_map_baseline<value_type, n>>("std::unordered_map", ops);
+        replay_trace<free_list_vector_baseline<value_type, n>>("std::vector+free_list", ops);
+        replay_trace<optional_vector_baseline<value_type, n>>("std::vector<optional>", ops);
+    }
+
+    int replay(const char* path, size_t element_size)
+    {
+        const auto ops = load_trace(path);
+
+        switch (element_size)
+        {
+        case 8:    replay_all<8>(ops);    break;
+        case 64:   replay_all<64>(ops);   break;
+        case 256:  replay_all<256>(ops);  break;
+        case 4096: replay_all<4096>(ops); break;
+        default:
+            std::printf("unsupported element size %zu (use 8, 64, 256 or 4096)\n", element_size);
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    void usage(const char* program)
+    {
+        std::printf(
+            "usage: %s [--filter <container>] [--reps <count>] [--max-mb <size>] [--csv] [--counters]\n"
+            "       %s --replay <trace> [--size <bytes>]\n"
+            "       %s --generate-trace <trace>\n"
+            "  --filter  only run containers whose name contains the given string\n"
+            "  --reps    repetitions per benchmark, the median is reported (default 7)\n"
+            "  --max-mb  skip configurations whose payload exceeds this size (default 512)\n"
+            "  --csv     print results as comma-separated values\n"
+            "  --counters  report hardware counters per op (Linux perf events)\n"
+            "  --replay  replay a recorded operation trace and report per-op latency\n"
+            "  --size    element size used when replaying a trace (default 64)\n"
+            "  --generate-trace  write a synthetic bursty churn trace to replay\n",
+            program, program, program);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    const char* replay_path = nullptr;
+    const char* generate_path = nullptr;
+    size_t replay_size = 64;
+
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        const std::string arg = argv[idx];
+        const bool has_value = (idx + 1) < argc;
+
+        if ((arg == "--filter") && has_value)
+            opts.filter = argv[++idx];
+        else if ((arg == "--reps") && has_value)
+            opts.repetitions = std::max<size_t>(1, std::strtoull(argv[++idx], nullptr, 10));
+        else if ((arg == "--max-mb") && has_value)
+            opts.max_bytes = std::strtoull(argv[++idx], nullptr, 10) << 20;
+        else if (arg == "--csv")
+            opts.csv = true;
+        else if (arg == "--counters")
+            opts.counters = true;
+        else if ((arg == "--replay") && has_value)
+            replay_path = argv[++idx];
+        else if ((arg == "--size") && has_value)
+            replay_size = std::strtoull(argv[++idx], nullptr, 10);
+        else if ((arg == "--generate-trace") && has_value)
+            generate_path = argv[++idx];
+        else
+        {
+            usage(argv[0]);
+            return (arg == "--help") ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    try
+    {
+        if (generate_path != nullptr)
+        {
+            // Churn 30% of a 50k working set per frame
+            save_trace(generate_path, generate_churn_trace(50000, 15000, 200, 2000));
+            return EXIT_SUCCESS;
+        }
+
+        if (replay_path != nullptr)
+            return replay(replay_path, replay_size);
+    }
+    catch (const std::exception& ex)
+    {
+        std::printf("error: %s\n", ex.what());
+        return EXIT_FAILURE;
+    }
+
+    runner run(opts);
+    run.header();
+
+    bench_sizes<16>(run);
+    bench_sizes<256>(run);
+    bench_sizes<4096>(run);
+    bench_sizes<65534>(run);
+
+    run.compare("keyed_array", "slot_array");
+    run.compare("slot_array", "std::unordered_map");
+    run.compare("slot_array", "std::vector+free_list");
+    run.compare("slot_array", "std::vector<optional>");
+    run.compare("keyed_array", "std::unordered_map");
+    run.compare("keyed_array", "std::vector+free_list");
+    run.compare("keyed_array", "std::vector<optional>");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "perf_counters.h"
+
+namespace bench
+{
+    /// <summary>
+    /// A fixed-size element payload for benchmarking.
+    /// The first word carries a value so that reads can't be optimized out.
+    /// </summary>
+    template<size_t Size>
+    struct payload
+    {
+        static_assert(Size >= 8 && (Size % 8) == 0, "payload size must be a multiple of 8");
+
+        payload() = default;
+
+        explicit payload(uint64_t value)
+            : words()
+        {
+            words[0] = value;
+        }
+
+        uint64_t value() const noexcept { return words[0]; }
+
+        std::array<uint64_t, Size / 8> words;
+    };
+
+    /// <summary>
+    /// Prevents the compiler from discarding the computation of a value.
+    /// </summary>
+    template<typename T>
+    inline void do_not_optimize(const T& value)
+    {
+#if defined(_MSC_VER)
+        static volatile const T* sink;
+        sink = &value;
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    /// <summary>
+    /// Returns a deterministic shuffled sequence of [0, count).
+    /// Every run of the benchmark uses the same order for a given count.
+    /// </summary>
+    inline std::vector<size_t> shuffled_indices(size_t count, uint64_t seed = 0x5eed)
+    {
+        std::vector<size_t> result(count);
+        for (size_t idx = 0; idx < count; ++idx)
+            result[idx] = idx;
+        std::mt19937_64 rng(seed ^ count);
+        std::shuffle(result.begin(), result.end(), rng);
+        return result;
+    }
+
+    template<typename T, typename = void>
+    struct is_iterable : std::false_type {};
+
+    template<typename T>
+    struct is_iterable<T, std::void_t<decltype(std::declval<T&>().begin())>>
+        : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_for_each : std::false_type {};
+
+    template<typename T>
+    struct has_for_each<T, std::void_t<decltype(std::declval<T&>().for_each(
+        std::declval<void(*)(typename T::value_type&)>()))>>
+        : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_for_each_occupied : std::false_type {};
+
+    template<typename T>
+    struct has_for_each_occupied<T, std::void_t<decltype(std::declval<T&>().for_each_occupied(
+        std::declval<void(*)(typename T::key_type, typename T::value_type&)>()))>>
+        : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_emplace_n : std::false_type {};
+
+    template<typename T>
+    struct has_emplace_n<T, std::void_t<decltype(std::declval<T&>().emplace_n(
+        size_t(), std::declval<typename T::key_type*>(), uint64_t()))>>
+        : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_remove_many : std::false_type {};
+
+    template<typename T>
+    struct has_remove_many<T, std::void_t<decltype(std::declval<T&>().remove_many(
+        std::declval<const typename T::key_type*>(), size_t()))>>
+        : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_get_many : std::false_type {};
+
+    template<typename T>
+    struct has_get_many<T, std::void_t<decltype(std::declval<T&>().get_many(
+        std::declval<const typename T::key_type*>(), size_t(),
+        std::declval<typename T::value_type**>()))>>
+        : std::true_type {};
+
+    template<typename T, typename = void>
+    struct has_validate_many : std::false_type {};
+
+    template<typename T>
+    struct has_validate_many<T, std::void_t<decltype(std::declval<T&>().validate_many(
+        std::declval<const typename T::key_type*>(), size_t(), std::declval<uint64_t*>()))>>
+        : std::true_type {};
+
+    /// <summary>
+    /// Visits every element of a container using its native iteration.
+    /// </summary>
+    template<typename Container, typename F>
+    void visit_all(Container& container, F&& fn)
+    {
+        if constexpr (has_for_each<Container>::value)
+            container.for_each(fn);
+        else if constexpr (has_for_each_occupied<Container>::value)
+            container.for_each_occupied([&](const auto&, auto& value) { fn(value); });
+        else
+            for (auto& value : container)
+                fn(value);
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    struct result
+    {
+        std::string container;
+        std::string operation;
+        size_t n;
+        size_t element_size;
+        size_t ops;
+        double ns_per_op;
+        perf_counters::readings counters_per_op;
+    };
+
+    struct options
+    {
+        std::string filter;
+        size_t repetitions = 7;
+        size_t max_bytes = size_t(512) << 20;
+        bool csv = false;
+        bool counters = false;
+    };
+
+    /// <summary>
+    /// Collects and reports benchmark results.
+    /// Each benchmark body is run several times and the median is kept.
+    /// </summary>
+    class runner
+    {
+    public:
+        explicit runner(options opts)
+            : m_options(std::move(opts))
+            , m_results()
+            , m_counters()
+        {
+            if (m_options.counters)
+            {
+                m_counters = std::make_unique<perf_counters>();
+                if (m_counters->available() == false)
+                {
+                    std::fprintf(stderr,
+                        "hardware counters unavailable, reporting timings only\n");
+                    m_counters.reset();
+                }
+            }
+        }
+
+        const options& config() const noexcept { return m_options; }
+        const std::vector<result>& results() const noexcept { return m_results; }
+
+        /// <summary>
+        /// Returns true if the given suite should be run at all.
+        /// </summary>
+        bool enabled(const char* container, size_t n, size_t element_size) const
+        {
+            if ((n * element_size) > m_options.max_bytes)
+                return false;
+            if (m_options.filter.empty())
+                return true;
+            return std::strstr(container, m_options.filter.c_str()) != nullptr;
+        }
+
+        /// <summary>
+        /// Measures a benchmark. The setup function is run untimed before
+        /// each repetition and the body is expected to perform ops operations.
+        /// Hardware counters, if enabled, are averaged over all repetitions.
+        /// </summary>
+        template<typename Setup, typename Body>
+        void measure(
+            const char* container,
+            const char* operation,
+            size_t n,
+            size_t element_size,
+            size_t ops,
+            Setup&& setup,
+            Body&& body)
+        {
+            if (ops == 0)
+                return;
+
+            std::vector<double> samples;
+            samples.reserve(m_options.repetitions);
+
+            perf_counters::readings counts;
+            counts.fill(m_counters ? 0.0 : std::nan(""));
+
+            for (size_t rep = 0; rep < m_options.repetitions; ++rep)
+            {
+                setup();
+
+                if (m_counters)
+                    m_counters->start();
+                const auto start = clock::now();
+                body();
+                const auto stop = clock::now();
+                if (m_counters)
+                    m_counters->stop();
+
+                const std::chrono::duration<double, std::nano> elapsed = stop - start;
+                samples.push_back(elapsed.count() / static_cast<double>(ops));
+
+                if (m_counters)
+                {
+                    const auto reading = m_counters->read();
+                    for (size_t idx = 0; idx < counts.size(); ++idx)
+                        counts[idx] += reading[idx];
+                }
+            }
+
+            std::sort(samples.begin(), samples.end());
+            const double median = samples[samples.size() / 2];
+
+            const double total_ops = double(ops) * double(m_options.repetitions);
+            for (double& value : counts)
+                value /= total_ops;
+
+            m_results.push_back({ container, operation, n, element_size, ops, median, counts });
+            report(m_results.back());
+        }
+
+        /// <summary>
+        /// Prints the time ratio of one container against another for every
+        /// operation and configuration both were measured with. A ratio above
+        /// one means the first container was slower.
+        /// </summary>
+        void compare(const char* container, const char* baseline) const
+        {
+            bool printed = false;
+
+            for (const result& lhs : m_results)
+            {
+                if (lhs.container != container)
+                    continue;
+
+                for (const result& rhs : m_results)
+                {
+                    if ((rhs.container != baseline) ||
+                        (rhs.operation != lhs.operation) ||
+                        (rhs.n != lhs.n) ||
+                        (rhs.element_size != lhs.element_size))
+                        continue;
+
+                    if (printed == false)
+                    {
+                        std::printf("\n%s%s vs %s (time ratio, >1 means %s is slower)\n",
+                            m_options.csv ? "# " : "", container, baseline, container);
+                        printed = true;
+                    }
+
+                    const double ratio = lhs.ns_per_op / std::max(rhs.ns_per_op, 1e-9);
+                    std::printf("%s%-20s %8zu %8zu %12.3f%s\n",
+                        m_options.csv ? "# " : "",
+                        lhs.operation.c_str(), lhs.n, lhs.element_size, ratio,
+                        (ratio > 1.0) ? "  *" : "");
+                }
+            }
+        }
+
+        void header() const
+        {
+            if (m_options.csv)
+                std::printf("container,operation,n,sizeof,ops,ns_per_op");
+            else
+                std::printf("%-24s %-20s %8s %8s %12s",
+                    "container", "operation", "n", "sizeof", "ns/op");
+
+            if (m_counters)
+                for (size_t idx = 0; idx < perf_counters::count; ++idx)
+                    std::printf(m_options.csv ? ",%s_per_op" : " %10s/op",
+                        perf_counters::name(idx));
+
+            std::printf("\n");
+        }
+
+    private:
+        void report(const result& res) const
+        {
+            if (m_options.csv)
+                std::printf("%s,%s,%zu,%zu,%zu,%.3f",
+                    res.container.c_str(), res.operation.c_str(),
+                    res.n, res.element_size, res.ops, res.ns_per_op);
+            else
+                std::printf("%-24s %-20s %8zu %8zu %12.3f",
+                    res.container.c_str(), res.operation.c_str(),
+                    res.n, res.element_size, res.ns_per_op);
+
+            if (m_counters)
+                for (double value : res.counters_per_op)
+                    std::printf(m_options.csv ? ",%.3f" : " %13.3f", value);
+
+            std::printf("\n");
+            std::fflush(stdout);
+        }
+
+        options                        m_options;
+        std::vector<result>            m_results;
+        std::unique_ptr<perf_counters> m_counters;
+    };
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench
+{
+    /// <summary>
+    /// Hardware performance counters for the calling thread, read through
+    /// Linux perf_event_open. Each counter is opened independently so that
+    /// an event the CPU or kernel doesn't support only disables itself.
+    /// On other platforms, or when perf events are restricted (see
+    /// /proc/sys/kernel/perf_event_paranoid), nothing is available and
+    /// every reading is NaN.
+    /// </summary>
+    class perf_counters
+    {
+    public:
+        enum counter
+        {
+            instructions,
+            branch_misses,
+            l1d_misses,
+            llc_misses,
+            count
+        };
+
+        using readings = std::array<double, count>;
+
+        static const char* name(size_t which)
+        {
+            static const char* names[] = { "instr", "br-miss", "L1d-miss", "LLC-miss" };
+            return names[which];
+        }
+
+        perf_counters()
+            : m_fds()
+        {
+            m_fds.fill(-1);
+
+#if defined(__linux__)
+            const uint64_t l1d_read_miss =
+                PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+            m_fds[instructions]  = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            m_fds[branch_misses] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+            m_fds[l1d_misses]    = open_event(PERF_TYPE_HW_CACHE, l1d_read_miss);
+            m_fds[llc_misses]    = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+        }
+
+        ~perf_counters()
+        {
+#if defined(__linux__)
+            for (int fd : m_fds)
+                if (fd >= 0)
+                    close(fd);
+#endif
+        }
+
+        perf_counters(const perf_counters&)            = delete;
+        perf_counters& operator=(const perf_counters&) = delete;
+
+        bool available() const noexcept
+        {
+            for (int fd : m_fds)
+                if (fd >= 0)
+                    return true;
+            return false;
+        }
+
+        void start()
+        {
+#if defined(__linux__)
+            for (int fd : m_fds)
+            {
+                if (fd >= 0)
+                {
+                    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+
+        void stop()
+        {
+#if defined(__linux__)
+            for (int fd : m_fds)
+                if (fd >= 0)
+                    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+        }
+
+        /// <summary>
+        /// Reads the counts since the last start(), scaled up if the kernel
+        /// had to multiplex the counter. Unavailable counters read as NaN.
+        /// </summary>
+        readings read() const
+        {
+            readings result;
+            result.fill(std::nan(""));
+
+#if defined(__linux__)
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                if (m_fds[idx] < 0)
+                    continue;
+
+                // Layout given by PERF_FORMAT_TOTAL_TIME_ENABLED | _RUNNING
+                uint64_t values[3] = {};
+                if (::read(m_fds[idx], values, sizeof(values)) != sizeof(values))
+                    continue;
+                if (values[2] == 0)
+                    continue;
+
+                result[idx] = double(values[0]) * (double(values[1]) / double(values[2]));
+            }
+#endif
+
+            return result;
+        }
+
+    private:
+#if defined(__linux__)
+        static int open_event(uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format =
+                PERF_FORMAT_TOTAL_TIME_ENABLED |
+                PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            const long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+            return static_cast<int>(fd);
+        }
+#endif
+
+        std::array<int, count> m_fds;
+    };
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+namespace bench
+{
+    /// <summary>
+    /// A single recorded container operation. Handles are trace-local ids
+    /// assigned by the recording process, one per emplace. Replaying maps
+    /// each handle to whatever key the container under test returned.
+    /// </summary>
+    struct trace_op
+    {
+        enum kind : uint8_t
+        {
+            emplace = 0,
+            remove  = 1,
+            get     = 2,
+            iterate = 3,
+            clear   = 4,
+            count
+        };
+
+        kind     op;
+        uint32_t handle;
+    };
+
+    inline const char* trace_op_name(trace_op::kind op)
+    {
+        static const char* names[] = { "emplace", "remove", "get", "iterate", "clear" };
+        return (op < trace_op::count) ? names[op] : "unknown";
+    }
+
+    /// <summary>
+    /// Trace files come in two flavors that are told apart by their header.
+    ///
+    /// Binary: the 8-byte magic "NSTRACE1" followed by 5-byte records of an
+    /// op byte and a little-endian uint32 handle.
+    ///
+    /// Text: one op per line, '#' starts a comment. Ops are "e <handle>",
+    /// "r <handle>", "g <handle>", "i" (iterate) and "c" (clear).
+    /// </summary>
+    static constexpr char trace_magic[8] = { 'N', 'S', 'T', 'R', 'A', 'C', 'E', '1' };
+
+    inline std::vector<trace_op> load_trace(const char* path)
+    {
+        std::FILE* file = std::fopen(path, "rb");
+        if (file == nullptr)
+            throw std::runtime_error(std::string("cannot open trace: ") + path);
+
+        std::vector<trace_op> result;
+        char magic[sizeof(trace_magic)] = {};
+        const size_t magic_read = std::fread(magic, 1, sizeof(magic), file);
+
+        if ((magic_read == sizeof(magic)) &&
+            (std::memcmp(magic, trace_magic, sizeof(magic)) == 0))
+        {
+            unsigned char record[5];
+            while (std::fread(record, 1, sizeof(record), file) == sizeof(record))
+            {
+                if (record[0] >= trace_op::count)
+                    throw std::runtime_error("malformed binary trace record");
+
+                const uint32_t handle =
+                    uint32_t(record[1])         |
+                    (uint32_t(record[2]) << 8)  |
+                    (uint32_t(record[3]) << 16) |
+                    (uint32_t(record[4]) << 24);
+                result.push_back({ static_cast<trace_op::kind>(record[0]), handle });
+            }
+        }
+        else
+        {
+            std::rewind(file);
+
+            char line[256];
+            size_t line_number = 0;
+            while (std::fgets(line, sizeof(line), file) != nullptr)
+            {
+                ++line_number;
+
+                char op = 0;
+                unsigned long handle = 0;
+                const int fields = std::sscanf(line, " %c %lu", &op, &handle);
+                if ((fields <= 0) || (op == '#'))
+                    continue;
+
+                trace_op::kind kind;
+                switch (op)
+                {
+                case 'e': kind = trace_op::emplace; break;
+                case 'r': kind = trace_op::remove;  break;
+                case 'g': kind = trace_op::get;     break;
+                case 'i': kind = trace_op::iterate; break;
+                case 'c': kind = trace_op::clear;   break;
+                default:
+                    throw std::runtime_error(
+                        "malformed trace at line " + std::to_string(line_number));
+                }
+
+                const bool needs_handle = (kind <= trace_op::get);
+                if (needs_handle && (fields < 2))
+                    throw std::runtime_error(
+                        "missing handle at line " + std::to_string(line_number));
+
+                result.push_back({ kind, static_cast<uint32_t>(handle) });
+            }
+        }
+
+        std::fclose(file);
+        return result;
+    }
+
+    inline void save_trace(const char* path, const std::vector<trace_op>& ops)
+    {
+        std::FILE* file = std::fopen(path, "wb");
+        if (file == nullptr)
+            throw std::runtime_error(std::string("cannot create trace: ") + path);
+
+        std::fwrite(trace_magic, 1, sizeof(trace_magic), file);
+        for (const trace_op& op : ops)
+        {
+            const unsigned char record[5] =
+            {
+                static_cast<unsigned char>(op.op),
+                static_cast<unsigned char>(op.handle),
+                static_cast<unsigned char>(op.handle >> 8),
+                static_cast<unsigned char>(op.handle >> 16),
+                static_cast<unsigned char>(op.handle >> 24),
+            };
+            std::fwrite(record, 1, sizeof(record), file);
+        }
+
+        std::fclose(file);
+    }
+
+    /// <summary>
+    /// Generates a bursty churn trace: the container is filled to a working
+    /// level, then repeatedly loses a burst of random elements and is
+    /// refilled, with lookups of both live and dead handles and a full
+    /// iteration once per burst (i.e. once per "frame").
+    /// </summary>
+    inline std::vector<trace_op> generate_churn_trace(
+        size_t live_target,
+        size_t burst,
+        size_t frames,
+        size_t gets_per_frame,
+        uint64_t seed = 0x5eed)
+    {
+        std::mt19937_64 rng(seed);
+        std::vector<trace_op> result;
+        std::vector<uint32_t> live;
+        std::vector<uint32_t> dead;
+        uint32_t next_handle = 0;
+
+        auto emplace = [&]
+        {
+            result.push_back({ trace_op::emplace, next_handle });
+            live.push_back(next_handle++);
+        };
+
+        while (live.size() < live_target)
+            emplace();
+
+        for (size_t frame = 0; frame < frames; ++frame)
+        {
+            const size_t removals = std::min(burst, live.size());
+            for (size_t idx = 0; idx < removals; ++idx)
+            {
+                const size_t pick = rng() % live.size();
+                result.push_back({ trace_op::remove, live[pick] });
+                dead.push_back(live[pick]);
+                live[pick] = live.back();
+                live.pop_back();
+            }
+
+            for (size_t idx = 0; idx < gets_per_frame; ++idx)
+            {
+                // Roughly one in eight lookups is for a handle that died
+                const bool stale = (dead.empty() == false) && ((rng() % 8) == 0);
+                const auto& source = stale ? dead : live;
+                if (source.empty() == false)
+                    result.push_back({ trace_op::get, source[rng() % source.size()] });
+            }
+
+            while (live.size() < live_target)
+                emplace();
+
+            result.push_back({ trace_op::iterate, 0 });
+        }
+
+        return result;
+    }
+
+    /// <summary>
+    /// Replays a trace against a container, timing every operation.
+    /// Reports throughput and per-op latency percentiles.
+    /// </summary>
+    template<typename Container>
+    void replay_trace(const char* name, const std::vector<trace_op>& ops)
+    {
+        using key_type = typename Container::key_type;
+
+        auto container = std::make_unique<Container>();
+        std::vector<key_type> keys;
+        std::vector<bool> issued;
+        std::vector<bool> alive;
+        std::vector<uint32_t> samples[trace_op::count];
+        size_t failures = 0;
+
+        for (auto& sample : samples)
+            sample.reserve(ops.size());
+
+        auto key_for = [&](uint32_t handle) -> const key_type*
+        {
+            if ((handle >= issued.size()) || (issued[handle] == false))
+                return nullptr;
+            return &keys[handle];
+        };
+
+        uint64_t sum = 0;
+        double total_ns = 0.0;
+
+        for (const trace_op& op : ops)
+        {
+            if ((op.op == trace_op::emplace) && (op.handle >= keys.size()))
+            {
+                keys.resize(size_t(op.handle) + 1);
+                issued.resize(size_t(op.handle) + 1);
+                alive.resize(size_t(op.handle) + 1);
+            }
+
+            const auto start = clock::now();
+            switch (op.op)
+            {
+            case trace_op::emplace:
+                try
+                {
+                    keys[op.handle] =
+                        container->template emplace_back<uint64_t>(uint64_t(op.handle));
+                    issued[op.handle] = true;
+                    alive[op.handle] = true;
+                }
+                catch (const std::exception&)
+                {
+                    ++failures;
+                }
+                break;
+
+            case trace_op::remove:
+                if (const key_type* key = key_for(op.handle))
+                    if (container->try_remove(*key))
+                        alive[op.handle] = false;
+                break;
+
+            case trace_op::get:
+                if (const key_type* key = key_for(op.handle))
+                    if (auto* value = container->try_get(*key))
+                        sum += value->value();
+                break;
+
+            case trace_op::iterate:
+                // Containers without native iteration are walked through the
+                // keys of their live elements, as their users would have to
+                if constexpr (is_iterable<Container>::value || has_for_each<Container>::value)
+                {
+                    visit_all(*container, [&](const auto& value) { sum += value.value(); });
+                }
+                else
+                {
+                    for (size_t handle = 0; handle < keys.size(); ++handle)
+                        if (alive[handle])
+                            sum += container->try_get(keys[handle])->value();
+                }
+                break;
+
+            case trace_op::clear:
+                container->clear();
+                alive.assign(alive.size(), false);
+                break;
+
+            default:
+                break;
+            }
+            const auto stop = clock::now();
+
+            const std::chrono::duration<double, std::nano> elapsed = stop - start;
+            total_ns += elapsed.count();
+            samples[op.op].push_back(static_cast<uint32_t>(
+                std::min(elapsed.count(), double(UINT32_MAX))));
+        }
+
+        do_not_optimize(sum);
+
+        std::printf("\n%s: %zu ops in %.3f ms (%.2f Mops/s)",
+            name, ops.size(), total_ns / 1e6,
+            (total_ns > 0.0) ? (double(ops.size()) * 1e3 / total_ns) : 0.0);
+        if (failures > 0)
+            std::printf(", %zu failed emplacements", failures);
+        std::printf("\n%-10s %10s %10s %10s %10s\n", "op", "count", "p50 ns", "p99 ns", "p999 ns");
+
+        for (size_t kind = 0; kind < trace_op::count; ++kind)
+        {
+            auto& sample = samples[kind];
+            if (sample.empty())
+                continue;
+
+            auto percentile = [&](double fraction)
+            {
+                const size_t rank = std::min(
+                    sample.size() - 1,
+                    static_cast<size_t>(fraction * double(sample.size())));
+                std::nth_element(sample.begin(), sample.begin() + rank, sample.end());
+                return sample[rank];
+            };
+
+            std::printf("%-10s %10zu %10u %10u %10u\n",
+                trace_op_name(static_cast<trace_op::kind>(kind)),
+                sample.size(), percentile(0.5), percentile(0.99), percentile(0.999));
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "policy.h"
+
+namespace nonstd
+{
+    namespace detail
+    {
+        /// <summary>
+        /// The slots of a keyed container changed since its last delta
+        /// snapshot, under the given tracking policy, and the number of that
+        /// snapshot (the checkpoint).
+        /// </summary>
+        template<typename Tracking, size_t N>
+        class dirty_slots;
+
+        template<size_t N>
+        class dirty_slots<no_tracking, N>
+        {
+        public:
+            static constexpr bool enabled = false;
+
+            void touch(size_t) noexcept {}
+            uint64_t checkpoint() const noexcept { return 0; }
+        };
+
+        /// <summary>
+        /// One dirty bit per slot. Words are zeroed as touches first reach
+        /// them, so construction and clearing after a checkpoint are O(1).
+        /// </summary>
+        template<size_t N>
+        class dirty_slots<dirty_tracking, N>
+        {
+            static constexpr size_t bit_words = (N + 63) / 64;
+
+        public:
+            static constexpr bool enabled = true;
+
+            dirty_slots()
+                : m_checkpoint()
+                , m_ready()
+            {
+                // Pass
+            }
+
+            void touch(size_t index) noexcept
+            {
+                const size_t word = index / 64;
+                for (; m_ready <= word; ++m_ready)
+                    m_bits[m_ready] = 0;
+                m_bits[word] |= (uint64_t(1) << (index % 64));
+            }
+
+            uint64_t checkpoint() const noexcept { return m_checkpoint; }
+
+            // Words at or past this hold no dirty bits
+            size_t words() const noexcept { return m_ready; }
+            uint64_t word(size_t word) const noexcept { return m_bits[word]; }
+
+            /// <summary>
+            /// Forgets every dirty slot and moves to the given checkpoint.
+            /// </summary>
+            void advance(uint64_t checkpoint) noexcept
+            {
+                m_checkpoint = checkpoint;
+                m_ready = 0;
+            }
+
+            // Words past m_ready were never written (see object_regions)
+            template<typename Fn>
+            void regions(Fn&& fn) const
+            {
+                fn(&m_checkpoint, sizeof(m_checkpoint));
+                fn(&m_ready, sizeof(m_ready));
+                fn(m_bits.data(), m_ready * sizeof(uint64_t));
+            }
+
+        private:
+            uint64_t                        m_checkpoint;
+            size_t                          m_ready; // Bitmap words below are zeroed
+            std::array<uint64_t, bit_words> m_bits;
+        };
+    }
+}
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "platform.h"
+#include "policy.h"
+
+namespace nonstd
+{
+    namespace detail
+    {
+        /// <summary>
+        /// The free slots of a keyed container, in the order the allocation
+        /// policy reuses them. head() is the slot the next insertion takes,
+        /// or the maximum Index if none are free. The list is threaded
+        /// through a link per slot that the container owns, reached through
+        /// the next accessor passed to push and pop. With no slots at all,
+        /// push and pop are never reached, and compile to nothing so that
+        /// no access to the container's empty link array is generated.
+        /// save writes the list's own state through write(const void*,
+        /// size_t), leaving out anything never initialized, and load reads
+        /// it back through read(void*, size_t), returning false if it names
+        /// a slot at or past limit (the container's high-water mark).
+        /// </summary>
+        template<typename Allocation, typename Index, size_t N>
+        class free_slots;
+
+        /// <summary>
+        /// A singly linked stack, pushed and popped at the head.
+        /// </summary>
+        template<typename Index, size_t N>
+        class free_slots<lifo_allocation, Index, N>
+        {
+        public:
+            static constexpr Index none = std::numeric_limits<Index>::max();
+
+            free_slots()
+                : m_head(none)
+            {
+                // Pass
+            }
+
+            Index head() const noexcept { return m_head; }
+
+            template<typename Next>
+            void push(Index index, Next&& next)
+            {
+                if constexpr (N == 0)
+                    return; // Nothing is ever freed, and links don't exist
+                next(index) = m_head;
+                m_head = index;
+            }
+
+            template<typename Next>
+            void pop(Next&& next)
+            {
+                if constexpr (N == 0)
+                    return; // Nothing is ever freed, and links don't exist
+                m_head = next(m_head);
+            }
+
+            /// <summary>
+            /// Whether pred holds for any of the next count slots to be
+            /// reused, visited in reuse order without popping them.
+            /// </summary>
+            template<typename Next, typename Pred>
+            bool any_of(size_t count, Next&& next, Pred&& pred) const
+            {
+                for (Index index = m_head; (count > 0) && (index != none); --count, index = next(index))
+                    if (pred(index))
+                        return true;
+                return false;
+            }
+
+            template<typename Write>
+            void save(Write&& write) const
+            {
+                write(&m_head, sizeof(m_head));
+            }
+
+            template<typename Read>
+            bool load(Read&& read, size_t limit)
+            {
+                read(&m_head, sizeof(m_head));
+                return (m_head == none) || (m_head < limit);
+            }
+
+        private:
+            Index m_head;
+        };
+
+        /// <summary>
+        /// A singly linked queue, pushed at the tail and popped at the head.
+        /// The tail is only meaningful while the queue is not empty.
+        /// </summary>
+        template<typename Index, size_t N>
+        class free_slots<fifo_allocation, Index, N>
+        {
+        public:
+            static constexpr Index none = std::numeric_limits<Index>::max();
+
+            free_slots()
+                : m_head(none)
+                , m_tail(none)
+            {
+                // Pass
+            }
+
+            Index head() const noexcept { return m_head; }
+
+            template<typename Next>
+            void push(Index index, Next&& next)
+            {
+                if constexpr (N == 0)
+                    return; // Nothing is ever freed, and links don't exist
+                next(index) = none;
+                if (m_head == none)
+                    m_head = index;
+                else
+                    next(m_tail) = index;
+                m_tail = index;
+            }
+
+            template<typename Next>
+            void pop(Next&& next)
+            {
+                if constexpr (N == 0)
+                    return; // Nothing is ever freed, and links don't exist
+                m_head = next(m_head);
+            }
+
+            template<typename Next, typename Pred>
+            bool any_of(size_t count, Next&& next, Pred&& pred) const
+            {
+                for (Index index = m_head; (count > 0) && (index != none); --count, index = next(index))
+                    if (pred(index))
+                        return true;
+                return false;
+            }
+
+            template<typename Write>
+            void save(Write&& write) const
+            {
+                write(&m_head, sizeof(m_head));
+                write(&m_tail, sizeof(m_tail));
+            }
+
+            template<typename Read>
+            bool load(Read&& read, size_t limit)
+            {
+                read(&m_head, sizeof(m_head));
+                read(&m_tail, sizeof(m_tail));
+                if (m_head == none)
+                    return true;
+                return (m_head < limit) && (m_tail < limit);
+            }
+
+        private:
+            Index m_head;
+            Index m_tail;
+        };
+
+        /// <summary>
+        /// A two-level bitmap of free slots. Each bit of the summary marks a
+        /// bitmap word with any free slot in it, so the lowest free slot is
+        /// found with one scan of the summary and two bit searches. Words
+        /// are zeroed as pushes first reach them, keeping construction O(1).
+        /// The per-slot links are unused and set to none.
+        /// </summary>
+        template<typename Index, size_t N>
+        class free_slots<lowest_index_allocation, Index, N>
+        {
+            static constexpr size_t bit_words = (N + 63) / 64;
+            static constexpr size_t summary_words = (bit_words + 63) / 64;
+
+        public:
+            static constexpr Index none = std::numeric_limits<Index>::max();
+
+            free_slots()
+                : m_head(none)
+                , m_ready()
+            {
+                // Pass
+            }
+
+            Index head() const noexcept { return m_head; }
+
+            template<typename Next>
+            void push(Index index, Next&& next)
+            {
+                if constexpr (N == 0)
+                    return; // Nothing is ever freed, and links don't exist
+                next(index) = none;
+
+                const size_t word = index / 64;
+                for (; m_ready <= word; ++m_ready)
+                {
+                    if ((m_ready % 64) == 0)
+                        m_summary[m_ready / 64] = 0;
+                    m_bits[m_ready] = 0;
+                }
+
+                m_bits[word] |= (uint64_t(1) << (index % 64));
+                m_summary[word / 64] |= (uint64_t(1) << (word % 64));
+                if ((m_head == none) || (index < m_head))
+                    m_head = index;
+            }
+
+            template<typename Next>
+            void pop(Next&&)
+            {
+                if constexpr (N == 0)
+                    return; // Nothing is ever freed, and links don't exist
+                const size_t word = m_head / 64;
+                m_bits[word] &= ~(uint64_t(1) << (m_head % 64));
+                if (m_bits[word] == 0)
+                    m_summary[word / 64] &= ~(uint64_t(1) << (word % 64));
+                m_head = lowest(word / 64);
+            }
+
+            // Free slots are reused lowest first, so visit the bitmap upward
+            template<typename Next, typename Pred>
+            bool any_of(size_t count, Next&&, Pred&& pred) const
+            {
+                if (m_head == none)
+                    return false;
+
+                for (size_t word = m_head / 64; (count > 0) && (word < m_ready); ++word)
+                {
+                    for (uint64_t bits = m_bits[word]; (count > 0) && (bits != 0); --count, bits &= (bits - 1))
+                        if (pred(static_cast<Index>((word * 64) + countr_zero64(bits))))
+                            return true;
+                }
+                return false;
+            }
+
+            // Only the words below m_ready were ever written
+            template<typename Write>
+            void save(Write&& write) const
+            {
+                write(&m_head, sizeof(m_head));
+                write(&m_ready, sizeof(m_ready));
+                write(m_summary.data(), ((m_ready + 63) / 64) * sizeof(uint64_t));
+                write(m_bits.data(), m_ready * sizeof(uint64_t));
+            }
+
+            // As above, for snapshots (see object_regions)
+            template<typename Fn>
+            void regions(Fn&& fn) const
+            {
+                save(fn);
+            }
+
+            template<typename Read>
+            bool load(Read&& read, size_t limit)
+            {
+                read(&m_head, sizeof(m_head));
+                read(&m_ready, sizeof(m_ready));
+                if ((m_ready > bit_words) || (m_ready > ((limit + 63) / 64)))
+                    return false;
+
+                read(m_summary.data(), ((m_ready + 63) / 64) * sizeof(uint64_t));
+                read(m_bits.data(), m_ready * sizeof(uint64_t));
+
+                // Every free bit is below the limit, marked in the summary,
+                // and the lowest of them is the head
+                for (size_t word = 0; word < m_ready; ++word)
+                {
+                    const size_t below = limit - std::min(limit, word * 64);
+                    if ((below < 64) && ((m_bits[word] >> below) != 0))
+                        return false;
+                    const bool marked = ((m_summary[word / 64] >> (word % 64)) & 1) != 0;
+                    if (marked != (m_bits[word] != 0))
+                        return false;
+                }
+                if ((m_ready % 64) != 0)
+                {
+                    if ((m_summary[m_ready / 64] >> (m_ready % 64)) != 0)
+                        return false;
+                }
+                return m_head == lowest(0);
+            }
+
+        private:
+            // Nothing below the summary word of the popped head is free
+            Index lowest(size_t first) const
+            {
+                for (size_t outer = first; (outer * 64) < m_ready; ++outer)
+                {
+                    if (m_summary[outer] != 0)
+                    {
+                        const size_t word = (outer * 64) + countr_zero64(m_summary[outer]);
+                        return static_cast<Index>((word * 64) + countr_zero64(m_bits[word]));
+                    }
+                }
+                return none;
+            }
+
+            Index                               m_head;
+            size_t                              m_ready; // Bitmap words below are zeroed
+            std::array<uint64_t, summary_words> m_summary;
+            std::array<uint64_t, bit_words>     m_bits;
+        };
+    }
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "policy.h"
+#include "versioned_key.h"
+
+namespace nonstd
+{
+    /// <summary>
+    /// The container operations an op_journal records.
+    /// </summary>
+    enum class journal_op : uint8_t
+    {
+        emplace = 1, // A value was inserted, and given the recorded key
+        remove  = 2, // The value at the recorded key was removed
+        clear   = 3, // The container was cleared
+        compact = 4, // A slot_array's dead values were compacted
+    };
+
+    /// <summary>
+    /// One journaled operation, with the key it produced or consumed.
+    /// Fixed size, so that a journal can be shipped as a plain array.
+    /// </summary>
+    struct journal_record
+    {
+        uint64_t   version;
+        uint32_t   index;
+        uint16_t   meta;
+        journal_op op;
+        uint8_t    reserved;
+    };
+
+    static_assert(sizeof(journal_record) == 16, "journal_record should pack into 16 bytes");
+
+    /// <summary>
+    /// A ring buffer of journal records over storage the caller provides
+    /// and keeps alive. Containers under the op_journaling policy append to
+    /// the journal attached to them. Records are read back out in order,
+    /// to be shipped elsewhere or replayed. When the ring is full, new
+    /// records are dropped and counted, as the container can't be stopped
+    /// mid-operation; a journal that has dropped records can't be replayed.
+    /// Not safe to use from several threads at once.
+    /// </summary>
+    class op_journal
+    {
+    public:
+        op_journal(journal_record* records, size_t capacity) noexcept
+            : m_records(records)
+            , m_capacity(capacity)
+            , m_head()
+            , m_tail()
+            , m_dropped()
+        {
+            // Pass
+        }
+
+        op_journal(const op_journal&)            = delete;
+        op_journal& operator=(const op_journal&) = delete;
+
+        size_t capacity() const noexcept { return m_capacity; }
+        size_t size()     const noexcept { return static_cast<size_t>(m_tail - m_head); }
+        bool empty()      const noexcept { return m_tail == m_head; }
+        bool full()       const noexcept { return size() == m_capacity; }
+
+        // Records that arrived while the journal was full and were lost
+        uint64_t dropped() const noexcept { return m_dropped; }
+
+        void push(const journal_record& record) noexcept
+        {
+            if (full())
+            {
+                ++m_dropped;
+                return;
+            }
+            m_records[m_tail % m_capacity] = record;
+            ++m_tail;
+        }
+
+        /// <summary>
+        /// Removes the oldest record into out. Returns false if empty.
+        /// </summary>
+        bool pop(journal_record& out) noexcept
+        {
+            if (empty())
+                return false;
+            out = m_records[m_head % m_capacity];
+            ++m_head;
+            return true;
+        }
+
+        /// <summary>
+        /// Removes up to count of the oldest records, in order, into out.
+        /// Returns the number removed.
+        /// </summary>
+        size_t read(journal_record* out, size_t count) noexcept
+        {
+            size_t taken = 0;
+            for (; (taken < count) && pop(out[taken]); ++taken) {}
+            return taken;
+        }
+
+        /// <summary>
+        /// Appends count records, such as ones read from another journal.
+        /// Any that don't fit are dropped, as with push.
+        /// </summary>
+        void write(const journal_record* records, size_t count) noexcept
+        {
+            for (size_t idx = 0; idx < count; ++idx)
+                push(records[idx]);
+        }
+
+    private:
+        journal_record* m_records;
+        size_t          m_capacity;
+        uint64_t        m_head;    // Records popped so far
+        uint64_t        m_tail;    // Records pushed so far
+        uint64_t        m_dropped;
+    };
+
+    namespace detail
+    {
+        /// <summary>
+        /// A container's link to its journal under the given policy.
+        /// </summary>
+        template<typename Journal>
+        class journal_hook;
+
+        template<>
+        class journal_hook<no_journal>
+        {
+        public:
+            static constexpr bool enabled = false;
+
+            template<typename Key>
+            void record(journal_op, const Key&) noexcept {}
+        };
+
+        template<>
+        class journal_hook<op_journaling>
+        {
+        public:
+            static constexpr bool enabled = true;
+
+            journal_hook()
+                : m_journal(nullptr)
+            {
+                // Pass
+            }
+
+            void attach(op_journal* journal) noexcept { m_journal = journal; }
+            op_journal* attached() const noexcept     { return m_journal; }
+
+            template<typename Key>
+            void record(journal_op op, const Key& key) noexcept
+            {
+                using traits = key_traits<Key>;
+                static_assert(sizeof(typename traits::version_type) <= sizeof(uint64_t) &&
+                              sizeof(typename traits::index_type)   <= sizeof(uint32_t) &&
+                              sizeof(typename Key::meta_type)       <= sizeof(uint16_t),
+                    "key fields too wide for journal_record");
+
+                if (m_journal != nullptr)
+                {
+                    m_journal->push({
+                        static_cast<uint64_t>(traits::version(key)),
+                        static_cast<uint32_t>(traits::index(key)),
+                        static_cast<uint16_t>(key.meta()),
+                        op,
+                        0 });
+                }
+            }
+
+        private:
+            op_journal* m_journal;
+        };
+
+        template<typename T, typename = void>
+        struct has_compact : std::false_type {};
+
+        template<typename T>
+        struct has_compact<T, std::void_t<decltype(std::declval<T&>().compact())>>
+            : std::true_type {};
+    }
+
+    /// <summary>
+    /// Applies the records in a journal, oldest first, to a follower
+    /// container of the same type, popping each one. Inserted values are
+    /// built by make_value(record), and must be given the recorded key,
+    /// which they will be if the follower started in the leader's state
+    /// (for instance both empty) and has seen every record since. The free
+    /// lists then hold the same slots in the same order. Returns the number
+    /// of records applied.
+    ///
+    /// Throws std::overflow_error, applying nothing, if the journal has
+    /// dropped records, and std::logic_error if the follower produces a
+    /// different key or has no value to remove, as it has then diverged.
+    /// </summary>
+    template<typename Container, typename MakeValue>
+    size_t replay(op_journal& journal, Container& container, MakeValue&& make_value)
+    {
+        using key_type    = typename Container::key_type;
+        using traits      = key_traits<key_type>;
+        using value_type  = typename Container::value_type;
+
+        if (journal.dropped() != 0)
+            throw std::overflow_error("op_journal dropped records");
+
+        size_t replayed = 0;
+        for (journal_record record; journal.pop(record); ++replayed)
+        {
+            const key_type key = traits::make(
+                static_cast<typename traits::version_type>(record.version),
+                static_cast<typename traits::index_type>(record.index),
+                static_cast<typename key_type::meta_type>(record.meta));
+
+            switch (record.op)
+            {
+            case journal_op::emplace:
+            {
+                const key_type made = container.template emplace_back<value_type>(
+                    make_value(static_cast<const journal_record&>(record)), key.meta());
+                if ((traits::index(made) != traits::index(key)) ||
+                    (traits::version(made) != traits::version(key)))
+                    throw std::logic_error("replay produced a different key than the journal");
+                break;
+            }
+
+            case journal_op::remove:
+                if (container.try_remove(key) == false)
+                    throw std::logic_error("replay found no value to remove");
+                break;
+
+            case journal_op::clear:
+                container.clear();
+                break;
+
+            case journal_op::compact:
+                if constexpr (detail::has_compact<Container>::value)
+                    container.compact();
+                break;
+
+            default:
+                throw std::logic_error("unknown journal record");
+            }
+        }
+        return replayed;
+    }
+}
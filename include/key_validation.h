@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "platform.h"
+
+namespace nonstd
+{
+    namespace detail
+    {
+        /// <summary>
+        /// The slot state of a keyed_array that keys are validated against.
+        /// Keys are read as 8-byte records holding a 32-bit version and then
+        /// a 16-bit index, as laid out by versioned_key.
+        /// </summary>
+        struct key_slots
+        {
+            const uint32_t* versions;
+            const uint16_t* free;       // Needs a spare entry past high_water - 1
+            uint32_t        high_water; // Must be nonzero
+            uint16_t        slot_full;
+        };
+
+        struct key_record
+        {
+            uint32_t version;
+            uint16_t index;
+            uint16_t meta;
+        };
+
+        static_assert(sizeof(key_record) == 8, "unexpected key_record padding");
+
+        // A validation kernel checks up to 64 keys, returning one bit per key
+        using validate_kernel = uint64_t(*)(const unsigned char*, size_t, const key_slots&);
+
+        /// <summary>
+        /// Checks each key in turn. Out-of-range keys are redirected to slot
+        /// zero, which is known to be initialized, so that there's nothing to
+        /// branch on but the loop itself.
+        /// </summary>
+        inline uint64_t validate_keys_scalar(
+            const unsigned char* keys,
+            size_t count,
+            const key_slots& slots)
+        {
+            uint64_t bits = 0;
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                key_record key;
+                std::memcpy(&key, keys + (idx * sizeof(key_record)), sizeof(key_record));
+
+                const bool in_range = (key.index < slots.high_water);
+                const size_t index = in_range ? key.index : 0;
+                const bool valid =
+                    in_range &
+                    (slots.free[index] == slots.slot_full) &
+                    (slots.versions[index] == key.version);
+
+                bits |= static_cast<uint64_t>(valid) << idx;
+            }
+            return bits;
+        }
+
+#if defined(NONSTD_SIMD_DISPATCH)
+        /// <summary>
+        /// Checks eight keys per step with AVX2 gathers. Lanes for keys out of
+        /// range are masked off and never gathered. A 32-bit gather of a
+        /// 16-bit free entry reads two bytes past it, hence that requirement.
+        /// </summary>
+        NONSTD_TARGET("avx2")
+        inline uint64_t validate_keys_avx2(
+            const unsigned char* keys,
+            size_t count,
+            const key_slots& slots)
+        {
+            const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+            const __m256i low_half = _mm256_set1_epi32(0xFFFF);
+            const __m256i high_water = _mm256_set1_epi32(static_cast<int>(slots.high_water));
+            const __m256i slot_full = _mm256_set1_epi32(slots.slot_full);
+            const int* versions = reinterpret_cast<const int*>(slots.versions);
+            const int* free = reinterpret_cast<const int*>(slots.free);
+
+            uint64_t bits = 0;
+            size_t idx = 0;
+            for (; (idx + 8) <= count; idx += 8)
+            {
+                const unsigned char* chunk = keys + (idx * sizeof(key_record));
+                const __m256i lo = _mm256_permutevar8x32_epi32(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk)), deinterleave);
+                const __m256i hi = _mm256_permutevar8x32_epi32(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk + 32)), deinterleave);
+
+                const __m256i key_versions = _mm256_permute2x128_si256(lo, hi, 0x20);
+                const __m256i key_indices = _mm256_and_si256(
+                    _mm256_permute2x128_si256(lo, hi, 0x31), low_half);
+
+                // Indices are at most 16 bits, so a signed compare is safe
+                const __m256i in_range = _mm256_cmpgt_epi32(high_water, key_indices);
+                const __m256i slot_versions = _mm256_mask_i32gather_epi32(
+                    _mm256_setzero_si256(), versions, key_indices, in_range, 4);
+                const __m256i slot_free = _mm256_and_si256(
+                    _mm256_mask_i32gather_epi32(
+                        _mm256_setzero_si256(), free, key_indices, in_range, 2),
+                    low_half);
+
+                const __m256i valid = _mm256_and_si256(
+                    in_range,
+                    _mm256_and_si256(
+                        _mm256_cmpeq_epi32(slot_versions, key_versions),
+                        _mm256_cmpeq_epi32(slot_free, slot_full)));
+
+                const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+                bits |= static_cast<uint64_t>(static_cast<uint32_t>(mask)) << idx;
+            }
+
+            if (idx < count)
+            {
+                const unsigned char* rest = keys + (idx * sizeof(key_record));
+                bits |= validate_keys_scalar(rest, count - idx, slots) << idx;
+            }
+            return bits;
+        }
+
+        /// <summary>
+        /// Checks sixteen keys per step with AVX-512 gathers, with the same
+        /// masking and over-read as the AVX2 kernel.
+        /// </summary>
+        NONSTD_TARGET("avx512f")
+        inline uint64_t validate_keys_avx512(
+            const unsigned char* keys,
+            size_t count,
+            const key_slots& slots)
+        {
+            const __m512i even = _mm512_setr_epi32(
+                0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+            const __m512i odd = _mm512_setr_epi32(
+                1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31);
+            const __m512i low_half = _mm512_set1_epi32(0xFFFF);
+            const __m512i high_water = _mm512_set1_epi32(static_cast<int>(slots.high_water));
+            const __m512i slot_full = _mm512_set1_epi32(slots.slot_full);
+
+            uint64_t bits = 0;
+            size_t idx = 0;
+            for (; (idx + 16) <= count; idx += 16)
+            {
+                const unsigned char* chunk = keys + (idx * sizeof(key_record));
+                const __m512i lo = _mm512_loadu_si512(chunk);
+                const __m512i hi = _mm512_loadu_si512(chunk + 64);
+
+                const __m512i key_versions = _mm512_permutex2var_epi32(lo, even, hi);
+                const __m512i key_indices = _mm512_and_si512(
+                    _mm512_permutex2var_epi32(lo, odd, hi), low_half);
+
+                const __mmask16 in_range = _mm512_cmplt_epu32_mask(key_indices, high_water);
+                const __m512i slot_versions = _mm512_mask_i32gather_epi32(
+                    _mm512_setzero_si512(), in_range, key_indices, slots.versions, 4);
+                const __m512i slot_free = _mm512_and_si512(
+                    _mm512_mask_i32gather_epi32(
+                        _mm512_setzero_si512(), in_range, key_indices, slots.free, 2),
+                    low_half);
+
+                const __mmask16 valid =
+                    _mm512_mask_cmpeq_epi32_mask(in_range, slot_versions, key_versions) &
+                    _mm512_cmpeq_epi32_mask(slot_free, slot_full);
+
+                bits |= static_cast<uint64_t>(valid) << idx;
+            }
+
+            if (idx < count)
+            {
+                const unsigned char* rest = keys + (idx * sizeof(key_record));
+                bits |= validate_keys_scalar(rest, count - idx, slots) << idx;
+            }
+            return bits;
+        }
+#endif
+
+        /// <summary>
+        /// Picks the widest kernel the running CPU supports.
+        /// </summary>
+        inline validate_kernel select_validate_kernel() noexcept
+        {
+#if defined(NONSTD_SIMD_DISPATCH)
+            if (cpu_features().avx512f)
+                return validate_keys_avx512;
+            if (cpu_features().avx2)
+                return validate_keys_avx2;
+#endif
+            return validate_keys_scalar;
+        }
+
+        /// <summary>
+        /// Validates count keys with the given kernel, writing one bit per
+        /// key to valid, 64 to a word. Returns the number of valid keys.
+        /// </summary>
+        inline size_t validate_keys(
+            validate_kernel kernel,
+            const void* keys,
+            size_t count,
+            const key_slots& slots,
+            uint64_t* valid)
+        {
+            const unsigned char* bytes = static_cast<const unsigned char*>(keys);
+
+            size_t found = 0;
+            for (size_t first = 0; first < count; first += 64)
+            {
+                const size_t block = ((count - first) < 64) ? (count - first) : 64;
+                const uint64_t bits = (slots.high_water == 0) ? 0 :
+                    kernel(bytes + (first * sizeof(key_record)), block, slots);
+
+                valid[first / 64] = bits;
+                found += popcount64(bits);
+            }
+            return found;
+        }
+    }
+}
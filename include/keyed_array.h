@@ -1,19 +1,38 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "dirty_slots.h"
+#include "free_slots.h"
+#include "journal.h"
+#include "key_validation.h"
+#include "platform.h"
+#include "policy.h"
 #include "raw_buffer.h"
 #include "versioned_key.h"
 
 namespace nonstd
 {
-    template<class T, size_t N, typename Key = versioned_key>
+    template<
+        class T,
+        size_t N,
+        typename Key = versioned_key,
+        typename Policy = default_policy>
     class keyed_array
+        : private detail::hook_base<typename Policy::stats_type>
+        , private detail::hook_base<detail::dirty_slots<typename Policy::tracking_type, N>>
+        , private detail::hook_base<detail::journal_hook<typename Policy::journal_type>>
     {
     public:
         using value_type        = T;
@@ -25,26 +44,86 @@ namespace nonstd
         using iterator          = T*;
         using const_iterator    = const T*;
         using key_type          = Key;
+        using key_traits_type   = nonstd::key_traits<Key>;
         using version_type      = typename key_type::version_type;
         using index_type        = typename key_type::index_type;
         using meta_type         = typename key_type::meta_type;
+        using policy_type       = Policy;
+        using stats_type        = typename policy_type::stats_type;
+        using overflow_type     = typename policy_type::overflow_type;
+        using allocation_type   = typename policy_type::allocation_type;
+        using storage_type      = typename policy_type::storage_type;
+        using tracking_type     = typename policy_type::tracking_type;
+        using journal_type      = typename policy_type::journal_type;
+
+        // Slot metadata types, as small as N and the version policy allow
+        using slot_index_type   = detail::uint_fitting_t<N + 1>;
+        using slot_version_type = detail::slot_version_t<Policy, version_type>;
 
         static constexpr auto capacity = N;
 
     private:
-        static const index_type max_index = std::numeric_limits<index_type>::max();
-        static const index_type invalid_index = max_index;
-        static const index_type slot_full = max_index - 1;
-        static_assert(N <= slot_full, "keyed_array too large for index_type");
+        static const index_type max_index = key_traits_type::max_index;
+        static_assert(N <= max_index - 1, "keyed_array too large for index_type");
+
+        static const slot_index_type invalid_index =
+            std::numeric_limits<slot_index_type>::max();
+        static const slot_index_type slot_full = invalid_index - 1;
+
+        static const slot_version_type max_version =
+            static_cast<slot_version_type>(std::min<uint64_t>(
+                key_traits_type::max_version,
+                std::numeric_limits<slot_version_type>::max()));
+
+        using free_slots_type =
+            detail::free_slots<allocation_type, slot_index_type, N>;
+        using dirty_slots_type =
+            detail::dirty_slots<tracking_type, N>;
+        using journal_hook_type =
+            detail::journal_hook<journal_type>;
+        using stats_base =
+            detail::hook_base<stats_type>;
+        using dirty_base =
+            detail::hook_base<dirty_slots_type>;
+        using journal_base =
+            detail::hook_base<journal_hook_type>;
+
+        // Ends the slot records of a delta snapshot
+        static constexpr uint64_t delta_end = std::numeric_limits<uint64_t>::max();
+
+        // How many keys ahead get_many prefetches
+        static constexpr size_t prefetch_distance = 8;
+
+        // One occupancy bit per slot, 64 slots to a word
+        static constexpr size_t occupancy_words = (N + 63) / 64;
+
+        // The vectorized validate_many kernels read versioned_key's layout
+        // and the default slot metadata types directly, and can't call the
+        // statistics hooks per key
+        static constexpr bool simd_keys =
+            std::is_same_v<key_type, versioned_key> &&
+            std::is_same_v<slot_index_type, uint16_t> &&
+            std::is_same_v<slot_version_type, uint32_t> &&
+            std::is_same_v<stats_type, no_stats>;
+
+        // Those kernels gather each 16-bit free entry with a 32-bit load,
+        // which reads the entry after it, so m_free has one spare entry at
+        // the end. Only the masked-off upper half of a gather ever reads it.
+        static constexpr size_t free_entries = simd_keys ? (N + 1) : N;
 
     public:
+        /// <summary>
+        /// Constructs an empty keyed array in O(1). Slot metadata is only
+        /// initialized when a slot is first used, so the data, version and
+        /// free arrays are deliberately left uninitialized here.
+        /// </summary>
         keyed_array()
-            : m_free_head()
-            , m_data()
-            , m_versions()
-            , m_free()
+            : m_size()
+            , m_free_slots()
+            , m_high_water()
+            , m_retired()
         {
-            reset_metadata();
+            // Pass
         }
 
         ~keyed_array()
@@ -59,8 +138,67 @@ namespace nonstd
         keyed_array& operator=(keyed_array&&)      = delete;
 
         // Size and capacity
+        constexpr size_t size()       const noexcept { return m_size; }
         constexpr size_t max_size()   const noexcept { return N; }
-        constexpr bool full()         const noexcept { return m_free_head == invalid_index; }
+        constexpr bool empty()        const noexcept { return m_size == 0; }
+        constexpr bool full()         const noexcept { return (m_free_slots.head() == invalid_index) && (m_high_water >= N); }
+
+        // Slots permanently taken out of use (see retire_on_overflow)
+        constexpr size_t retired()    const noexcept { return m_retired; }
+
+        // Statistics (see policy.h)
+        const stats_type& stats()     const noexcept { return stats_hook(); }
+        void reset_stats()                  noexcept { stats_hook().reset(); }
+
+        // Delta snapshots written or applied so far (see dirty_tracking)
+        uint64_t checkpoint()         const noexcept { return dirty_hook().checkpoint(); }
+
+        /// <summary>
+        /// Sets the journal that insertions and removals are recorded to
+        /// under op_journaling, or stops recording if given nullptr.
+        /// </summary>
+        void attach_journal(op_journal* journal) noexcept
+        {
+            static_assert(journal_hook_type::enabled, "attach_journal needs op_journaling");
+            journal_hook().attach(journal);
+        }
+
+        op_journal* journal() const noexcept
+        {
+            static_assert(journal_hook_type::enabled, "journal needs op_journaling");
+            return journal_hook().attached();
+        }
+
+        /// <summary>
+        /// Passes each initialized byte range of the array to
+        /// fn(const void*, size_t): its counters, free list and hooks, the
+        /// metadata of slots below the high-water mark, and the value of
+        /// each live slot. The rest is left out, so that save_snapshot
+        /// never writes memory the array hasn't set.
+        /// </summary>
+        template<typename Fn>
+        void regions(Fn&& fn) const
+        {
+            detail::object_regions(stats_hook(), fn);
+            detail::object_regions(dirty_hook(), fn);
+            detail::object_regions(journal_hook(), fn);
+            fn(&m_size, sizeof(m_size));
+            detail::object_regions(m_free_slots, fn);
+            fn(&m_high_water, sizeof(m_high_water));
+
+            const size_t words = (m_high_water + 63) / 64;
+            for (size_t word = 0; word < words; ++word)
+                for (uint64_t bits = m_occupied[word]; bits != 0; bits &= bits - 1)
+                    fn(m_data.data() + (word * 64) + countr_zero64(bits), sizeof(T));
+
+            fn(m_versions.data(), m_high_water * sizeof(slot_version_type));
+            fn(m_free.data(), m_high_water * sizeof(slot_index_type));
+            fn(m_occupied.data(), words * sizeof(uint64_t));
+            fn(&m_retired, sizeof(m_retired));
+        }
+
+        class key_iterator;
+        class key_range;
 
         /// <summary>
         /// Inserts a value into the keyed array.
@@ -69,22 +207,83 @@ namespace nonstd
         template<typename ... Args>
         key_type emplace_back(Args&& ... args, meta_type meta = 0)
         {
-            if (m_free_head == invalid_index)
-                throw std::out_of_range("keyed_array has no free slots");
-            const index_type index = m_free_head;
+            const slot_index_type index = next_slot();
 
-            // We could probably recover by just orphaning this slot, but
-            // that would make insertion O(n) as we'd have to find the next.
-            // Otherwise this is fatal as it makes all key handles unsafe.
-            if (increment_version(m_versions[index]) == false)
+            // This is fatal as it makes all key handles unsafe. To recover,
+            // use retire_on_overflow, which orphans saturated slots when they
+            // are freed so that they never reach the free list at all.
+            slot_version_type version = m_versions[index];
+            if (increment_version(version) == false)
                 throw std::overflow_error("keyed_array version overflow");
 
-            // Store data and update structure status information
+            // Store data first, so that a throwing constructor leaves the
+            // slot's version as it was and nothing goes unjournaled
             m_data.emplace(index, std::forward<Args>(args) ...);
-            m_free_head = m_free[index];
+            m_versions[index] = version;
+            claim_slot();
             m_free[index] = slot_full;
+            set_occupied(index);
+            ++m_size;
+
+            stats_hook().on_insert(m_versions[index]);
+            const key_type key = key_traits_type::make(m_versions[index], index, meta);
+            journal_hook().record(journal_op::emplace, key);
+            return key;
+        }
+
+        /// <summary>
+        /// Inserts count values, each constructed from the same arguments,
+        /// and writes their keys to keys_out. Throws std::out_of_range before
+        /// inserting anything if there is no room for all of them, or
+        /// std::overflow_error if a freed slot it would reuse has run out
+        /// of versions. If constructing a value throws, the values inserted
+        /// before it stay, and their keys have been written to keys_out.
+        /// Returns the output iterator past the last key written.
+        /// </summary>
+        template<typename OutputIt, typename ... Args>
+        OutputIt emplace_n(size_t count, OutputIt keys_out, const Args& ... args)
+        {
+            constexpr bool no_throw =
+                std::is_nothrow_constructible_v<T, const Args& ...>;
+
+            return insert_n<no_throw>(count, keys_out, 0,
+                [&](size_t pos) { m_data.emplace(pos, args ...); });
+        }
+
+        /// <summary>
+        /// Inserts a value constructed from each element in [first, last)
+        /// and writes their keys to keys_out, as emplace_n does.
+        /// Single-pass input iterators can't be counted up front, so those
+        /// are inserted one element at a time instead.
+        /// </summary>
+        template<typename InputIt, typename OutputIt>
+        OutputIt emplace_range(
+            InputIt first,
+            InputIt last,
+            OutputIt keys_out,
+            meta_type meta = 0)
+        {
+            using traits = std::iterator_traits<InputIt>;
+            using source_type = typename traits::reference;
+
+            if constexpr (std::is_base_of_v<
+                std::forward_iterator_tag,
+                typename traits::iterator_category>)
+            {
+                constexpr bool no_throw =
+                    std::is_nothrow_constructible_v<T, source_type> &&
+                    noexcept(*first) && noexcept(++first);
 
-            return key_type(m_versions[index], index, meta);
+                const size_t count = static_cast<size_t>(std::distance(first, last));
+                return insert_n<no_throw>(count, keys_out, meta,
+                    [&](size_t pos) { m_data.emplace(pos, *first); ++first; });
+            }
+            else
+            {
+                for (; first != last; ++first)
+                    *keys_out++ = emplace_back<source_type>(*first, meta);
+                return keys_out;
+            }
         }
 
         /// <summary>
@@ -95,7 +294,7 @@ namespace nonstd
         {
             if (evaluate_key(key) == false)
                 return nullptr;
-            return std::addressof(m_data[key.m_index]);
+            return std::addressof(m_data[key_traits_type::index(key)]);
         }
 
         /// <summary>
@@ -106,7 +305,82 @@ namespace nonstd
         {
             if (evaluate_key(key) == false)
                 return nullptr;
-            return std::addressof(m_data[key.m_index]);
+            return std::addressof(m_data[key_traits_type::index(key)]);
+        }
+
+        /// <summary>
+        /// Resolves count keys at once, writing a pointer to each value (or
+        /// nullptr for keys that did not match) to out. Returns the number of
+        /// keys that matched. Prefetches the slot metadata and value of keys
+        /// further ahead, so that their cache misses overlap rather than
+        /// each lookup waiting on the last.
+        /// </summary>
+        size_t get_many(const key_type* keys, size_t count, T** out)
+        {
+            size_t found = 0;
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                prefetch_ahead(keys, count, idx);
+                out[idx] = try_get(keys[idx]);
+                found += (out[idx] != nullptr);
+            }
+            return found;
+        }
+
+        /// <summary>
+        /// Resolves count keys at once, writing a pointer to each value (or
+        /// nullptr for keys that did not match) to out. Returns the number of
+        /// keys that matched.
+        /// </summary>
+        size_t get_many(const key_type* keys, size_t count, const T** out) const
+        {
+            size_t found = 0;
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                prefetch_ahead(keys, count, idx);
+                out[idx] = try_get(keys[idx]);
+                found += (out[idx] != nullptr);
+            }
+            return found;
+        }
+
+        /// <summary>
+        /// Checks count keys at once, setting bit (i % 64) of valid[i / 64]
+        /// if key i matches a live value and clearing it otherwise. valid
+        /// must hold (count + 63) / 64 words. Returns the number of matches.
+        /// For the default key and statistics types, keys are checked 16 or
+        /// 8 at a time with AVX-512 or AVX2 gathers where the CPU supports
+        /// them, and without branching per key otherwise.
+        /// </summary>
+        size_t validate_many(const key_type* keys, size_t count, uint64_t* valid) const
+        {
+            if constexpr (simd_keys)
+            {
+                static const detail::validate_kernel kernel =
+                    detail::select_validate_kernel();
+
+                // The over-read of the last entry lands in m_free's spare entry
+                const detail::key_slots slots = {
+                    m_versions.data(),
+                    m_free.data(),
+                    static_cast<uint32_t>(m_high_water),
+                    slot_full };
+                return detail::validate_keys(kernel, keys, count, slots, valid);
+            }
+            else
+            {
+                size_t found = 0;
+                for (size_t first = 0; first < count; first += 64)
+                {
+                    uint64_t bits = 0;
+                    for (size_t idx = first; (idx < count) && (idx < first + 64); ++idx)
+                        bits |= static_cast<uint64_t>(evaluate_key(keys[idx])) << (idx - first);
+
+                    valid[first / 64] = bits;
+                    found += popcount64(bits);
+                }
+                return found;
+            }
         }
 
         /// <summary>
@@ -118,72 +392,632 @@ namespace nonstd
             if (evaluate_key(key) == false)
                 return false;
 
-            destroy_at(key.m_index);
+            destroy_at(static_cast<slot_index_type>(key_traits_type::index(key)));
+            stats_hook().on_erase();
+            journal_hook().record(journal_op::remove, key);
+            return true;
+        }
+
+        /// <summary>
+        /// Marks the value at a given key as changed, so that the next delta
+        /// snapshot carries it. Needed after modifying a value in place, as
+        /// only insertion and removal are tracked automatically.
+        /// Returns false if no value was found.
+        /// </summary>
+        bool mark_dirty(key_type key)
+        {
+            if (evaluate_key(key) == false)
+                return false;
+
+            dirty_hook().touch(key_traits_type::index(key));
             return true;
         }
 
         /// <summary>
-        /// Clears and reorganizes the keyed array.
-        /// Does not reset version numbers on slots.
+        /// Writes a delta snapshot through write(const void*, size_t): the
+        /// array's counters and the initialized part of its free list, then
+        /// the version, free-list link and (if live) value of every slot
+        /// changed since the last delta, grouped by 64-slot word. Starts the
+        /// next checkpoint. Applying it to an array in the state of the
+        /// previous checkpoint, such as a replica restored from a full
+        /// snapshot, brings it up to date. A full snapshot keeps the dirty
+        /// slots, so to start a compact chain of deltas, write one to a sink
+        /// that drops it right before. Needs dirty_tracking and trivially
+        /// copyable values.
+        /// </summary>
+        template<typename Write>
+        void write_delta(Write&& write)
+        {
+            static_assert(dirty_slots_type::enabled, "write_delta needs dirty_tracking");
+            static_assert(std::is_trivially_copyable_v<T>, "delta values must be trivially copyable");
+
+            const uint64_t checkpoint = dirty_hook().checkpoint();
+            const uint64_t counters[] = { checkpoint, checkpoint + 1, m_size, m_high_water, m_retired };
+            write(counters, sizeof(counters));
+            m_free_slots.save(write);
+
+            for (size_t word = 0; word < dirty_hook().words(); ++word)
+            {
+                const uint64_t dirty = dirty_hook().word(word);
+                if (dirty == 0)
+                    continue;
+
+                const uint64_t record[] = { word, dirty, m_occupied[word] };
+                write(record, sizeof(record));
+                for (uint64_t bits = dirty; bits != 0; bits &= bits - 1)
+                {
+                    const size_t idx = (word * 64) + countr_zero64(bits);
+                    write(std::addressof(m_versions[idx]), sizeof(slot_version_type));
+                    write(std::addressof(m_free[idx]), sizeof(slot_index_type));
+                    if (m_free[idx] == slot_full)
+                        write(m_data.data() + idx, sizeof(T));
+                }
+            }
+
+            write(&delta_end, sizeof(delta_end));
+            dirty_hook().advance(checkpoint + 1);
+        }
+
+        /// <summary>
+        /// Applies a delta snapshot read through read(void*, size_t), which
+        /// must fill the buffer or throw. Throws std::runtime_error if the
+        /// delta doesn't start at this array's checkpoint, or if any of its
+        /// counters, free-list state, slot indices or links are out of range
+        /// or disagree. The whole delta is read and checked first, so a
+        /// throw changes nothing. Changes applied here are not themselves
+        /// marked dirty.
+        /// </summary>
+        template<typename Read>
+        void apply_delta(Read&& read)
+        {
+            static_assert(dirty_slots_type::enabled, "apply_delta needs dirty_tracking");
+            static_assert(std::is_trivially_copyable_v<T>, "delta values must be trivially copyable");
+
+            uint64_t counters[5];
+            read(counters, sizeof(counters));
+            if (counters[0] != dirty_hook().checkpoint())
+                throw std::runtime_error("delta does not follow this keyed_array's checkpoint");
+
+            // The high-water mark never falls, and bounds everything else
+            const uint64_t high_water = counters[3];
+            if ((counters[1] != (counters[0] + 1)) ||
+                (high_water > N) || (high_water < m_high_water) ||
+                (counters[2] > high_water) || (counters[4] > (high_water - counters[2])))
+                throw std::runtime_error("malformed keyed_array delta");
+
+            free_slots_type free_slots;
+            if (free_slots.load(read, static_cast<size_t>(high_water)) == false)
+                throw std::runtime_error("malformed keyed_array delta");
+
+            struct staged_slot
+            {
+                size_t            index;
+                slot_version_type version;
+                slot_index_type   link;
+            };
+
+            std::vector<std::pair<size_t, uint64_t>> words;
+            std::vector<staged_slot> slots;
+            std::vector<unsigned char> values;
+            for (;;)
+            {
+                uint64_t word = 0;
+                read(&word, sizeof(word));
+                if (word == delta_end)
+                    break;
+
+                // Words come in ascending order, holding only slots below
+                // the high-water mark
+                uint64_t record[2];
+                read(record, sizeof(record));
+                if ((word >= ((high_water + 63) / 64)) || ((words.empty() == false) && (word <= words.back().first)))
+                    throw std::runtime_error("malformed keyed_array delta");
+                const uint64_t mask = slot_mask(static_cast<size_t>(word), static_cast<size_t>(high_water));
+                if (((record[0] & ~mask) != 0) || ((record[1] & ~mask) != 0))
+                    throw std::runtime_error("malformed keyed_array delta");
+
+                for (uint64_t bits = record[0]; bits != 0; bits &= bits - 1)
+                {
+                    const size_t idx = (static_cast<size_t>(word) * 64) + countr_zero64(bits);
+                    staged_slot slot = { idx, slot_version_type(), slot_index_type() };
+                    read(&slot.version, sizeof(slot_version_type));
+                    read(&slot.link, sizeof(slot_index_type));
+
+                    const bool occupied = ((record[1] >> (idx % 64)) & 1) != 0;
+                    const bool full = (slot.link == slot_full);
+                    if ((occupied != full) || ((full == false) && (slot.link != invalid_index) && (slot.link >= high_water)))
+                        throw std::runtime_error("malformed keyed_array delta");
+
+                    if (full)
+                    {
+                        values.resize(values.size() + sizeof(T));
+                        read(values.data() + values.size() - sizeof(T), sizeof(T));
+                    }
+                    slots.push_back(slot);
+                }
+                words.emplace_back(static_cast<size_t>(word), record[1]);
+            }
+
+            const unsigned char* value = values.data();
+            for (const staged_slot& slot : slots)
+            {
+                m_versions[slot.index] = slot.version;
+                m_free[slot.index] = slot.link;
+                if (slot.link == slot_full)
+                {
+                    std::memcpy(static_cast<void*>(m_data.data() + slot.index), value, sizeof(T));
+                    value += sizeof(T);
+                }
+            }
+            for (const auto& [word, occupied] : words)
+                m_occupied[word] = occupied;
+
+            m_free_slots = free_slots;
+            m_size = static_cast<size_t>(counters[2]);
+            m_high_water = static_cast<size_t>(high_water);
+            m_retired = static_cast<size_t>(counters[4]);
+            dirty_hook().advance(counters[1]);
+        }
+
+        /// <summary>
+        /// Clears the keyed array, returning the slots of live elements to
+        /// the free list. Only occupied slots are visited, highest first, so
+        /// that under lifo_allocation the lowest freed slot is reused next.
+        /// Does not reset version numbers on slots. Under op_journaling,
+        /// each value cleared is recorded as its own removal, in this order.
         /// </summary>
         void clear()
         {
-            destroy_all();
-            reset_metadata();
+            for (size_t word = (m_high_water + 63) / 64; word-- > 0;)
+            {
+                for (uint64_t bits = m_occupied[word]; bits != 0;)
+                {
+                    const unsigned bit = highest_bit64(bits);
+                    bits &= ~(uint64_t(1) << bit);
+
+                    // A follower replays these through try_remove, freeing
+                    // the same slots in the same order, and fails on any
+                    // value it doesn't hold rather than diverging silently
+                    const auto index = static_cast<slot_index_type>((word * 64) + bit);
+                    journal_hook().record(journal_op::remove, key_traits_type::make(m_versions[index], index, 0));
+                    destroy_at(index);
+                }
+            }
+            stats_hook().on_clear();
+
+            // The removals are already recorded, so a follower's clear
+            // finds it empty
+            journal_hook().record(journal_op::clear, key_traits_type::make(0, 0, 0));
+        }
+
+        /// <summary>
+        /// Calls fn(key, value) for every live value, in slot order. Empty
+        /// runs of 64 slots are skipped with a single test. fn may remove
+        /// any value, including the one it was given. Values inserted by fn
+        /// may or may not be visited. Keys carry no meta data, as that is
+        /// not stored in the array.
+        /// </summary>
+        template<typename Fn>
+        void for_each_occupied(Fn&& fn)
+        {
+            const size_t words = (m_high_water + 63) / 64;
+            for (size_t word = 0; word < words; ++word)
+            {
+                for (uint64_t bits = m_occupied[word]; bits != 0;)
+                {
+                    const unsigned bit = countr_zero64(bits);
+                    const size_t idx = (word * 64) + bit;
+                    fn(key_at(idx), m_data[idx]);
+
+                    // Re-read, in case fn removed values later in this word
+                    bits = m_occupied[word] & (~uint64_t(1) << bit);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Calls fn(key, value) for every live value, in slot order.
+        /// </summary>
+        template<typename Fn>
+        void for_each_occupied(Fn&& fn) const
+        {
+            const size_t words = (m_high_water + 63) / 64;
+            for (size_t word = 0; word < words; ++word)
+            {
+                for (uint64_t bits = m_occupied[word]; bits != 0; bits &= bits - 1)
+                {
+                    const size_t idx = (word * 64) + countr_zero64(bits);
+                    fn(key_at(idx), m_data[idx]);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Returns a forward range over the keys of all live values, in slot
+        /// order. Keys carry no meta data. Removing a value only invalidates
+        /// iterators positioned at it.
+        /// </summary>
+        key_range keys() const noexcept
+        {
+            return key_range(this);
         }
 
     private:
-        static bool increment_version(version_type& version)
+        /// <summary>
+        /// Advances a slot's version, wrapping to zero past max_version.
+        /// Returns false if it wrapped, as zero is never a valid version.
+        /// </summary>
+        static bool increment_version(slot_version_type& version)
+        {
+            if constexpr (max_version == std::numeric_limits<slot_version_type>::max())
+            {
+                return (++version > 0);
+            }
+            else
+            {
+                version = (version == max_version) ?
+                    slot_version_type(0) : slot_version_type(version + 1);
+                return (version > 0);
+            }
+        }
+
+        /// <summary>
+        /// Finds the slot the next insertion will use, without claiming it.
+        /// Freed slots are reused first, in the order set by allocation_type.
+        /// Otherwise the slot at the high-water mark is initialized, as it
+        /// has never been used before.
+        /// </summary>
+        slot_index_type next_slot()
+        {
+            if (m_free_slots.head() != invalid_index)
+                return m_free_slots.head();
+            if (m_high_water >= N)
+                throw std::out_of_range("keyed_array has no free slots");
+
+            m_versions[m_high_water] = 0;
+            m_free[m_high_water] = invalid_index;
+            if ((m_high_water % 64) == 0)
+                m_occupied[m_high_water / 64] = 0;
+            return static_cast<slot_index_type>(m_high_water);
+        }
+
+        /// <summary>
+        /// Claims the slot returned by next_slot, once insertion succeeded.
+        /// </summary>
+        void claim_slot()
         {
-            return (++version > 0);
+            if (m_free_slots.head() != invalid_index)
+                m_free_slots.pop(next_free());
+            else
+                ++m_high_water;
         }
 
-        void reset_metadata()
+        /// <summary>
+        /// Shared body of emplace_n and emplace_range. Capacity and the
+        /// versions of the freed slots to reuse are checked once, freed
+        /// slots are refilled as in emplace_back, and the rest are taken in
+        /// bulk from past the high-water mark. When construction can't
+        /// throw, the metadata of those fresh slots is written first in a
+        /// separate loop that the compiler is free to vectorize.
+        /// </summary>
+        template<bool NoThrow, typename OutputIt, typename Construct>
+        OutputIt insert_n(
+            size_t count,
+            OutputIt keys_out,
+            meta_type meta,
+            Construct&& construct)
         {
-            if constexpr (N == 0)
+            // Every slot not live or retired is either free or never used
+            if (count > (N - m_size - m_retired))
+                throw std::out_of_range("keyed_array has no free slots");
+
+            // Retired slots never return to the free list, so only a slot
+            // that would throw on reuse needs checking for up front
+            if constexpr (overflow_type::retire_slots == false)
+            {
+                const auto peek_free = [this](slot_index_type index) { return m_free[index]; };
+                const bool saturated = m_free_slots.any_of(count, peek_free,
+                    [&](slot_index_type index) { return (m_versions[index] == max_version); });
+                if (saturated)
+                    throw std::overflow_error("keyed_array version overflow");
+            }
+
+            for (; (count > 0) && (m_free_slots.head() != invalid_index); --count)
             {
-                m_free_head = invalid_index;
-                return;
+                const slot_index_type index = m_free_slots.head();
+                slot_version_type version = m_versions[index];
+                if (increment_version(version) == false)
+                    throw std::overflow_error("keyed_array version overflow");
+
+                construct(index);
+                m_versions[index] = version;
+                claim_slot();
+                m_free[index] = slot_full;
+                set_occupied(index);
+                ++m_size;
+
+                stats_hook().on_insert(m_versions[index]);
+                const key_type key = key_traits_type::make(m_versions[index], index, meta);
+                journal_hook().record(journal_op::emplace, key);
+                *keys_out++ = key;
             }
 
-            for (index_type pos = 0; pos < (N - 1); ++pos)
+            // Occupancy words starting at or past the high-water mark are
+            // still uninitialized, so clear those the fresh slots reach
+            const size_t first = m_high_water;
+            for (size_t word = (first + 63) / 64; word < (first + count + 63) / 64; ++word)
+                m_occupied[word] = 0;
+
+            if constexpr (NoThrow)
             {
-                m_free[pos] = (pos + 1);
+                for (size_t idx = first; idx < first + count; ++idx)
+                {
+                    m_versions[idx] = 1;
+                    m_free[idx] = slot_full;
+                    set_occupied(idx);
+                }
+                for (size_t idx = first; idx < first + count; ++idx)
+                    construct(idx);
+
+                m_high_water += count;
+                m_size += count;
+
+                for (size_t idx = first; idx < first + count; ++idx)
+                {
+                    stats_hook().on_insert(1);
+                    const key_type key = key_traits_type::make(1, static_cast<index_type>(idx), meta);
+                    journal_hook().record(journal_op::emplace, key);
+                    *keys_out++ = key;
+                }
+            }
+            else
+            {
+                // Commit one at a time so that a throw leaves no gaps
+                for (size_t idx = first; idx < first + count; ++idx)
+                {
+                    construct(idx);
+                    m_versions[idx] = 1;
+                    m_free[idx] = slot_full;
+                    set_occupied(idx);
+                    ++m_high_water;
+                    ++m_size;
+
+                    stats_hook().on_insert(1);
+                    const key_type key = key_traits_type::make(1, static_cast<index_type>(idx), meta);
+                    journal_hook().record(journal_op::emplace, key);
+                    *keys_out++ = key;
+                }
             }
 
-            m_free[N - 1] = invalid_index;
-            m_free_head = 0;
+            return keys_out;
         }
 
-        void destroy_at(index_type index)
+        void destroy_at(slot_index_type index)
         {
             m_data.destroy(index);
-            m_free[index] = m_free_head;
-            m_free_head = index;
+            clear_occupied(index);
+            release_slot(index);
+            --m_size;
+        }
+
+        /// <summary>
+        /// The bits of an occupancy word that stand for slots below limit,
+        /// which is no lower than the word's first slot.
+        /// </summary>
+        static constexpr uint64_t slot_mask(size_t word, size_t limit) noexcept
+        {
+            const size_t slots = limit - (word * 64);
+            return (slots >= 64) ? ~uint64_t(0) : ((uint64_t(1) << slots) - 1);
+        }
+
+        // Every insertion and removal passes through these two
+        void set_occupied(size_t index)
+        {
+            m_occupied[index / 64] |= (uint64_t(1) << (index % 64));
+            dirty_hook().touch(index);
+        }
+
+        void clear_occupied(size_t index)
+        {
+            m_occupied[index / 64] &= ~(uint64_t(1) << (index % 64));
+            dirty_hook().touch(index);
+        }
+
+        /// <summary>
+        /// Returns the first occupied slot at or after from, or N if there
+        /// are none. Empty words are skipped whole.
+        /// </summary>
+        size_t next_occupied(size_t from) const
+        {
+            const size_t words = (m_high_water + 63) / 64;
+            size_t word = from / 64;
+            if (word >= words)
+                return N;
+
+            uint64_t bits = m_occupied[word] & (~uint64_t(0) << (from % 64));
+            while (bits == 0)
+            {
+                if (++word >= words)
+                    return N;
+                bits = m_occupied[word];
+            }
+            return (word * 64) + countr_zero64(bits);
+        }
+
+        /// <summary>
+        /// Returns a slot to the free list, unless it is due to be retired.
+        /// </summary>
+        void release_slot(slot_index_type index)
+        {
+            if constexpr (overflow_type::retire_slots)
+            {
+                if (m_versions[index] == max_version)
+                {
+                    m_free[index] = invalid_index;
+                    ++m_retired;
+                    stats_hook().on_retire();
+                    return;
+                }
+            }
+
+            m_free_slots.push(index, next_free());
+        }
+
+        /// <summary>
+        /// Accessor for the free list links, which share m_free with the
+        /// slot_full marker of live slots. Any slot whose link is reached
+        /// is marked dirty, as it may be about to change.
+        /// </summary>
+        auto next_free() noexcept
+        {
+            return [this](slot_index_type index) -> slot_index_type&
+            {
+                dirty_hook().touch(index);
+                return m_free[index];
+            };
+        }
+
+        /// <summary>
+        /// Issues the prefetches for get_many at position idx. Everything a
+        /// lookup touches is addressed by the key alone, so it can all be
+        /// requested at once.
+        /// </summary>
+        void prefetch_ahead(const key_type* keys, size_t count, size_t idx) const
+        {
+            if ((idx + prefetch_distance) < count)
+            {
+                const index_type index = key_traits_type::index(keys[idx + prefetch_distance]);
+                if (index < m_high_water)
+                {
+                    nonstd::prefetch(std::addressof(m_versions[index]));
+                    nonstd::prefetch(std::addressof(m_free[index]));
+                    nonstd::prefetch(m_data.address(index));
+                }
+            }
+        }
+
+        key_type key_at(size_t index) const
+        {
+            return key_traits_type::make(
+                static_cast<version_type>(m_versions[index]),
+                static_cast<index_type>(index), 0);
         }
 
         bool evaluate_key(key_type key) const
         {
-            const index_type index = key.m_index;
-            if (index >= N)
-                return false; // Out of range
-            if (m_free[index] != slot_full)
-                return false; // Element missing
-            if (key.m_version != m_versions[index])
-                return false; // Key outdated
+            const index_type index = key_traits_type::index(key);
+            stats_hook().on_lookup();
+            if (index >= m_high_water)
+            {
+                if (index >= N)
+                    stats_hook().on_out_of_range();
+                else
+                    stats_hook().on_stale();
+                return false; // Out of range or never issued
+            }
+            const version_type version = key_traits_type::version(key);
+            if ((m_free[index] != slot_full) ||         // Element missing
+                (version != m_versions[index]))         // Key outdated
+            {
+                stats_hook().on_stale();
+                return false;
+            }
             return true;
         }
 
         void destroy_all()
         {
-            for (index_type idx = 0; idx < N; ++idx)
-                if (m_free[idx] == slot_full)
-                    m_data.destroy(idx);
+            const size_t words = (m_high_water + 63) / 64;
+            for (size_t word = 0; word < words; ++word)
+                for (uint64_t bits = m_occupied[word]; bits != 0; bits &= bits - 1)
+                    m_data.destroy((word * 64) + countr_zero64(bits));
+        }
+
+        // The policy hooks are bases, taking no storage when empty
+        stats_type& stats_hook()          const noexcept { return stats_base::get(); }
+        dirty_slots_type& dirty_hook()    const noexcept { return dirty_base::get(); }
+        journal_hook_type& journal_hook() const noexcept { return journal_base::get(); }
+
+        size_t                                    m_size;
+        free_slots_type                           m_free_slots;
+        size_t                                    m_high_water; // Slots below have been used
+        nonstd::raw_buffer<T, N, storage_type>    m_data;
+        std::array<slot_version_type, N>          m_versions;
+        std::array<slot_index_type, free_entries> m_free;       // See free_entries
+        std::array<uint64_t, occupancy_words>     m_occupied;   // Words below the high-water mark are valid
+        size_t                                    m_retired;
+    };
+
+    /// <summary>
+    /// Forward iterator over the keys of a keyed_array's live values.
+    /// </summary>
+    template<class T, size_t N, typename Key, typename Policy>
+    class keyed_array<T, N, Key, Policy>::key_iterator
+    {
+        friend class keyed_array;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = Key;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const Key*;
+        using reference         = Key;
+
+        key_iterator() = default;
+
+        Key operator*() const { return m_owner->key_at(m_index); }
+
+        key_iterator& operator++()
+        {
+            m_index = m_owner->next_occupied(m_index + 1);
+            return *this;
+        }
+
+        key_iterator operator++(int)
+        {
+            key_iterator prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        friend bool operator==(const key_iterator& lhs, const key_iterator& rhs) noexcept
+        {
+            return lhs.m_index == rhs.m_index;
+        }
+
+        friend bool operator!=(const key_iterator& lhs, const key_iterator& rhs) noexcept
+        {
+            return lhs.m_index != rhs.m_index;
+        }
+
+    private:
+        key_iterator(const keyed_array* owner, size_t index)
+            : m_owner(owner)
+            , m_index(index)
+        {
+            // Pass
+        }
+
+        const keyed_array* m_owner = nullptr;
+        size_t             m_index = 0; // N when past the end
+    };
+
+    template<class T, size_t N, typename Key, typename Policy>
+    class keyed_array<T, N, Key, Policy>::key_range
+    {
+        friend class keyed_array;
+
+    public:
+        key_iterator begin() const { return key_iterator(m_owner, m_owner->next_occupied(0)); }
+        key_iterator end()   const { return key_iterator(m_owner, N); }
+
+    private:
+        explicit key_range(const keyed_array* owner)
+            : m_owner(owner)
+        {
+            // Pass
         }
 
-        index_type                  m_free_head;
-        nonstd::raw_buffer<T,  N>   m_data;
-        std::array<version_type, N> m_versions;
-        std::array<index_type, N>   m_free;
+        const keyed_array* m_owner;
     };
 }
@@ -0,0 +1,534 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "free_slots.h"
+#include "policy.h"
+#include "raw_buffer.h"
+#include "versioned_key.h"
+
+namespace nonstd
+{
+    namespace detail
+    {
+        template<size_t I, class T, size_t N, typename Storage>
+        struct column_leaf
+        {
+            // User-provided, so that the buffer is left uninitialized
+            column_leaf() {}
+
+            nonstd::raw_buffer<T, N, Storage> buffer;
+        };
+
+        template<typename Indices, size_t N, typename Storage, class ... Ts>
+        struct column_set;
+
+        /// <summary>
+        /// One raw_buffer per column. std::tuple would value-initialize,
+        /// and so zero, every buffer on construction.
+        /// </summary>
+        template<size_t ... Is, size_t N, typename Storage, class ... Ts>
+        struct column_set<std::index_sequence<Is ...>, N, Storage, Ts ...>
+            : column_leaf<Is, Ts, N, Storage> ...
+        {
+            column_set() {}
+
+            template<typename Fn>
+            void for_each(Fn&& fn)
+            {
+                (fn(static_cast<column_leaf<Is, Ts, N, Storage>&>(*this).buffer), ...);
+            }
+        };
+    }
+
+    /// <summary>
+    /// A slot_array that stores each component type in its own dense
+    /// column, structure-of-arrays style. All columns share one key space
+    /// and one lookup table, so one key names a value in every column and
+    /// a removal moves the same dense index in each of them. Loops over a
+    /// few components touch only those columns.
+    ///
+    /// Takes the same policies as slot_array, except deferred_removal.
+    /// </summary>
+    template<
+        typename Key,
+        typename Policy,
+        size_t N,
+        class ... Ts>
+    class basic_multi_slot_array
+        : private detail::hook_base<typename Policy::stats_type>
+    {
+        static_assert(sizeof...(Ts) > 0, "multi_slot_array needs a column");
+
+    public:
+        using key_type          = Key;
+        using key_traits_type   = nonstd::key_traits<Key>;
+        using version_type      = typename key_type::version_type;
+        using index_type        = typename key_type::index_type;
+        using meta_type         = typename key_type::meta_type;
+        using policy_type       = Policy;
+        using stats_type        = typename policy_type::stats_type;
+        using overflow_type     = typename policy_type::overflow_type;
+        using allocation_type   = typename policy_type::allocation_type;
+        using storage_type      = typename policy_type::storage_type;
+
+        // Slot metadata types, as small as N and the version policy allow
+        using slot_index_type   = detail::uint_fitting_t<N>;
+        using slot_version_type = detail::slot_version_t<Policy, version_type>;
+
+        // The type stored in column I
+        template<size_t I>
+        using column_type = std::tuple_element_t<I, std::tuple<Ts ...>>;
+
+        static constexpr auto capacity = N;
+        static constexpr auto columns = sizeof...(Ts);
+
+    private:
+        static_assert(Policy::removal_type::deferred == false,
+            "multi_slot_array does not support deferred_removal");
+
+        static const index_type max_index = key_traits_type::max_index;
+        static_assert(N <= max_index, "multi_slot_array too large for index_type");
+
+        static const slot_index_type invalid_index =
+            std::numeric_limits<slot_index_type>::max();
+
+        static const slot_version_type max_version =
+            static_cast<slot_version_type>(std::min<uint64_t>(
+                key_traits_type::max_version,
+                std::numeric_limits<slot_version_type>::max()));
+
+        using free_slots_type =
+            detail::free_slots<allocation_type, slot_index_type, N>;
+        using stats_base =
+            detail::hook_base<stats_type>;
+
+        // A row is relocated one column at a time, so a throw partway
+        // through would leave the earlier columns moved and the rest not
+        static constexpr bool nothrow_rows = (is_nothrow_relocatable_v<Ts> && ...);
+
+        struct lookup_t
+        {
+            slot_version_type version;
+            slot_index_type next_free;
+            slot_index_type data_index;
+        };
+
+    public:
+        /// <summary>
+        /// Constructs an empty multi slot array in O(1). As with slot_array,
+        /// slot metadata is only initialized when a slot is first used.
+        /// </summary>
+        basic_multi_slot_array()
+            : m_size()
+            , m_free_slots()
+            , m_high_water()
+            , m_retired()
+        {
+            // Pass
+        }
+
+        ~basic_multi_slot_array()
+        {
+            destroy_all();
+        }
+
+        // This is a big, fixed data structure for holding resources
+        basic_multi_slot_array(const basic_multi_slot_array&)            = delete;
+        basic_multi_slot_array& operator=(const basic_multi_slot_array&) = delete;
+        basic_multi_slot_array(basic_multi_slot_array&&)                 = delete;
+        basic_multi_slot_array& operator=(basic_multi_slot_array&&)      = delete;
+
+        // Size and capacity
+        constexpr size_t size()        const noexcept { return m_size; }
+        constexpr size_t max_size()    const noexcept { return N; }
+        constexpr bool empty()         const noexcept { return m_size == 0; }
+
+        // Slots permanently taken out of use (see retire_on_overflow)
+        constexpr size_t retired()     const noexcept { return m_retired; }
+
+        // Statistics (see policy.h)
+        const stats_type& stats()      const noexcept { return stats_hook(); }
+        void reset_stats()                   noexcept { stats_hook().reset(); }
+
+        // Dense column access. Row i of every column belongs to one key.
+        template<size_t I> column_type<I>* data()                    noexcept { return column<I>().data(); }
+        template<size_t I> const column_type<I>* data()        const noexcept { return column<I>().data(); }
+        template<size_t I> column_type<I>* begin()                   noexcept { return data<I>(); }
+        template<size_t I> const column_type<I>* begin()       const noexcept { return data<I>(); }
+        template<size_t I> column_type<I>* end()                     noexcept { return data<I>() + m_size; }
+        template<size_t I> const column_type<I>* end()         const noexcept { return data<I>() + m_size; }
+
+        /// <summary>
+        /// Inserts a row, constructing each column's value from the argument
+        /// at the same position. If a constructor throws, the values already
+        /// constructed for the row are destroyed and nothing is inserted.
+        /// </summary>
+        template<typename ... Us>
+        key_type emplace_back(Us&& ... values)
+        {
+            return emplace_back_with_meta(0, std::forward<Us>(values) ...);
+        }
+
+        /// <summary>
+        /// Inserts a row as emplace_back does, inscribing meta_data into the
+        /// returned key.
+        /// </summary>
+        template<typename ... Us>
+        key_type emplace_back_with_meta(meta_type meta_data, Us&& ... values)
+        {
+            static_assert(sizeof...(Us) == sizeof...(Ts),
+                "multi_slot_array rows need one value per column");
+
+            const slot_index_type lookup_index = next_slot();
+            lookup_t& lookup = m_lookups[lookup_index];
+
+            // This is fatal as it makes all key handles unsafe (see slot_array)
+            slot_version_type version = lookup.version;
+            if (increment_version(version) == false)
+                throw std::overflow_error("multi_slot_array version overflow");
+
+            // Store data first, so that a throwing constructor leaves the
+            // slot's version as it was (see slot_array)
+            construct_row<0>(m_size, std::forward<Us>(values) ...);
+            m_erase[m_size] = lookup_index;
+            lookup.data_index = static_cast<slot_index_type>(m_size);
+
+            // Pop free list and increase size
+            lookup.version = version;
+            claim_slot(lookup);
+            ++m_size;
+
+            stats_hook().on_insert(lookup.version);
+            return key_traits_type::make(lookup.version, lookup_index, meta_data);
+        }
+
+        /// <summary>
+        /// Returns whether the key matches a live row.
+        /// </summary>
+        bool contains(key_type key) const
+        {
+            return resolve_key(key) != nullptr;
+        }
+
+        /// <summary>
+        /// Tries to get the value in column I at the given key.
+        /// Will return a nullptr if the key did not match any row.
+        /// </summary>
+        template<size_t I>
+        column_type<I>* try_get(key_type key)
+        {
+            if (const lookup_t* lookup = resolve_key(key))
+                return std::addressof(column<I>()[lookup->data_index]);
+            return nullptr;
+        }
+
+        /// <summary>
+        /// Tries to get the value in column I at the given key.
+        /// Will return a nullptr if the key did not match any row.
+        /// </summary>
+        template<size_t I>
+        const column_type<I>* try_get(key_type key) const
+        {
+            if (const lookup_t* lookup = resolve_key(key))
+                return std::addressof(column<I>()[lookup->data_index]);
+            return nullptr;
+        }
+
+        /// <summary>
+        /// Tries to remove the row at a given key, relocating the last row
+        /// into its place in every column.
+        /// Returns false if no row was found. If some column's relocation
+        /// may throw, the last row is move-assigned over the removed one
+        /// instead, one column at a time. A throw then moves the columns
+        /// already done back, leaving every row as it was.
+        /// </summary>
+        bool try_remove(key_type key)
+        {
+            const lookup_t* found = resolve_key(key);
+            if (found == nullptr)
+                return false;
+
+            // Get information for the row we want to remove
+            const slot_index_type data_index_cursor = found->data_index;
+            const slot_index_type lookup_index_cursor = m_erase[data_index_cursor];
+            lookup_t& lookup_cursor = m_lookups[lookup_index_cursor];
+
+            // Get information for the last row in the array
+            const slot_index_type data_index_tail =
+                static_cast<slot_index_type>(m_size - 1);
+            lookup_t& lookup_tail = m_lookups[m_erase[data_index_tail]];
+
+            if constexpr (nothrow_rows)
+            {
+                // Destroy the row and relocate the last row into its place
+                destroy_row(data_index_cursor);
+                if (data_index_cursor != data_index_tail)
+                    relocate_row(data_index_cursor, data_index_tail);
+            }
+            else
+            {
+                // Move the last row over this one and destroy the last. The
+                // removed values are held until every column has moved
+                // WARNING: This may throw if a move throws!
+                if (data_index_cursor != data_index_tail)
+                {
+                    std::tuple<std::optional<Ts> ...> removed;
+                    replace_row<0>(data_index_cursor, data_index_tail, removed);
+                }
+                destroy_row(data_index_tail);
+            }
+
+            // Update erase list
+            m_erase[data_index_cursor] = m_erase[data_index_tail];
+            m_erase[data_index_tail] = invalid_index;
+
+            // Update the two affected lookups
+            lookup_cursor.data_index = invalid_index;
+            lookup_tail.data_index = data_index_cursor;
+
+            // Update the free list and size
+            release_slot(lookup_cursor, lookup_index_cursor);
+            --m_size;
+
+            stats_hook().on_erase();
+            return true;
+        }
+
+        /// <summary>
+        /// Clears the multi slot array in O(size), returning only the slots
+        /// of live rows to the free list.
+        /// Does not reset version numbers on slots.
+        /// </summary>
+        void clear()
+        {
+            for (size_t idx = m_size; idx-- > 0;)
+            {
+                destroy_row(idx);
+
+                const slot_index_type lookup_index = m_erase[idx];
+                lookup_t& lookup = m_lookups[lookup_index];
+                lookup.data_index = invalid_index;
+                release_slot(lookup, lookup_index);
+            }
+
+            m_size = 0;
+            stats_hook().on_clear();
+        }
+
+    private:
+        using column_set_type =
+            detail::column_set<std::index_sequence_for<Ts ...>, N, storage_type, Ts ...>;
+
+        template<size_t I>
+        raw_buffer<column_type<I>, N, storage_type>& column() noexcept
+        {
+            return static_cast<detail::column_leaf<I, column_type<I>, N, storage_type>&>(m_columns).buffer;
+        }
+
+        template<size_t I>
+        const raw_buffer<column_type<I>, N, storage_type>& column() const noexcept
+        {
+            return static_cast<const detail::column_leaf<I, column_type<I>, N, storage_type>&>(m_columns).buffer;
+        }
+
+        /// <summary>
+        /// Constructs row pos of columns I and up. If a later column throws,
+        /// column I's value is destroyed again before the exception leaves.
+        /// </summary>
+        template<size_t I, typename U, typename ... Rest>
+        void construct_row(size_t pos, U&& value, Rest&& ... rest)
+        {
+            column<I>().emplace(pos, std::forward<U>(value));
+            if constexpr (sizeof...(Rest) > 0)
+            {
+                try
+                {
+                    construct_row<I + 1>(pos, std::forward<Rest>(rest) ...);
+                }
+                catch (...)
+                {
+                    column<I>().destroy(pos);
+                    throw;
+                }
+            }
+        }
+
+        void destroy_row(size_t pos)
+        {
+            m_columns.for_each([pos](auto& buffer) { buffer.destroy(pos); });
+        }
+
+        // Only used when no column's relocation can throw (see nothrow_rows)
+        void relocate_row(size_t dst, size_t src)
+        {
+            m_columns.for_each([=](auto& buffer) { buffer.relocate(dst, src); });
+        }
+
+        /// <summary>
+        /// Move-assigns row src over row dst in columns I and up, moving
+        /// dst's old values into removed first. If a column throws, those
+        /// before it are moved back, leaving both rows as they were.
+        /// </summary>
+        template<size_t I>
+        void replace_row(size_t dst, size_t src, std::tuple<std::optional<Ts> ...>& removed)
+        {
+            auto& buffer = column<I>();
+            auto& old = std::get<I>(removed);
+            old.emplace(std::move(buffer[dst]));
+
+            bool moved = false;
+            try
+            {
+                buffer[dst] = std::move(buffer[src]);
+                moved = true;
+                if constexpr ((I + 1) < columns)
+                    replace_row<I + 1>(dst, src, removed);
+            }
+            catch (...)
+            {
+                undo_replace(buffer[dst], buffer[src], *old, moved);
+                throw;
+            }
+        }
+
+        // Moving back can't itself be undone, so a throw here terminates
+        // rather than leave a row torn
+        template<typename U>
+        static void undo_replace(U& dst, U& src, U& old, bool moved) noexcept
+        {
+            if (moved)
+                src = std::move(dst);
+            dst = std::move(old);
+        }
+
+        /// <summary>
+        /// Advances a slot's version, wrapping to zero past max_version.
+        /// Returns false if it wrapped, as zero is never a valid version.
+        /// </summary>
+        static bool increment_version(slot_version_type& version)
+        {
+            if constexpr (max_version == std::numeric_limits<slot_version_type>::max())
+            {
+                return (++version > 0);
+            }
+            else
+            {
+                version = (version == max_version) ?
+                    slot_version_type(0) : slot_version_type(version + 1);
+                return (version > 0);
+            }
+        }
+
+        /// <summary>
+        /// Returns a slot to the free list, unless it is due to be retired.
+        /// </summary>
+        void release_slot(lookup_t& lookup, slot_index_type lookup_index)
+        {
+            if constexpr (overflow_type::retire_slots)
+            {
+                if (lookup.version == max_version)
+                {
+                    lookup.next_free = invalid_index;
+                    ++m_retired;
+                    stats_hook().on_retire();
+                    return;
+                }
+            }
+
+            m_free_slots.push(lookup_index, next_free());
+        }
+
+        auto next_free() noexcept
+        {
+            return [this](slot_index_type index) -> slot_index_type&
+            {
+                return m_lookups[index].next_free;
+            };
+        }
+
+        /// <summary>
+        /// Finds the slot the next insertion will use, without claiming it.
+        /// </summary>
+        slot_index_type next_slot()
+        {
+            if (m_free_slots.head() != invalid_index)
+                return m_free_slots.head();
+            if (m_high_water >= N)
+                throw std::out_of_range("multi_slot_array has no free slots");
+
+            lookup_t& lookup = m_lookups[m_high_water];
+            lookup.version = 0;
+            lookup.next_free = invalid_index;
+            return static_cast<slot_index_type>(m_high_water);
+        }
+
+        /// <summary>
+        /// Claims the slot returned by next_slot, once insertion succeeded.
+        /// </summary>
+        void claim_slot(lookup_t& lookup)
+        {
+            if (m_free_slots.head() != invalid_index)
+                m_free_slots.pop(next_free());
+            else
+                ++m_high_water;
+            lookup.next_free = invalid_index;
+        }
+
+        const lookup_t* resolve_key(key_type key) const
+        {
+            const index_type lookup_index = key_traits_type::index(key);
+            stats_hook().on_lookup();
+            if (lookup_index >= m_high_water)
+            {
+                if (lookup_index >= N)
+                    stats_hook().on_out_of_range();
+                else
+                    stats_hook().on_stale();
+                return nullptr; // Out of range or never issued
+            }
+
+            const lookup_t& lookup = m_lookups[lookup_index];
+            if ((lookup.data_index == invalid_index) ||                // Row missing
+                (lookup.version != key_traits_type::version(key)))     // Key outdated
+            {
+                stats_hook().on_stale();
+                return nullptr;
+            }
+            return std::addressof(lookup);
+        }
+
+        void destroy_all()
+        {
+            for (size_t idx = 0; idx < m_size; ++idx)
+                destroy_row(idx);
+        }
+
+        // The stats policy is a base, taking no storage when empty
+        stats_type& stats_hook() const noexcept { return stats_base::get(); }
+
+        size_t                         m_size;
+        free_slots_type                m_free_slots;
+        size_t                         m_high_water; // Slots below have been used
+        column_set_type                m_columns;
+        std::array<lookup_t, N>        m_lookups;
+        std::array<slot_index_type, N> m_erase;
+        size_t                         m_retired;
+    };
+
+    /// <summary>
+    /// A multi slot array with the default key and policies.
+    /// </summary>
+    template<size_t N, class ... Ts>
+    using multi_slot_array =
+        basic_multi_slot_array<versioned_key, default_policy, N, Ts ...>;
+}
@@ -2,9 +2,11 @@
 
 #include <array>
 #include <cstdint>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
 
 #include "raw_buffer.h"
 
@@ -15,8 +17,9 @@ namespace nonstd
     /// Is neither copyable nor movable, but does allow forwarding on
     /// object storage, and does not require or waste default initialization.
     /// Objects cannot be individually removed once added, only a full clear.
+    /// Storage places the values, as for raw_buffer.
     /// </summary>
-    template<class T, size_t N, typename Key = size_t>
+    template<class T, size_t N, typename Key = size_t, typename Storage = inline_storage>
     class packed_array
     {
     public:
@@ -29,6 +32,7 @@ namespace nonstd
         using iterator          = T*;
         using const_iterator    = const T*;
         using index_type        = Key;
+        using storage_type      = Storage;
 
         static constexpr auto capacity = N;
 
@@ -71,6 +75,17 @@ namespace nonstd
 
         constexpr index_type key()  const noexcept { return static_cast<index_type>(m_size); }
 
+        /// <summary>
+        /// Passes each initialized byte range of the array, its size and
+        /// its values, to fn(const void*, size_t), for save_snapshot.
+        /// </summary>
+        template<typename Fn>
+        void regions(Fn&& fn) const
+        {
+            fn(&m_size, sizeof(m_size));
+            fn(m_data.data(), m_size * sizeof(T));
+        }
+
         // Access
         inline reference operator[](index_type pos)
         {
@@ -105,6 +120,59 @@ namespace nonstd
             return result;
         }
 
+        /// <summary>
+        /// Appends count values, each constructed from the same arguments,
+        /// and writes their keys to keys_out. Throws std::out_of_range before
+        /// appending anything if there is no room for all of them.
+        /// </summary>
+        template<typename OutputIt, typename ... Args>
+        inline OutputIt emplace_n(size_t count, OutputIt keys_out, const Args& ... args)
+        {
+            if (count > (N - m_size))
+                throw std::out_of_range("packed_array is full");
+
+            for (; count > 0; --count)
+            {
+                m_data.emplace(m_size, args ...);
+                *keys_out++ = static_cast<index_type>(m_size);
+                ++m_size; // Important to increment after in case we throw
+            }
+            return keys_out;
+        }
+
+        /// <summary>
+        /// Appends a value constructed from each element in [first, last)
+        /// and writes their keys to keys_out, as emplace_n does.
+        /// Single-pass input iterators are appended one at a time instead.
+        /// </summary>
+        template<typename InputIt, typename OutputIt>
+        inline OutputIt emplace_range(InputIt first, InputIt last, OutputIt keys_out)
+        {
+            using category = typename std::iterator_traits<InputIt>::iterator_category;
+            if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>)
+            {
+                if (static_cast<size_t>(std::distance(first, last)) > (N - m_size))
+                    throw std::out_of_range("packed_array is full");
+
+                for (; first != last; ++first)
+                {
+                    m_data.emplace(m_size, *first);
+                    *keys_out++ = static_cast<index_type>(m_size);
+                    ++m_size; // Important to increment after in case we throw
+                }
+            }
+            else
+            {
+                for (; first != last; ++first)
+                {
+                    const index_type index = key();
+                    emplace_back(*first);
+                    *keys_out++ = index;
+                }
+            }
+            return keys_out;
+        }
+
         inline void pop_back()
         {
             m_data.destroy_at(m_size - 1);
@@ -124,7 +192,7 @@ namespace nonstd
                 m_data.destroy(idx);
         }
 
-        size_t                   m_size;
-        nonstd::raw_buffer<T, N> m_data;
+        size_t                            m_size;
+        nonstd::raw_buffer<T, N, Storage> m_data;
     };
 }
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace nonstd
+{
+    /// <summary>
+    /// A small fixed set of worker threads for running chunked loops. The
+    /// calling thread works alongside the workers, and every thread claims
+    /// the next unclaimed chunk from a shared atomic counter, so threads
+    /// that finish early simply take more chunks. Only one loop runs on a
+    /// pool at a time. A loop started from inside another runs inline.
+    /// </summary>
+    class thread_pool
+    {
+    public:
+        /// <summary>
+        /// Starts the given number of worker threads. By default, one fewer
+        /// than the hardware threads, as the caller of run also works.
+        /// </summary>
+        explicit thread_pool(size_t workers = default_workers())
+            : m_job(nullptr)
+            , m_generation()
+            , m_busy()
+            , m_stop(false)
+        {
+            m_threads.reserve(workers);
+            for (size_t idx = 0; idx < workers; ++idx)
+                m_threads.emplace_back([this] { worker_loop(); });
+        }
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for (std::thread& thread : m_threads)
+                thread.join();
+        }
+
+        thread_pool(const thread_pool&)            = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+        thread_pool(thread_pool&&)                 = delete;
+        thread_pool& operator=(thread_pool&&)      = delete;
+
+        size_t workers() const noexcept { return m_threads.size(); }
+
+        /// <summary>
+        /// The pool used when none is given, started on first use.
+        /// </summary>
+        static thread_pool& shared()
+        {
+            static thread_pool pool;
+            return pool;
+        }
+
+        static size_t default_workers() noexcept
+        {
+            const size_t threads = std::thread::hardware_concurrency();
+            return (threads > 1) ? (threads - 1) : 0;
+        }
+
+        /// <summary>
+        /// Calls fn(chunk) once for each chunk in [0, chunks), spread over
+        /// the pool, and returns once all calls have finished. If any call
+        /// throws, unclaimed chunks are skipped and the first exception is
+        /// rethrown here.
+        /// </summary>
+        template<typename Fn>
+        void run(size_t chunks, Fn&& fn)
+        {
+            if ((chunks <= 1) || m_threads.empty() || in_loop())
+            {
+                for (size_t chunk = 0; chunk < chunks; ++chunk)
+                    fn(chunk);
+                return;
+            }
+
+            using fn_type = std::remove_reference_t<Fn>;
+            job current(
+                static_cast<void*>(std::addressof(fn)),
+                [](void* context, size_t chunk) { (*static_cast<fn_type*>(context))(chunk); },
+                chunks);
+
+            std::lock_guard<std::mutex> run_lock(m_run_mutex);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_job = &current;
+                ++m_generation;
+            }
+            m_wake.notify_all();
+
+            work(current);
+
+            // Workers that haven't picked the job up by now never will
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [this] { return m_busy == 0; });
+                m_job = nullptr;
+            }
+
+            if (current.error)
+                std::rethrow_exception(current.error);
+        }
+
+    private:
+        struct job
+        {
+            job(void* context, void (*invoke)(void*, size_t), size_t chunks)
+                : context(context)
+                , invoke(invoke)
+                , chunks(chunks)
+                , next(0)
+            {
+                // Pass
+            }
+
+            void*               context;
+            void              (*invoke)(void*, size_t);
+            size_t              chunks;
+            std::atomic<size_t> next;
+            std::mutex          error_mutex;
+            std::exception_ptr  error;
+        };
+
+        static bool& in_loop() noexcept
+        {
+            static thread_local bool running = false;
+            return running;
+        }
+
+        static void work(job& current)
+        {
+            in_loop() = true;
+            for (size_t chunk; (chunk = current.next.fetch_add(1, std::memory_order_relaxed)) < current.chunks;)
+            {
+                try
+                {
+                    current.invoke(current.context, chunk);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(current.error_mutex);
+                    if (current.error == nullptr)
+                        current.error = std::current_exception();
+                    current.next.store(current.chunks, std::memory_order_relaxed);
+                }
+            }
+            in_loop() = false;
+        }
+
+        void worker_loop()
+        {
+            uint64_t seen = 0;
+            for (;;)
+            {
+                job* current = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_wake.wait(lock, [&] { return m_stop || (m_generation != seen); });
+                    if (m_stop)
+                        return;
+
+                    seen = m_generation;
+                    if (m_job == nullptr)
+                        continue; // Woke too late, the job is already done
+                    current = m_job;
+                    ++m_busy;
+                }
+
+                work(*current);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (--m_busy == 0)
+                        m_done.notify_all();
+                }
+            }
+        }
+
+        std::mutex               m_run_mutex; // Held for the whole of run
+        std::mutex               m_mutex;     // Guards the members below
+        std::condition_variable  m_wake;
+        std::condition_variable  m_done;
+        job*                     m_job;
+        uint64_t                 m_generation;
+        size_t                   m_busy;
+        bool                     m_stop;
+        std::vector<std::thread> m_threads;
+    };
+
+    namespace detail
+    {
+        template<typename T, typename = void>
+        struct has_dead : std::false_type {};
+
+        template<typename T>
+        struct has_dead<T, std::void_t<decltype(std::declval<const T&>().dead())>>
+            : std::true_type {};
+    }
+
+    /// <summary>
+    /// Calls fn on every value in the container's dense range, from begin()
+    /// to end(), split into chunks of grain values run across the pool.
+    /// The range is used in place, so this suits slot_array, packed_array
+    /// and other containers with contiguous storage. fn may run on several
+    /// threads at once and must not insert or remove values. A slot_array
+    /// holding dead values (see deferred_removal) must be compacted first.
+    /// </summary>
+    template<typename Container, typename Fn>
+    void parallel_for_each(
+        Container& container,
+        Fn&& fn,
+        size_t grain = 1024,
+        thread_pool& pool = thread_pool::shared())
+    {
+        if constexpr (detail::has_dead<Container>::value)
+            if (container.dead() != 0)
+                throw std::logic_error("parallel_for_each needs a compacted container");
+
+        const auto first = container.begin();
+        const size_t count = static_cast<size_t>(std::distance(first, container.end()));
+        grain = std::max<size_t>(grain, 1);
+
+        pool.run((count + grain - 1) / grain,
+            [&](size_t chunk)
+            {
+                auto it = first + (chunk * grain);
+                const auto last = first + std::min(count, (chunk + 1) * grain);
+                for (; it != last; ++it)
+                    fn(*it);
+            });
+    }
+}
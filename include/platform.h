@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NONSTD_X86_64 1
+#endif
+
+// Define NONSTD_NO_SIMD to always take the scalar paths
+#if defined(NONSTD_X86_64) && !defined(NONSTD_NO_SIMD)
+#define NONSTD_SIMD_DISPATCH 1
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_IX86)
+#include <xmmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+// Compiles a function for an instruction set beyond the build's baseline.
+// Callers must check cpu_features() first. MSVC needs no annotation.
+#if defined(__GNUC__) || defined(__clang__)
+#define NONSTD_TARGET(features) __attribute__((target(features)))
+#else
+#define NONSTD_TARGET(features)
+#endif
+
+namespace nonstd
+{
+    /// <summary>
+    /// Hints that the memory at the given address will be read soon.
+    /// Never faults, and compiles to nothing where no intrinsic exists.
+    /// </summary>
+    inline void prefetch(const void* address) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+        static_cast<void>(address);
+#endif
+    }
+
+    /// <summary>
+    /// Counts the set bits in a 64-bit word.
+    /// </summary>
+    inline size_t popcount64(uint64_t bits) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<size_t>(__builtin_popcountll(bits));
+#else
+        size_t count = 0;
+        for (; bits != 0; bits &= (bits - 1))
+            ++count;
+        return count;
+#endif
+    }
+
+    /// <summary>
+    /// Returns the index of the lowest set bit. Bits must not be zero.
+    /// </summary>
+    inline unsigned countr_zero64(uint64_t bits) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctzll(bits));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return static_cast<unsigned>(index);
+#else
+        unsigned index = 0;
+        for (; (bits & 1) == 0; bits >>= 1)
+            ++index;
+        return index;
+#endif
+    }
+
+    /// <summary>
+    /// Returns the index of the highest set bit. Bits must not be zero.
+    /// </summary>
+    inline unsigned highest_bit64(uint64_t bits) noexcept
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63u - static_cast<unsigned>(__builtin_clzll(bits));
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index;
+        _BitScanReverse64(&index, bits);
+        return static_cast<unsigned>(index);
+#else
+        unsigned index = 0;
+        for (; (bits >>= 1) != 0;)
+            ++index;
+        return index;
+#endif
+    }
+
+    /// <summary>
+    /// Instruction set extensions usable on the running CPU (and OS).
+    /// All false when SIMD dispatch is disabled or not supported.
+    /// </summary>
+    struct cpu_feature_set
+    {
+        bool avx2;
+        bool avx512f;
+    };
+
+    /// <summary>
+    /// Detects the CPU's features once, on first use.
+    /// </summary>
+    inline const cpu_feature_set& cpu_features() noexcept
+    {
+        static const cpu_feature_set features = []
+        {
+            cpu_feature_set result = {};
+#if defined(NONSTD_SIMD_DISPATCH)
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuidex(info, 0, 0);
+            if (info[0] < 7)
+                return result;
+
+            // The OS must also save the wider registers on context switches
+            __cpuidex(info, 1, 0);
+            const bool osxsave = (info[2] & (1 << 27)) != 0;
+            if (osxsave == false)
+                return result;
+            const unsigned long long xcr0 = _xgetbv(0);
+            const bool ymm = (xcr0 & 0x06) == 0x06;
+            const bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+            __cpuidex(info, 7, 0);
+            result.avx2 = ymm && ((info[1] & (1 << 5)) != 0);
+            result.avx512f = zmm && ((info[1] & (1 << 16)) != 0);
+#else
+            __builtin_cpu_init();
+            result.avx2 = __builtin_cpu_supports("avx2");
+            result.avx512f = __builtin_cpu_supports("avx512f");
+#endif
+#endif
+            return result;
+        }();
+        return features;
+    }
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+#include "storage.h"
+
+namespace nonstd
+{
+    /// <summary>
+    /// Statistics policy that records nothing. All hooks are empty and
+    /// inline, and the containers keep it in an empty base, so they compile
+    /// to the same code and layout as without it.
+    /// </summary>
+    struct no_stats
+    {
+        void on_lookup()         noexcept {}
+        void on_stale()          noexcept {}
+        void on_out_of_range()   noexcept {}
+        void on_insert(uint64_t) noexcept {}
+        void on_erase()          noexcept {}
+        void on_clear()          noexcept {}
+        void on_retire()         noexcept {}
+        void reset()             noexcept {}
+    };
+
+    /// <summary>
+    /// Statistics policy that counts container events.
+    /// Counters are cumulative until reset, which keeps the current size.
+    /// </summary>
+    struct counting_stats
+    {
+        uint64_t lookups         = 0; // Keys evaluated by a get or remove
+        uint64_t stale_misses    = 0; // In-range keys to a dead or reused slot
+        uint64_t out_of_range    = 0; // Keys with an index beyond capacity
+        uint64_t insertions      = 0;
+        uint64_t removals        = 0;
+        uint64_t size            = 0;
+        uint64_t size_high_water = 0;
+        uint64_t max_version     = 0; // Highest version any slot has reached
+        uint64_t retirements     = 0; // Slots retired for reaching max version
+
+        void on_lookup()       noexcept { ++lookups; }
+        void on_stale()        noexcept { ++stale_misses; }
+        void on_out_of_range() noexcept { ++out_of_range; }
+
+        void on_insert(uint64_t version) noexcept
+        {
+            ++insertions;
+            if (++size > size_high_water)
+                size_high_water = size;
+            if (version > max_version)
+                max_version = version;
+        }
+
+        void on_erase() noexcept
+        {
+            ++removals;
+            --size;
+        }
+
+        void on_clear() noexcept
+        {
+            removals += size;
+            size = 0;
+        }
+
+        void on_retire() noexcept
+        {
+            ++retirements;
+        }
+
+        void reset() noexcept
+        {
+            lookups = 0;
+            stale_misses = 0;
+            out_of_range = 0;
+            insertions = 0;
+            removals = 0;
+            size_high_water = size;
+        }
+    };
+
+    /// <summary>
+    /// Version overflow policy that throws std::overflow_error from
+    /// emplace_back when the next free slot's version would wrap around.
+    /// This is fatal, as outstanding keys to that slot would become unsafe.
+    /// </summary>
+    struct throw_on_overflow
+    {
+        static constexpr bool retire_slots = false;
+    };
+
+    /// <summary>
+    /// Version overflow policy that permanently retires a slot once its
+    /// version saturates, rather than returning it to the free list. The
+    /// usable capacity shrinks by one per retired slot, but the container
+    /// never throws for version overflow and never reuses a version.
+    /// </summary>
+    struct retire_on_overflow
+    {
+        static constexpr bool retire_slots = true;
+    };
+
+    /// <summary>
+    /// Removal policy that closes the hole left by a removed slot_array
+    /// value straight away, by relocating the last value into it.
+    /// </summary>
+    struct immediate_removal
+    {
+        static constexpr bool deferred = false;
+    };
+
+    /// <summary>
+    /// Removal policy under which slot_array removal only invalidates the
+    /// key and marks the value dead, so nothing moves while iterating.
+    /// Dead values stay constructed in place until compact() is called.
+    /// Has no effect on keyed_array, which never moves its values.
+    /// </summary>
+    struct deferred_removal
+    {
+        static constexpr bool deferred = true;
+    };
+
+    /// <summary>
+    /// Allocation policy that reuses the most recently freed slot first.
+    /// Its metadata is likely still in cache, but the same few slots see
+    /// every version increment under churn.
+    /// </summary>
+    struct lifo_allocation {};
+
+    /// <summary>
+    /// Allocation policy that reuses the least recently freed slot first.
+    /// Version increments are spread over every free slot, so a stale key
+    /// takes far longer to alias a new value when versions are narrow.
+    /// </summary>
+    struct fifo_allocation {};
+
+    /// <summary>
+    /// Allocation policy that reuses the lowest free slot index first,
+    /// found in a bitmap of free slots. Occupied slots stay packed at the
+    /// low end, which keeps keyed_array iteration dense.
+    /// </summary>
+    struct lowest_index_allocation {};
+
+    /// <summary>
+    /// Tracking policy that records nothing. keyed_array compiles to the
+    /// same code and layout as without it, and can't write delta snapshots.
+    /// </summary>
+    struct no_tracking {};
+
+    /// <summary>
+    /// Tracking policy under which keyed_array marks each slot whose value,
+    /// version or free-list link changes in a dirty bitmap, so that a delta
+    /// snapshot can carry only the slots changed since the last one. Values
+    /// modified in place through try_get must be marked with mark_dirty.
+    /// </summary>
+    struct dirty_tracking {};
+
+    /// <summary>
+    /// Journal policy that records nothing. The containers compile to the
+    /// same code and layout as without it.
+    /// </summary>
+    struct no_journal {};
+
+    /// <summary>
+    /// Journal policy under which the keyed containers append a record of
+    /// every insertion and removal, with its key, to the op_journal given
+    /// to attach_journal (see journal.h), so that replay can repeat them on
+    /// a follower and reproduce the same keys.
+    /// </summary>
+    struct op_journaling {};
+
+    /// <summary>
+    /// Version storage policy under which each slot stores its version in
+    /// the key's version type. To store versions in fewer bytes, set the
+    /// policy's version_type to a narrower unsigned type instead, such as
+    /// uint16_t. Slot versions then wrap (see overflow_type) at that width.
+    /// </summary>
+    struct key_version {};
+
+    /// <summary>
+    /// The set of policies used by the keyed containers unless overridden.
+    /// To change a policy, derive from this and shadow the relevant type:
+    ///
+    ///     struct my_policy : nonstd::default_policy
+    ///     {
+    ///         using stats_type = nonstd::counting_stats;
+    ///     };
+    ///
+    ///     nonstd::slot_array<T, N, nonstd::versioned_key, my_policy> arr;
+    ///
+    /// The storage_type places the container's values (see storage.h).
+    /// </summary>
+    struct default_policy
+    {
+        using stats_type      = no_stats;
+        using overflow_type   = throw_on_overflow;
+        using removal_type    = immediate_removal;
+        using version_type    = key_version;
+        using allocation_type = lifo_allocation;
+        using storage_type    = inline_storage;
+        using tracking_type   = no_tracking;
+        using journal_type    = no_journal;
+    };
+
+    namespace detail
+    {
+        /// <summary>
+        /// The type a container stores slot versions in under Policy.
+        /// </summary>
+        template<typename Policy, typename KeyVersion>
+        using slot_version_t = std::conditional_t<
+            std::is_same_v<typename Policy::version_type, key_version>,
+            KeyVersion,
+            typename Policy::version_type>;
+
+        // Whether a container takes stats or journal policies at all, as
+        // packed_array doesn't
+        template<typename T, typename = void>
+        struct has_stats_type : std::false_type {};
+
+        template<typename T>
+        struct has_stats_type<T, std::void_t<typename T::stats_type>>
+            : std::true_type {};
+
+        template<typename T, typename = void>
+        struct has_journal_type : std::false_type {};
+
+        template<typename T>
+        struct has_journal_type<T, std::void_t<typename T::journal_type>>
+            : std::true_type {};
+
+        template<typename T, typename = void>
+        struct has_regions : std::false_type {};
+
+        template<typename T>
+        struct has_regions<T, std::void_t<decltype(
+            std::declval<const T&>().regions(std::declval<void (*)(const void*, size_t)>()))>>
+            : std::true_type {};
+
+        /// <summary>
+        /// Passes the initialized bytes of one of a container's parts to
+        /// fn(const void*, size_t), for save_snapshot. Parts that are only
+        /// partly initialized, such as bitmaps zeroed on first use, say
+        /// which bytes through their own regions(fn). Empty parts have none.
+        /// </summary>
+        template<typename T, typename Fn>
+        void object_regions(const T& object, Fn&& fn)
+        {
+            if constexpr (std::is_empty_v<T>)
+                return;
+            else if constexpr (has_regions<T>::value)
+                object.regions(fn);
+            else
+                fn(std::addressof(object), sizeof(T));
+        }
+
+        /// <summary>
+        /// Holds one of a container's policy hooks (stats, dirty tracking or
+        /// journal) as a base of the container. An empty hook, as under the
+        /// default policies, is itself a private base and so takes no
+        /// storage; any other is a member. get() reaches the hook from const
+        /// members too, as lookups record stats, so it acts as mutable.
+        /// </summary>
+        template<typename Hook, bool = std::is_empty_v<Hook> && (std::is_final_v<Hook> == false)>
+        class hook_base : private Hook
+        {
+        public:
+            hook_base()
+                : Hook()
+            {
+                // Pass
+            }
+
+            Hook& get() const noexcept
+            {
+                return const_cast<Hook&>(static_cast<const Hook&>(*this));
+            }
+        };
+
+        template<typename Hook>
+        class hook_base<Hook, false>
+        {
+        public:
+            hook_base()
+                : m_hook()
+            {
+                // Pass
+            }
+
+            Hook& get() const noexcept { return m_hook; }
+
+        private:
+            mutable Hook m_hook;
+        };
+    }
+
+    /// <summary>
+    /// The default policies, but with event counting enabled.
+    /// </summary>
+    struct counting_policy : default_policy
+    {
+        using stats_type = counting_stats;
+    };
+}
@@ -2,12 +2,41 @@
 
 #include <array>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <new>
+#include <stdexcept>
 #include <type_traits>
+#include <utility>
+
+#include "storage.h"
 
 namespace nonstd
 {
+    /// <summary>
+    /// Whether moving a T to a new address and destroying the original can
+    /// be done with a plain memcpy instead. True for trivially copyable types.
+    /// Specialize this for other types that don't depend on their own address
+    /// (e.g. most types holding only pointers to heap memory) to opt in.
+    /// </summary>
+    template<typename T>
+    struct is_trivially_relocatable
+        : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+    template<typename T>
+    inline constexpr bool is_trivially_relocatable_v =
+        is_trivially_relocatable<T>::value;
+
+    /// <summary>
+    /// Whether relocating a T can't throw, either because it is trivially
+    /// relocatable or because its move constructor is noexcept. Containers
+    /// only destroy a value before relocating another into its slot when
+    /// this holds, as a throw would otherwise leave the slot uninitialized.
+    /// </summary>
+    template<typename T>
+    inline constexpr bool is_nothrow_relocatable_v =
+        is_trivially_relocatable_v<T> || std::is_nothrow_move_constructible_v<T>;
+
     /// <summary>
     /// A raw buffer of typed but potentially uninitialized data.
     /// Values can be created and destroyed within this structure's slots.
@@ -16,13 +45,20 @@ namespace nonstd
     /// 
     /// Note that assigning to an uninitialized slot is undefined.
     /// Use emplacement instead to construct a value in that slot.
+    ///
+    /// Storage places the slots: inline in the buffer (the default), on the
+    /// heap, or in an anonymous memory mapping (see storage.h).
     /// </summary>
-    template<typename T, std::size_t N>
+    template<typename T, std::size_t N, typename Storage = inline_storage>
     class raw_buffer
     {
+        using slot_type = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
     public:
         static constexpr auto capacity = N;
 
+        using storage_type = Storage;
+
         raw_buffer()  = default;
         ~raw_buffer() = default;
 
@@ -53,28 +89,37 @@ namespace nonstd
         {
             return *std::launder(
                 reinterpret_cast<T*>(
-                    std::addressof(m_data[pos])));
+                    std::addressof(slot(pos))));
         }
 
         inline const T& operator[](std::size_t pos) const
         {
             return *std::launder(
                 reinterpret_cast<const T*>(
-                    std::addressof(m_data[pos])));
+                    std::addressof(slot(pos))));
         }
 
         inline T& at(std::size_t pos)
         {
             return *std::launder(
                 reinterpret_cast<T*>(
-                    std::addressof(m_data.at(pos))));
+                    std::addressof(checked_slot(pos))));
         }
 
         inline const T& at(std::size_t pos) const
         {
             return *std::launder(
                 reinterpret_cast<const T*>(
-                    std::addressof(m_data.at(pos))));
+                    std::addressof(checked_slot(pos))));
+        }
+
+        /// <summary>
+        /// Returns the address of a slot's storage, whether or not it holds
+        /// a value. Useful for prefetching without touching the value.
+        /// </summary>
+        inline const void* address(std::size_t pos) const noexcept
+        {
+            return static_cast<const void*>(std::addressof(slot(pos)));
         }
 
         // Operations
@@ -82,7 +127,7 @@ namespace nonstd
         inline T& emplace(size_t pos, Args&&... args)
         {
             return
-                *::new(static_cast<void*>(std::addressof(m_data[pos])))
+                *::new(static_cast<void*>(std::addressof(slot(pos))))
                 T(std::forward<Args>(args) ...);
         }
 
@@ -90,7 +135,7 @@ namespace nonstd
         inline T& emplace_at(size_t pos, Args&&... args)
         {
             return
-                *::new(static_cast<void*>(std::addressof(m_data.at(pos))))
+                *::new(static_cast<void*>(std::addressof(checked_slot(pos))))
                 T(std::forward<Args>(args) ...);
         }
 
@@ -99,7 +144,7 @@ namespace nonstd
             std::destroy_at(
                 std::launder(
                     reinterpret_cast<const T*>(
-                        std::addressof(m_data[pos]))));
+                        std::addressof(slot(pos)))));
         }
 
         inline void destroy_at(std::size_t pos)
@@ -107,13 +152,59 @@ namespace nonstd
             std::destroy_at(
                 std::launder(
                     reinterpret_cast<const T*>(
-                        std::addressof(m_data.at(pos)))));
+                        std::addressof(checked_slot(pos)))));
+        }
+
+        /// <summary>
+        /// Moves the value at src into the uninitialized slot at dst and ends
+        /// the lifetime of the value at src, leaving that slot uninitialized.
+        /// Trivially relocatable types are copied bytewise. If the move
+        /// constructor throws, dst is left uninitialized and src unchanged.
+        /// </summary>
+        inline void relocate(std::size_t dst, std::size_t src)
+        {
+            if constexpr (is_trivially_relocatable_v<T>)
+            {
+                std::memcpy(
+                    static_cast<void*>(std::addressof(slot(dst))),
+                    static_cast<const void*>(std::addressof(slot(src))),
+                    sizeof(T));
+            }
+            else
+            {
+                emplace(dst, std::move((*this)[src]));
+                destroy(src);
+            }
         }
 
     private:
-        std::array<std::aligned_storage_t<sizeof(T), alignof(T)>, N> m_data;
+        inline slot_type& slot(std::size_t pos) noexcept
+        {
+            return m_data[pos];
+        }
+
+        inline const slot_type& slot(std::size_t pos) const noexcept
+        {
+            return m_data[pos];
+        }
+
+        inline slot_type& checked_slot(std::size_t pos)
+        {
+            if (pos >= N)
+                throw std::out_of_range("raw_buffer index out of range");
+            return slot(pos);
+        }
+
+        inline const slot_type& checked_slot(std::size_t pos) const
+        {
+            if (pos >= N)
+                throw std::out_of_range("raw_buffer index out of range");
+            return slot(pos);
+        }
+
+        detail::buffer_storage<Storage, slot_type, N> m_data;
         static_assert( // TODO: The (N == 0) case has a size -- should it?
-            (N == 0) || (sizeof(m_data) == (sizeof(T) * N)),
+            (N == 0) || (sizeof(std::array<slot_type, N>) == (sizeof(T) * N)),
             "raw_buffer exhibiting incorrect sizing or alignment");
     };
 }
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "policy.h"
+#include "storage.h"
+
+#if defined(NONSTD_MMAP)
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace nonstd
+{
+    namespace detail
+    {
+        /// <summary>
+        /// Leads every shared segment. The layout fields let a reader refuse
+        /// a segment written for a different container type or build.
+        /// </summary>
+        struct segment_header
+        {
+            static constexpr uint64_t segment_magic = 0x6E6F6E7374647368; // "nonstdsh"
+
+            uint64_t              magic;
+            uint64_t              container_size;
+            uint64_t              container_align;
+            uint64_t              value_size;
+            uint64_t              capacity;
+            std::atomic<uint32_t> ready;    // Set once the container is constructed
+            std::atomic<uint64_t> sequence; // Odd while the writer is mid-update
+        };
+
+        template<typename Container>
+        struct segment_layout
+        {
+            segment_header header;
+            Container      container;
+        };
+    }
+
+#if defined(NONSTD_MMAP)
+    /// <summary>
+    /// A keyed container that lives in a named POSIX shared memory segment,
+    /// so that one writer process can update it in place while any number
+    /// of reader processes look values up with the same keys, with nothing
+    /// copied between them. Keys are index and version pairs, and the
+    /// containers hold no pointers, so both mean the same in every process.
+    ///
+    /// Reads are made consistent with a sequence lock: the writer bumps a
+    /// counter to odd before each write and back to even after it, and a
+    /// read is retried if the counter was odd or changed while it ran. A
+    /// read callback can therefore see a half-written container, and must
+    /// only copy values out, never keep references or trust what it saw
+    /// until read returns. Writers never wait for readers. Readers give up
+    /// after a timeout, as a writer that died mid-write never finishes.
+    ///
+    /// The container must use inline storage and no stats (readers map the
+    /// segment read-only), and its values must be trivially copyable. It
+    /// can't be journaled, as a journal is reached through a pointer that
+    /// only means something in the writer's process.
+    /// </summary>
+    template<typename Container>
+    class shared_segment
+    {
+        using layout_type = detail::segment_layout<Container>;
+        using value_type  = typename Container::value_type;
+
+        static_assert(
+            std::is_same_v<typename Container::storage_type, inline_storage>,
+            "shared_segment needs the container's values stored inline");
+        static_assert(
+            std::is_trivially_copyable_v<value_type>,
+            "shared_segment values must be trivially copyable");
+        static_assert(
+            !detail::has_stats_type<Container>::value ||
+                std::is_same_v<typename Container::stats_type, no_stats>,
+            "shared_segment readers cannot record stats");
+        static_assert(
+            !detail::has_journal_type<Container>::value ||
+                std::is_same_v<typename Container::journal_type, no_journal>,
+            "shared_segment containers cannot hold a journal pointer");
+        static_assert(
+            std::atomic<uint64_t>::is_always_lock_free &&
+                std::atomic<uint32_t>::is_always_lock_free,
+            "shared_segment needs address-free atomics");
+
+    public:
+        using container_type = Container;
+
+        // How long read waits for a write in progress before giving up
+        static constexpr std::chrono::milliseconds default_read_timeout { 1000 };
+
+        /// <summary>
+        /// Creates the named segment and constructs an empty container in
+        /// it, for writing. Throws std::system_error if the name is taken.
+        /// The segment is removed again when the writer is destroyed.
+        /// </summary>
+        static shared_segment create(const std::string& name)
+        {
+            const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "shm_open");
+
+            void* pages = MAP_FAILED;
+            if (::ftruncate(fd, sizeof(layout_type)) == 0)
+                pages = ::mmap(nullptr, sizeof(layout_type), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            const int error = errno;
+            ::close(fd);
+
+            if (pages == MAP_FAILED)
+            {
+                ::shm_unlink(name.c_str());
+                throw std::system_error(error, std::generic_category(), "shared_segment create");
+            }
+
+            // The header's atomics must be constructed before first use.
+            // The mapping starts zeroed, so readers see it as not ready, and
+            // constructing it zeroed again doesn't change what they see
+            layout_type* layout = static_cast<layout_type*>(pages);
+            detail::segment_header& header =
+                *::new(static_cast<void*>(std::addressof(layout->header))) detail::segment_header();
+            header.magic           = detail::segment_header::segment_magic;
+            header.container_size  = sizeof(Container);
+            header.container_align = alignof(Container);
+            header.value_size      = sizeof(value_type);
+            header.capacity        = Container::capacity;
+            ::new(static_cast<void*>(std::addressof(layout->container))) Container();
+            header.ready.store(1, std::memory_order_release);
+
+            return shared_segment(layout, name, true);
+        }
+
+        /// <summary>
+        /// Maps an existing segment read-only. Throws std::system_error if
+        /// it can't be opened, or std::runtime_error if its writer hasn't
+        /// finished creating it or it holds a different container type.
+        /// </summary>
+        static shared_segment open(const std::string& name)
+        {
+            const int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+            if (fd < 0)
+                throw std::system_error(errno, std::generic_category(), "shm_open");
+
+            struct stat info = {};
+            const bool sized = (::fstat(fd, &info) == 0);
+            const bool fits = sized && (static_cast<size_t>(info.st_size) >= sizeof(layout_type));
+            void* pages = MAP_FAILED;
+            if (fits)
+                pages = ::mmap(nullptr, sizeof(layout_type), PROT_READ, MAP_SHARED, fd, 0);
+            const int error = errno;
+            ::close(fd);
+
+            if (sized && !fits)
+                throw std::runtime_error("shared_segment is not ready or has a different layout");
+            if (pages == MAP_FAILED)
+                throw std::system_error(error, std::generic_category(), "shared_segment open");
+
+            shared_segment segment(static_cast<layout_type*>(pages), name, false);
+            const detail::segment_header& header = segment.m_layout->header;
+            if (header.ready.load(std::memory_order_acquire) == 0)
+                throw std::runtime_error("shared_segment is not ready or has a different layout");
+            if ((header.magic != detail::segment_header::segment_magic) ||
+                (header.container_size != sizeof(Container)) ||
+                (header.container_align != alignof(Container)) ||
+                (header.value_size != sizeof(value_type)) ||
+                (header.capacity != Container::capacity))
+                throw std::runtime_error("shared_segment is not ready or has a different layout");
+
+            return segment;
+        }
+
+        /// <summary>
+        /// Removes a named segment, such as one left by a writer that died.
+        /// Returns false if there was no such segment.
+        /// </summary>
+        static bool remove(const std::string& name) noexcept
+        {
+            return (::shm_unlink(name.c_str()) == 0);
+        }
+
+        shared_segment(shared_segment&& rhs) noexcept
+            : m_layout(std::exchange(rhs.m_layout, nullptr))
+            , m_name(std::move(rhs.m_name))
+            , m_writer(rhs.m_writer)
+        {
+            // Pass
+        }
+
+        shared_segment& operator=(shared_segment&& rhs) noexcept
+        {
+            if (this != &rhs)
+            {
+                release();
+                m_layout = std::exchange(rhs.m_layout, nullptr);
+                m_name = std::move(rhs.m_name);
+                m_writer = rhs.m_writer;
+            }
+            return *this;
+        }
+
+        shared_segment(const shared_segment&)            = delete;
+        shared_segment& operator=(const shared_segment&) = delete;
+
+        ~shared_segment()
+        {
+            release();
+        }
+
+        bool writable() const noexcept { return m_writer; }
+
+        /// <summary>
+        /// Calls fn(container) with the writer's mutable container, marking
+        /// the update as in progress for readers until fn returns or throws.
+        /// Throws std::logic_error on a segment opened for reading.
+        /// </summary>
+        template<typename Fn>
+        decltype(auto) write(Fn&& fn)
+        {
+            if (m_writer == false)
+                throw std::logic_error("shared_segment opened for reading");
+
+            // The single writer owns the counter, so no read-modify-write
+            std::atomic<uint64_t>& sequence = m_layout->header.sequence;
+            const uint64_t start = sequence.load(std::memory_order_relaxed);
+            sequence.store(start + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            struct end_write
+            {
+                ~end_write() { sequence.store(start + 2, std::memory_order_release); }
+                std::atomic<uint64_t>& sequence;
+                uint64_t               start;
+            } guard { sequence, start };
+
+            return fn(m_layout->container);
+        }
+
+        /// <summary>
+        /// Calls fn(const container&) until it runs without the writer
+        /// updating the container in the meantime, and returns its last
+        /// result. fn must return by value (see above). Throws
+        /// std::system_error (errc::timed_out) if no attempt succeeds within
+        /// the timeout, such as when the writer died partway through a write.
+        /// </summary>
+        template<typename Fn>
+        auto read(Fn&& fn) const -> std::invoke_result_t<Fn&, const Container&>
+        {
+            return read(std::forward<Fn>(fn), default_read_timeout);
+        }
+
+        /// <summary>
+        /// Calls fn(const container&) as above, giving up after timeout.
+        /// </summary>
+        template<typename Fn, typename Rep, typename Period>
+        auto read(Fn&& fn, std::chrono::duration<Rep, Period> timeout) const
+            -> std::invoke_result_t<Fn&, const Container&>
+        {
+            using result_type = std::invoke_result_t<Fn&, const Container&>;
+            static_assert(!std::is_reference_v<result_type>, "read results must be copies");
+
+            const std::atomic<uint64_t>& sequence = m_layout->header.sequence;
+            const Container& container = m_layout->container;
+
+            // The clock is only read once an attempt has had to be retried
+            bool waiting = false;
+            std::chrono::steady_clock::time_point deadline;
+            for (;;)
+            {
+                const uint64_t before = sequence.load(std::memory_order_acquire);
+                if ((before % 2) == 0)
+                {
+                    if constexpr (std::is_void_v<result_type>)
+                    {
+                        fn(container);
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if (sequence.load(std::memory_order_relaxed) == before)
+                            return;
+                    }
+                    else
+                    {
+                        result_type result = fn(container);
+                        std::atomic_thread_fence(std::memory_order_acquire);
+                        if (sequence.load(std::memory_order_relaxed) == before)
+                            return result;
+                    }
+                }
+
+                const auto now = std::chrono::steady_clock::now();
+                if (waiting == false)
+                {
+                    waiting = true;
+                    deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+                }
+                else if (now >= deadline)
+                {
+                    throw std::system_error(
+                        std::make_error_code(std::errc::timed_out), "shared_segment read");
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        /// <summary>
+        /// The number of completed writes, for readers to skip unchanged
+        /// state cheaply.
+        /// </summary>
+        uint64_t version() const noexcept
+        {
+            return m_layout->header.sequence.load(std::memory_order_acquire) / 2;
+        }
+
+    private:
+        shared_segment(layout_type* layout, std::string name, bool writer)
+            : m_layout(layout)
+            , m_name(std::move(name))
+            , m_writer(writer)
+        {
+            // Pass
+        }
+
+        void release() noexcept
+        {
+            if (m_layout == nullptr)
+                return;
+            if (m_writer)
+            {
+                m_layout->container.~Container();
+                ::shm_unlink(m_name.c_str());
+            }
+            ::munmap(static_cast<void*>(m_layout), sizeof(layout_type));
+            m_layout = nullptr;
+        }
+
+        layout_type* m_layout;
+        std::string  m_name;
+        bool         m_writer;
+    };
+#endif
+}
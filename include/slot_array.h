@@ -1,19 +1,32 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 
+#include "free_slots.h"
+#include "journal.h"
+#include "platform.h"
+#include "policy.h"
 #include "raw_buffer.h"
 #include "versioned_key.h"
 
 namespace nonstd
 {
-    template<class T, size_t N, typename Key = versioned_key>
+    template<
+        class T,
+        size_t N,
+        typename Key = versioned_key,
+        typename Policy = default_policy>
     class slot_array
+        : private detail::hook_base<typename Policy::stats_type>
+        , private detail::hook_base<detail::journal_hook<typename Policy::journal_type>>
     {
     public:
         using value_type        = T;
@@ -25,33 +38,95 @@ namespace nonstd
         using iterator          = T*;
         using const_iterator    = const T*;
         using key_type          = Key;
+        using key_traits_type   = nonstd::key_traits<Key>;
         using version_type      = typename key_type::version_type;
         using index_type        = typename key_type::index_type;
         using meta_type         = typename key_type::meta_type;
+        using policy_type       = Policy;
+        using stats_type        = typename policy_type::stats_type;
+        using overflow_type     = typename policy_type::overflow_type;
+        using removal_type      = typename policy_type::removal_type;
+        using allocation_type   = typename policy_type::allocation_type;
+        using storage_type      = typename policy_type::storage_type;
+        using journal_type      = typename policy_type::journal_type;
+
+        // Slot metadata types, as small as N and the version policy allow
+        using slot_index_type   = detail::uint_fitting_t<N>;
+        using slot_version_type = detail::slot_version_t<Policy, version_type>;
 
         static constexpr auto capacity = N;
 
     private:
-        static const index_type max_index = std::numeric_limits<index_type>::max();
-        static const index_type invalid_index = max_index;
-        static_assert(N <= invalid_index, "slot_array too large for index_type");
+        static const index_type max_index = key_traits_type::max_index;
+        static_assert(N <= max_index, "slot_array too large for index_type");
+
+        static const slot_index_type invalid_index =
+            std::numeric_limits<slot_index_type>::max();
+
+        static const slot_version_type max_version =
+            static_cast<slot_version_type>(std::min<uint64_t>(
+                key_traits_type::max_version,
+                std::numeric_limits<slot_version_type>::max()));
+
+        // How many keys ahead get_many prefetches each stage of a lookup
+        static constexpr size_t prefetch_distance = 8;
+
+        // Batch removals given a thread pool close their holes in parallel
+        // once at least this many values, and this fraction of them, go
+        static constexpr size_t parallel_min_removed = 4096;
+        static constexpr size_t parallel_min_fraction = 8; // 1 in 8
+
+        // The most pieces the parallel compaction splits each range into
+        static constexpr size_t parallel_max_chunks = 256;
+
+        // Batch removals leave holes to close after every value is erased,
+        // which a relocation that throws partway through would leave open
+        static constexpr bool fill_each_removal =
+            (removal_type::deferred == false) && (is_nothrow_relocatable_v<T> == false);
+
+        // Stands in for a thread pool in the serial batch removal overloads
+        struct no_pool
+        {
+            size_t workers() const noexcept { return 0; }
+
+            template<typename Fn>
+            void run(size_t chunks, Fn&& fn)
+            {
+                for (size_t chunk = 0; chunk < chunks; ++chunk)
+                    fn(chunk);
+            }
+        };
+
+        using free_slots_type =
+            detail::free_slots<allocation_type, slot_index_type, N>;
+        using journal_hook_type =
+            detail::journal_hook<journal_type>;
+        using stats_base =
+            detail::hook_base<stats_type>;
+        using journal_base =
+            detail::hook_base<journal_hook_type>;
 
         struct lookup_t
         {
-            version_type version;
-            index_type next_free;
-            index_type data_index;
+            slot_version_type version;
+            slot_index_type next_free;
+            slot_index_type data_index;
         };
 
     public:
+        /// <summary>
+        /// Constructs an empty slot array in O(1). Slot metadata is only
+        /// initialized when a slot is first used, so the data, lookup and
+        /// erase arrays are deliberately left uninitialized here.
+        /// </summary>
         slot_array()
             : m_size()
-            , m_free_head()
-            , m_data()
-            , m_lookups()
-            , m_erase()
+            , m_free_slots()
+            , m_high_water()
+            , m_retired()
+            , m_dead()
         {
-            reset_metadata();
+            // Pass
         }
 
         ~slot_array()
@@ -66,9 +141,59 @@ namespace nonstd
         slot_array& operator=(slot_array&&)      = delete;
 
         // Size and capacity
-        constexpr size_t size()        const noexcept { return m_size; }
+        constexpr size_t size()        const noexcept { return m_size - m_dead; }
         constexpr size_t max_size()    const noexcept { return N; }
-        constexpr bool empty()         const noexcept { return m_size == 0; }
+        constexpr bool empty()         const noexcept { return m_size == m_dead; }
+
+        // Slots permanently taken out of use (see retire_on_overflow)
+        constexpr size_t retired()     const noexcept { return m_retired; }
+
+        // Removed values awaiting compact() (see deferred_removal)
+        constexpr size_t dead()        const noexcept { return m_dead; }
+
+        // Statistics (see policy.h)
+        const stats_type& stats()      const noexcept { return stats_hook(); }
+        void reset_stats()                   noexcept { stats_hook().reset(); }
+
+        /// <summary>
+        /// Sets the journal that insertions and removals are recorded to
+        /// under op_journaling, or stops recording if given nullptr. Every
+        /// freed slot is recorded as its own removal, in the order it was
+        /// freed, including those freed by batch removals and clear.
+        /// </summary>
+        void attach_journal(op_journal* journal) noexcept
+        {
+            static_assert(journal_hook_type::enabled, "attach_journal needs op_journaling");
+            journal_hook().attach(journal);
+        }
+
+        op_journal* journal() const noexcept
+        {
+            static_assert(journal_hook_type::enabled, "journal needs op_journaling");
+            return journal_hook().attached();
+        }
+
+        /// <summary>
+        /// Passes each initialized byte range of the array to
+        /// fn(const void*, size_t): its counters, free list and hooks, and
+        /// the values and slot metadata in use. Slots past the high-water
+        /// mark and storage past the last value are left out, so that
+        /// save_snapshot never writes memory the array hasn't set.
+        /// </summary>
+        template<typename Fn>
+        void regions(Fn&& fn) const
+        {
+            detail::object_regions(stats_hook(), fn);
+            detail::object_regions(journal_hook(), fn);
+            fn(&m_size, sizeof(m_size));
+            detail::object_regions(m_free_slots, fn);
+            fn(&m_high_water, sizeof(m_high_water));
+            fn(m_data.data(), m_size * sizeof(T));
+            fn(m_lookups.data(), m_high_water * sizeof(lookup_t));
+            fn(m_erase.data(), m_size * sizeof(slot_index_type));
+            fn(&m_retired, sizeof(m_retired));
+            fn(&m_dead, sizeof(m_dead));
+        }
 
         // Iterators
         iterator begin()                     noexcept { return m_data.data(); }
@@ -78,34 +203,120 @@ namespace nonstd
         const_iterator end()           const noexcept { return m_data.data() + m_size; }
         const_iterator cend()          const noexcept { return m_data.data() + m_size; }
 
+        /// <summary>
+        /// Calls fn on every live value in dense order. Unlike iterating from
+        /// begin() to end(), this skips values removed under deferred_removal,
+        /// which also allows fn to remove values, including its argument.
+        /// </summary>
+        template<typename Fn>
+        void for_each(Fn fn)
+        {
+            for (size_t idx = 0; idx < m_size; ++idx)
+                if (is_dead(idx) == false)
+                    fn(m_data[idx]);
+        }
+
+        /// <summary>
+        /// Calls fn on every live value in dense order.
+        /// </summary>
+        template<typename Fn>
+        void for_each(Fn fn) const
+        {
+            for (size_t idx = 0; idx < m_size; ++idx)
+                if (is_dead(idx) == false)
+                    fn(m_data[idx]);
+        }
+
         /// <summary>
         /// Inserts a value into the slot array.
         /// </summary>
         template<typename ... Args>
         key_type emplace_back(Args&& ... args, meta_type meta_data = 0)
         {
-            if (m_free_head == invalid_index)
-                throw std::out_of_range("slot_array has no free slots");
-            const index_type lookup_index = m_free_head;
+            if constexpr (removal_type::deferred)
+                if (m_size >= N)
+                    throw std::out_of_range("slot_array must be compacted");
+
+            const slot_index_type lookup_index = next_slot();
             lookup_t& lookup = m_lookups[lookup_index];
 
-            // We could probably recover by just orphaning this slot, but
-            // that would make insertion O(n) as we'd have to find the next.
-            // Otherwise this is fatal as it makes all key handles unsafe.
-            if (increment_version(lookup.version) == false)
+            // This is fatal as it makes all key handles unsafe. To recover,
+            // use retire_on_overflow, which orphans saturated slots when they
+            // are freed so that they never reach the free list at all.
+            slot_version_type version = lookup.version;
+            if (increment_version(version) == false)
                 throw std::overflow_error("slot_array version overflow");
 
-            // Store data and lookup
+            // Store data first, so that a throwing constructor leaves the
+            // slot's version as it was and nothing goes unjournaled
             m_data.emplace(m_size, std::forward<Args>(args) ...);
             m_erase[m_size] = lookup_index;
-            lookup.data_index = static_cast<index_type>(m_size);
+            lookup.data_index = static_cast<slot_index_type>(m_size);
 
             // Pop free list and increase size
-            m_free_head = lookup.next_free;
-            lookup.next_free = invalid_index;
+            lookup.version = version;
+            claim_slot(lookup);
             ++m_size;
 
-            return key_type(lookup.version, lookup_index, meta_data);
+            stats_hook().on_insert(lookup.version);
+            const key_type key = key_traits_type::make(lookup.version, lookup_index, meta_data);
+            journal_hook().record(journal_op::emplace, key);
+            return key;
+        }
+
+        /// <summary>
+        /// Inserts count values, each constructed from the same arguments,
+        /// and writes their keys to keys_out. Throws std::out_of_range before
+        /// inserting anything if there is no room for all of them, or
+        /// std::overflow_error if a freed slot it would reuse has run out
+        /// of versions. If constructing a value throws, the values inserted
+        /// before it stay, and their keys have been written to keys_out.
+        /// Returns the output iterator past the last key written.
+        /// </summary>
+        template<typename OutputIt, typename ... Args>
+        OutputIt emplace_n(size_t count, OutputIt keys_out, const Args& ... args)
+        {
+            constexpr bool no_throw =
+                std::is_nothrow_constructible_v<T, const Args& ...>;
+
+            return insert_n<no_throw>(count, keys_out, 0,
+                [&](size_t pos) { m_data.emplace(pos, args ...); });
+        }
+
+        /// <summary>
+        /// Inserts a value constructed from each element in [first, last)
+        /// and writes their keys to keys_out, as emplace_n does.
+        /// Single-pass input iterators can't be counted up front, so those
+        /// are inserted one element at a time instead.
+        /// </summary>
+        template<typename InputIt, typename OutputIt>
+        OutputIt emplace_range(
+            InputIt first,
+            InputIt last,
+            OutputIt keys_out,
+            meta_type meta_data = 0)
+        {
+            using traits = std::iterator_traits<InputIt>;
+            using source_type = typename traits::reference;
+
+            if constexpr (std::is_base_of_v<
+                std::forward_iterator_tag,
+                typename traits::iterator_category>)
+            {
+                constexpr bool no_throw =
+                    std::is_nothrow_constructible_v<T, source_type> &&
+                    noexcept(*first) && noexcept(++first);
+
+                const size_t count = static_cast<size_t>(std::distance(first, last));
+                return insert_n<no_throw>(count, keys_out, meta_data,
+                    [&](size_t pos) { m_data.emplace(pos, *first); ++first; });
+            }
+            else
+            {
+                for (; first != last; ++first)
+                    *keys_out++ = emplace_back<source_type>(*first, meta_data);
+                return keys_out;
+            }
         }
         
         /// <summary>
@@ -130,32 +341,509 @@ namespace nonstd
             return nullptr;
         }
 
+        /// <summary>
+        /// Resolves count keys at once, writing a pointer to each value (or
+        /// nullptr for keys that did not match) to out. Returns the number of
+        /// keys that matched. Prefetches the lookup entry and then the value
+        /// of keys further ahead, so that their cache misses overlap rather
+        /// than each lookup waiting on the last.
+        /// </summary>
+        size_t get_many(const key_type* keys, size_t count, T** out)
+        {
+            size_t found = 0;
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                prefetch_ahead(keys, count, idx);
+                out[idx] = try_get(keys[idx]);
+                found += (out[idx] != nullptr);
+            }
+            return found;
+        }
+
+        /// <summary>
+        /// Resolves count keys at once, writing a pointer to each value (or
+        /// nullptr for keys that did not match) to out. Returns the number of
+        /// keys that matched.
+        /// </summary>
+        size_t get_many(const key_type* keys, size_t count, const T** out) const
+        {
+            size_t found = 0;
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                prefetch_ahead(keys, count, idx);
+                out[idx] = try_get(keys[idx]);
+                found += (out[idx] != nullptr);
+            }
+            return found;
+        }
+
         /// <summary>
         /// Tries to remove a given key. 
         /// Returns false if no value was found.
+        /// Under deferred_removal, the value is only marked dead, and stays
+        /// in place (still constructed) until the next compact().
         /// </summary>
         bool try_remove(key_type key)
         {
-            using std::swap;
-
             lookup_t* lookup = resolve_key(key);
             if (lookup == nullptr)
                 return false;
-            lookup_t& lookup_cursor = *lookup;
 
+            if constexpr (removal_type::deferred)
+            {
+                erase_dense(lookup->data_index);
+                ++m_dead;
+                return true;
+            }
+
+            erase_and_fill(*lookup);
+            return true;
+        }
+
+        /// <summary>
+        /// Removes the values at each key in [first, last) in one pass,
+        /// skipping keys that don't match. Returns the number removed.
+        /// Unlike repeated try_remove calls, no element is moved more than
+        /// once, and only survivors are moved to fill the holes left behind.
+        /// Under deferred_removal, values are only marked dead, as with
+        /// try_remove, and the holes are left for compact().
+        /// If relocating T may throw, values are removed one at a time as
+        /// try_remove does instead, so that a throw leaves no holes.
+        /// </summary>
+        template<typename InputIt>
+        size_t remove_many(InputIt first, InputIt last)
+        {
+            no_pool pool;
+            return remove_many(first, last, pool);
+        }
+
+        /// <summary>
+        /// Removes the values at each key in [first, last), as above. Large
+        /// removals close their holes on the given pool (such as a
+        /// nonstd::thread_pool, see parallel.h) when T can be relocated
+        /// without throwing.
+        /// </summary>
+        template<typename InputIt, typename Pool>
+        size_t remove_many(InputIt first, InputIt last, Pool& pool)
+        {
+            size_t removed = 0;
+            if constexpr (fill_each_removal)
+            {
+                static_cast<void>(pool);
+                for (; first != last; ++first)
+                {
+                    if (lookup_t* lookup = resolve_key(*first))
+                    {
+                        erase_and_fill(*lookup);
+                        ++removed;
+                    }
+                }
+                return removed;
+            }
+
+            try
+            {
+                for (; first != last; ++first)
+                {
+                    if (lookup_t* lookup = resolve_key(*first))
+                    {
+                        erase_dense(lookup->data_index);
+                        ++removed;
+                    }
+                }
+            }
+            catch (...)
+            {
+                finish_removal(removed, pool);
+                throw;
+            }
+
+            finish_removal(removed, pool);
+            return removed;
+        }
+
+        /// <summary>
+        /// Removes the values at count keys starting at the given pointer.
+        /// See the iterator overload of remove_many.
+        /// </summary>
+        size_t remove_many(const key_type* keys, size_t count)
+        {
+            return remove_many(keys, keys + count);
+        }
+
+        /// <summary>
+        /// Removes every value for which the predicate returns true, in one
+        /// pass, as remove_many does. Returns the number removed. Values
+        /// are tested in dense order, or in reverse if relocating T may
+        /// throw and they are removed one at a time.
+        /// </summary>
+        template<typename Predicate>
+        size_t remove_if(Predicate pred)
+        {
+            no_pool pool;
+            return remove_if(pred, pool);
+        }
+
+        /// <summary>
+        /// Removes every value for which the predicate returns true, closing
+        /// the holes on the given pool as the pool overload of remove_many
+        /// does. The predicate itself is called on this thread.
+        /// </summary>
+        template<typename Predicate, typename Pool>
+        size_t remove_if(Predicate pred, Pool& pool)
+        {
+            size_t removed = 0;
+            if constexpr (fill_each_removal)
+            {
+                // Scanned downward, so each value moved into a hole from the
+                // tail has already been tested
+                static_cast<void>(pool);
+                for (size_t idx = m_size; idx-- > 0;)
+                {
+                    if (pred(m_data[idx]))
+                    {
+                        erase_and_fill(m_lookups[m_erase[idx]]);
+                        ++removed;
+                    }
+                }
+                return removed;
+            }
+
+            try
+            {
+                for (size_t idx = 0; idx < m_size; ++idx)
+                {
+                    if ((is_dead(idx) == false) && pred(m_data[idx]))
+                    {
+                        erase_dense(idx);
+                        ++removed;
+                    }
+                }
+            }
+            catch (...)
+            {
+                finish_removal(removed, pool);
+                throw;
+            }
+
+            finish_removal(removed, pool);
+            return removed;
+        }
+
+        /// <summary>
+        /// Destroys the values removed under deferred_removal and closes
+        /// their holes in one pass, as remove_many does. Invalidates
+        /// iterators and pointers to values. Does nothing under
+        /// immediate_removal, where there are never any dead values.
+        /// </summary>
+        void compact()
+        {
+            no_pool pool;
+            compact(pool);
+        }
+
+        /// <summary>
+        /// Destroys dead values and closes their holes as above, on the given
+        /// pool if there are enough of them (see remove_many).
+        /// </summary>
+        template<typename Pool>
+        void compact(Pool& pool)
+        {
+            if constexpr (removal_type::deferred)
+            {
+                if (m_dead == 0)
+                    return;
+
+                if constexpr (is_nothrow_relocatable_v<T> == false)
+                {
+                    static_cast<void>(pool);
+                    compact_by_assignment();
+                    journal_hook().record(journal_op::compact, key_traits_type::make(0, 0, 0));
+                    return;
+                }
+
+                if constexpr (std::is_trivially_destructible_v<T> == false)
+                {
+                    if (use_pool(pool, m_dead))
+                    {
+                        const size_t chunks = chunk_count(pool, m_size);
+                        pool.run(chunks, [&](size_t chunk)
+                        {
+                            const size_t end = chunk_begin(m_size, chunks, chunk + 1);
+                            for (size_t idx = chunk_begin(m_size, chunks, chunk); idx < end; ++idx)
+                                if (is_dead(idx))
+                                    m_data.destroy(idx);
+                        });
+                    }
+                    else
+                    {
+                        for (size_t idx = 0; idx < m_size; ++idx)
+                            if (is_dead(idx))
+                                m_data.destroy(idx);
+                    }
+                }
+
+                const size_t removed = m_dead;
+                m_dead = 0;
+                compact_holes(removed, pool);
+                journal_hook().record(journal_op::compact, key_traits_type::make(0, 0, 0));
+            }
+        }
+
+        /// <summary>
+        /// Clears the slot array in O(size), returning only the slots of
+        /// live elements to the free list.
+        /// Does not reset version numbers on slots.
+        /// </summary>
+        void clear()
+        {
+            for (size_t idx = m_size; idx-- > 0;)
+            {
+                m_data.destroy(idx);
+                if (is_dead(idx))
+                    continue; // Slot was already freed
+
+                const slot_index_type lookup_index = m_erase[idx];
+                lookup_t& lookup = m_lookups[lookup_index];
+                lookup.data_index = invalid_index;
+                release_slot(lookup, lookup_index);
+            }
+
+            m_size = 0;
+            m_dead = 0;
+            stats_hook().on_clear();
+
+            // The removals are already recorded, but a follower under
+            // deferred_removal still needs to drop its dead values
+            journal_hook().record(journal_op::clear, key_traits_type::make(0, 0, 0));
+        }
+
+    private:
+        /// <summary>
+        /// Advances a slot's version, wrapping to zero past max_version.
+        /// Returns false if it wrapped, as zero is never a valid version.
+        /// </summary>
+        static bool increment_version(slot_version_type& version)
+        {
+            if constexpr (max_version == std::numeric_limits<slot_version_type>::max())
+            {
+                return (++version > 0);
+            }
+            else
+            {
+                version = (version == max_version) ?
+                    slot_version_type(0) : slot_version_type(version + 1);
+                return (version > 0);
+            }
+        }
+
+        /// <summary>
+        /// Returns a slot to the free list, unless it is due to be retired.
+        /// </summary>
+        void release_slot(lookup_t& lookup, slot_index_type lookup_index)
+        {
+            // Slots are freed in an order that depends on the dense layout,
+            // which batch removals don't reproduce, so record each one
+            journal_hook().record(journal_op::remove,
+                key_traits_type::make(lookup.version, lookup_index, 0));
+
+            if constexpr (overflow_type::retire_slots)
+            {
+                if (lookup.version == max_version)
+                {
+                    lookup.next_free = invalid_index;
+                    ++m_retired;
+                    stats_hook().on_retire();
+                    return;
+                }
+            }
+
+            m_free_slots.push(lookup_index, next_free());
+        }
+
+        /// <summary>
+        /// Accessor for the free list links, which live in the lookups.
+        /// </summary>
+        auto next_free() noexcept
+        {
+            return [this](slot_index_type index) -> slot_index_type&
+            {
+                return m_lookups[index].next_free;
+            };
+        }
+
+        /// <summary>
+        /// Finds the slot the next insertion will use, without claiming it.
+        /// Freed slots are reused first, in the order set by allocation_type.
+        /// Otherwise the slot at the high-water mark is initialized, as it
+        /// has never been used before.
+        /// </summary>
+        slot_index_type next_slot()
+        {
+            if (m_free_slots.head() != invalid_index)
+                return m_free_slots.head();
+            if (m_high_water >= N)
+                throw std::out_of_range("slot_array has no free slots");
+
+            lookup_t& lookup = m_lookups[m_high_water];
+            lookup.version = 0;
+            lookup.next_free = invalid_index;
+            return static_cast<slot_index_type>(m_high_water);
+        }
+
+        /// <summary>
+        /// Claims the slot returned by next_slot, once insertion succeeded.
+        /// </summary>
+        void claim_slot(lookup_t& lookup)
+        {
+            if (m_free_slots.head() != invalid_index)
+                m_free_slots.pop(next_free());
+            else
+                ++m_high_water;
+            lookup.next_free = invalid_index;
+        }
+
+        /// <summary>
+        /// Shared body of emplace_n and emplace_range. Capacity and the
+        /// versions of the freed slots to reuse are checked once, freed
+        /// slots are refilled as in emplace_back, and the rest are taken in
+        /// bulk from past the high-water mark. When construction can't
+        /// throw, the metadata of those fresh slots is written first in a
+        /// separate loop that the compiler is free to vectorize.
+        /// </summary>
+        template<bool NoThrow, typename OutputIt, typename Construct>
+        OutputIt insert_n(
+            size_t count,
+            OutputIt keys_out,
+            meta_type meta_data,
+            Construct&& construct)
+        {
+            // Every slot not live or retired is either free or never used
+            if (count > (N - size() - m_retired))
+                throw std::out_of_range("slot_array has no free slots");
+            if constexpr (removal_type::deferred)
+                if (count > (N - m_size))
+                    throw std::out_of_range("slot_array must be compacted");
+
+            // Retired slots never return to the free list, so only a slot
+            // that would throw on reuse needs checking for up front
+            if constexpr (overflow_type::retire_slots == false)
+            {
+                const bool saturated = m_free_slots.any_of(count, next_free(),
+                    [&](slot_index_type index) { return (m_lookups[index].version == max_version); });
+                if (saturated)
+                    throw std::overflow_error("slot_array version overflow");
+            }
+
+            for (; (count > 0) && (m_free_slots.head() != invalid_index); --count)
+            {
+                const slot_index_type lookup_index = m_free_slots.head();
+                lookup_t& lookup = m_lookups[lookup_index];
+                slot_version_type version = lookup.version;
+                if (increment_version(version) == false)
+                    throw std::overflow_error("slot_array version overflow");
+
+                construct(m_size);
+                m_erase[m_size] = lookup_index;
+                lookup.data_index = static_cast<slot_index_type>(m_size);
+
+                lookup.version = version;
+                claim_slot(lookup);
+                ++m_size;
+
+                stats_hook().on_insert(lookup.version);
+                const key_type key = key_traits_type::make(lookup.version, lookup_index, meta_data);
+                journal_hook().record(journal_op::emplace, key);
+                *keys_out++ = key;
+            }
+
+            const size_t first_lookup = m_high_water;
+            const size_t first_data = m_size;
+            if constexpr (NoThrow)
+            {
+                for (size_t idx = 0; idx < count; ++idx)
+                    init_fresh(first_lookup + idx, first_data + idx);
+                for (size_t idx = 0; idx < count; ++idx)
+                    construct(first_data + idx);
+
+                m_high_water += count;
+                m_size += count;
+
+                for (size_t idx = 0; idx < count; ++idx)
+                {
+                    stats_hook().on_insert(1);
+                    const key_type key = key_traits_type::make(
+                        1, static_cast<index_type>(first_lookup + idx), meta_data);
+                    journal_hook().record(journal_op::emplace, key);
+                    *keys_out++ = key;
+                }
+            }
+            else
+            {
+                // Commit one at a time so that a throw leaves no gaps
+                for (size_t idx = 0; idx < count; ++idx)
+                {
+                    construct(first_data + idx);
+                    init_fresh(first_lookup + idx, first_data + idx);
+                    ++m_high_water;
+                    ++m_size;
+
+                    stats_hook().on_insert(1);
+                    const key_type key = key_traits_type::make(
+                        1, static_cast<index_type>(first_lookup + idx), meta_data);
+                    journal_hook().record(journal_op::emplace, key);
+                    *keys_out++ = key;
+                }
+            }
+
+            return keys_out;
+        }
+
+        /// <summary>
+        /// Initializes a never-used slot as live, at version 1, pointing at
+        /// the given dense index.
+        /// </summary>
+        void init_fresh(size_t lookup_index, size_t data_index)
+        {
+            lookup_t& lookup = m_lookups[lookup_index];
+            lookup.version = 1;
+            lookup.next_free = invalid_index;
+            lookup.data_index = static_cast<slot_index_type>(data_index);
+            m_erase[data_index] = static_cast<slot_index_type>(lookup_index);
+        }
+
+        /// <summary>
+        /// Removes the value at a live slot and fills its hole in the dense
+        /// array from the tail straight away, as try_remove does.
+        /// </summary>
+        void erase_and_fill(lookup_t& lookup_cursor)
+        {
             // Get information for the element we want to remove
-            const index_type data_index_cursor = lookup_cursor.data_index;
-            const index_type lookup_index_cursor = m_erase[data_index_cursor];
+            const slot_index_type data_index_cursor = lookup_cursor.data_index;
+            const slot_index_type lookup_index_cursor = m_erase[data_index_cursor];
 
             // Get information for the last element in the array
-            const index_type data_index_tail = static_cast<index_type>(m_size - 1);
-            const index_type lookup_index_tail = m_erase[data_index_tail];
+            const slot_index_type data_index_tail =
+                static_cast<slot_index_type>(m_size - 1);
+            const slot_index_type lookup_index_tail = m_erase[data_index_tail];
             lookup_t& lookup_tail = m_lookups[lookup_index_tail];
 
-            // Swap data with the value at the end of our storage and destroy
-            // WARNING: These operations may throw exceptions!
-            swap(m_data[data_index_cursor], m_data[data_index_tail]);
-            m_data.destroy(data_index_tail);
+            if constexpr (is_nothrow_relocatable_v<T>)
+            {
+                // Destroy the value and relocate the last value into its place
+                m_data.destroy(data_index_cursor);
+                if (data_index_cursor != data_index_tail)
+                    m_data.relocate(data_index_cursor, data_index_tail);
+            }
+            else
+            {
+                // Move the last value over this one and destroy the last, so
+                // that a throwing move leaves both still constructed
+                // WARNING: This may throw if T's move assignment throws!
+                if (data_index_cursor != data_index_tail)
+                    m_data[data_index_cursor] = std::move(m_data[data_index_tail]);
+                m_data.destroy(data_index_tail);
+            }
 
             // Update erase list
             m_erase[data_index_cursor] = m_erase[data_index_tail];
@@ -166,52 +854,266 @@ namespace nonstd
             lookup_tail.data_index = data_index_cursor;
 
             // Update the free list and size
-            lookup_cursor.next_free = m_free_head;
-            m_free_head = lookup_index_cursor;
+            release_slot(lookup_cursor, lookup_index_cursor);
             --m_size;
 
-            return true;
+            stats_hook().on_erase();
         }
 
         /// <summary>
-        /// Clears and reorganizes the slot array.
-        /// Does not reset version numbers on slots.
+        /// Destroys the value at a dense index and frees its slot, but leaves
+        /// a hole in the dense array, marked in the erase list, for
+        /// compact_holes to close. Under deferred_removal, the value is left
+        /// constructed for compact() to destroy later.
         /// </summary>
-        void clear()
+        void erase_dense(size_t data_index)
         {
-            destroy_all();
-            reset_metadata();
-            m_size = 0;
+            const slot_index_type lookup_index = m_erase[data_index];
+            lookup_t& lookup = m_lookups[lookup_index];
+
+            if constexpr (removal_type::deferred == false)
+                m_data.destroy(data_index);
+            m_erase[data_index] = invalid_index;
+            lookup.data_index = invalid_index;
+            release_slot(lookup, lookup_index);
+
+            stats_hook().on_erase();
         }
 
-    private:
-        static bool increment_version(uint32_t& version)
+        /// <summary>
+        /// Whether the value at a dense index was removed under
+        /// deferred_removal and is waiting for compact().
+        /// </summary>
+        bool is_dead(size_t data_index) const
+        {
+            if constexpr (removal_type::deferred)
+                return (m_erase[data_index] == invalid_index);
+            else
+                return false;
+        }
+
+        /// <summary>
+        /// Completes a batch removal of the given number of values.
+        /// </summary>
+        template<typename Pool>
+        void finish_removal(size_t removed, Pool& pool)
+        {
+            if constexpr (removal_type::deferred)
+                m_dead += removed;
+            else
+                compact_holes(removed, pool);
+        }
+
+        /// <summary>
+        /// Whether a batch of the given number of removals is large enough
+        /// to be worth handing to the pool. Never for the serial overloads,
+        /// or when a relocation could throw partway through.
+        /// </summary>
+        template<typename Pool>
+        bool use_pool(const Pool& pool, size_t removed) const
+        {
+            if constexpr (std::is_same_v<Pool, no_pool> || (is_nothrow_relocatable_v<T> == false))
+            {
+                static_cast<void>(pool);
+                static_cast<void>(removed);
+                return false;
+            }
+            else
+            {
+                return (pool.workers() > 0) &&
+                    (removed >= parallel_min_removed) &&
+                    ((removed * parallel_min_fraction) >= m_size);
+            }
+        }
+
+        template<typename Pool>
+        static size_t chunk_count(const Pool& pool, size_t count)
+        {
+            const size_t wanted = (pool.workers() + 1) * 4;
+            return std::max<size_t>(1, std::min({ wanted, parallel_max_chunks, count }));
+        }
+
+        // Chunk boundaries split count elements as evenly as possible
+        static size_t chunk_begin(size_t count, size_t chunks, size_t chunk)
+        {
+            return (count * chunk) / chunks;
+        }
+
+        template<typename Pool>
+        void compact_holes(size_t removed, Pool& pool)
+        {
+            if (use_pool(pool, removed))
+                compact_holes_parallel(removed, pool);
+            else
+                compact_holes(removed);
+        }
+
+        /// <summary>
+        /// Closes holes as compact_holes does, across the pool. The k-th hole
+        /// below the new size is filled by the k-th survivor above it, both
+        /// counted upward. Each range is split into chunks whose holes and
+        /// survivors are counted in parallel, and a prefix sum over those
+        /// counts tells each chunk of holes where its first survivor is, so
+        /// that all chunks can then be filled at once. Survivors' old erase
+        /// entries are only read during the fill, and cleared afterwards.
+        /// </summary>
+        template<typename Pool>
+        void compact_holes_parallel(size_t removed, Pool& pool)
+        {
+            const size_t new_size = m_size - removed;
+            const size_t chunks = chunk_count(pool, std::min(new_size, removed));
+
+            // Counts per chunk, then the prefix sums of those counts
+            std::array<size_t, parallel_max_chunks + 1> holes = {};
+            std::array<size_t, parallel_max_chunks + 1> survivors = {};
+
+            pool.run(chunks, [&](size_t chunk)
+            {
+                size_t count = 0;
+                const size_t hole_end = chunk_begin(new_size, chunks, chunk + 1);
+                for (size_t idx = chunk_begin(new_size, chunks, chunk); idx < hole_end; ++idx)
+                    count += (m_erase[idx] == invalid_index);
+                holes[chunk + 1] = count;
+
+                count = 0;
+                const size_t survivor_end = new_size + chunk_begin(removed, chunks, chunk + 1);
+                for (size_t idx = new_size + chunk_begin(removed, chunks, chunk); idx < survivor_end; ++idx)
+                    count += (m_erase[idx] != invalid_index);
+                survivors[chunk + 1] = count;
+            });
+
+            for (size_t chunk = 0; chunk < chunks; ++chunk)
+            {
+                holes[chunk + 1] += holes[chunk];
+                survivors[chunk + 1] += survivors[chunk];
+            }
+
+            pool.run(chunks, [&](size_t chunk)
+            {
+                size_t rank = holes[chunk];
+                if (rank == holes[chunk + 1])
+                    return;
+
+                // Find the survivor chunk holding this rank, then the survivor
+                const size_t survivor_chunk = static_cast<size_t>(std::upper_bound(
+                    survivors.begin(), survivors.begin() + chunks + 1, rank) - survivors.begin()) - 1;
+                size_t source = new_size + chunk_begin(removed, chunks, survivor_chunk);
+                for (size_t seen = survivors[survivor_chunk];; ++source)
+                    if ((m_erase[source] != invalid_index) && (seen++ == rank))
+                        break;
+
+                const size_t hole_end = chunk_begin(new_size, chunks, chunk + 1);
+                for (size_t target = chunk_begin(new_size, chunks, chunk); target < hole_end; ++target)
+                {
+                    if (m_erase[target] != invalid_index)
+                        continue;
+
+                    while (m_erase[source] == invalid_index)
+                        ++source;
+
+                    m_data.relocate(target, source);
+                    const slot_index_type lookup_index = m_erase[source];
+                    m_erase[target] = lookup_index;
+                    m_lookups[lookup_index].data_index = static_cast<slot_index_type>(target);
+                    ++source;
+                }
+            });
+
+            std::fill(m_erase.begin() + new_size, m_erase.begin() + m_size, slot_index_type(invalid_index));
+            m_size = new_size;
+        }
+
+        /// <summary>
+        /// Closes the given number of holes left by erase_dense. Holes below
+        /// the new size are filled by the survivors above it, scanning from
+        /// both ends, so each element is relocated at most once.
+        /// Only used when relocation can't throw (see fill_each_removal).
+        /// </summary>
+        void compact_holes(size_t removed)
         {
-            return (++version > 0);
+            const size_t new_size = m_size - removed;
+
+            size_t source = m_size;
+            for (size_t target = 0; target < new_size; ++target)
+            {
+                if (m_erase[target] != invalid_index)
+                    continue;
+
+                // There are as many survivors above new_size as holes below
+                while (m_erase[--source] == invalid_index) {}
+
+                m_data.relocate(target, source);
+                const slot_index_type lookup_index = m_erase[source];
+                m_erase[target] = lookup_index;
+                m_erase[source] = invalid_index;
+                m_lookups[lookup_index].data_index = static_cast<slot_index_type>(target);
+            }
+
+            m_size = new_size;
         }
 
-        void reset_metadata()
+        /// <summary>
+        /// Closes the holes left by dead values, as compact() does, when
+        /// relocating T may throw. Survivors above the new size are moved
+        /// over dead values below it, which stay constructed until then, and
+        /// the tables are updated after each move. A throw thus leaves every
+        /// value constructed and every dead value still marked dead.
+        /// </summary>
+        void compact_by_assignment()
         {
-            if constexpr (N == 0)
+            const size_t new_size = m_size - m_dead;
+
+            size_t source = m_size;
+            for (size_t target = 0; target < new_size; ++target)
             {
-                m_free_head = invalid_index;
-                return;
+                if (m_erase[target] != invalid_index)
+                    continue;
+
+                while (m_erase[--source] == invalid_index) {}
+
+                // WARNING: This may throw if T's move assignment throws!
+                m_data[target] = std::move(m_data[source]);
+                const slot_index_type lookup_index = m_erase[source];
+                m_erase[target] = lookup_index;
+                m_erase[source] = invalid_index;
+                m_lookups[lookup_index].data_index = static_cast<slot_index_type>(target);
             }
 
-            for (index_type idx = 0; idx < N; ++idx)
+            for (size_t idx = new_size; idx < m_size; ++idx)
+                m_data.destroy(idx);
+            m_size = new_size;
+            m_dead = 0;
+        }
+
+        /// <summary>
+        /// Issues the prefetches for get_many at position idx: the lookup
+        /// entry two strides ahead, and the value one stride ahead, whose
+        /// lookup entry should have arrived in cache by now.
+        /// </summary>
+        void prefetch_ahead(const key_type* keys, size_t count, size_t idx) const
+        {
+            if ((idx + (2 * prefetch_distance)) < count)
             {
-                m_lookups[idx].data_index = invalid_index;
-                m_lookups[idx].next_free = (idx + 1);
-                m_erase[idx] = invalid_index;
+                const index_type lookup_index = key_traits_type::index(keys[idx + (2 * prefetch_distance)]);
+                if (lookup_index < m_high_water)
+                    nonstd::prefetch(std::addressof(m_lookups[lookup_index]));
             }
 
-            m_lookups[N - 1].next_free = invalid_index;
-            m_free_head = 0;
+            if ((idx + prefetch_distance) < count)
+            {
+                const index_type lookup_index = key_traits_type::index(keys[idx + prefetch_distance]);
+                if (lookup_index < m_high_water)
+                {
+                    const slot_index_type data_index = m_lookups[lookup_index].data_index;
+                    if (data_index < m_size)
+                        nonstd::prefetch(m_data.address(data_index));
+                }
+            }
         }
 
         lookup_t* resolve_key(key_type key)
         {
-            const index_type lookup_index = key.m_index;
+            const index_type lookup_index = key_traits_type::index(key);
             if (evaluate_index(lookup_index) == false)
                 return nullptr;
 
@@ -224,7 +1126,7 @@ namespace nonstd
 
         const lookup_t* resolve_key(key_type key) const
         {
-            const index_type lookup_index = key.m_index;
+            const index_type lookup_index = key_traits_type::index(key);
             if (evaluate_index(lookup_index) == false)
                 return nullptr;
 
@@ -237,32 +1139,48 @@ namespace nonstd
 
         bool evaluate_index(index_type lookup_index) const
         {
-            if (lookup_index >= N)
-                return false; // Out of range
+            stats_hook().on_lookup();
+            if (lookup_index >= m_high_water)
+            {
+                if (lookup_index >= N)
+                    stats_hook().on_out_of_range();
+                else
+                    stats_hook().on_stale();
+                return false; // Out of range or never issued
+            }
             return true;
         }
 
         bool evaluate_lookup(key_type key, lookup_t lookup) const
         {
-            if (lookup.data_index == invalid_index)
-                return false; // Element missing
-            if (lookup.data_index >= m_size)
-                return false; // Out of range
-            if (lookup.version != key.m_version)
-                return false; // Key outdated
+            const version_type version = key_traits_type::version(key);
+            if ((lookup.data_index == invalid_index) || // Element missing
+                (lookup.data_index >= m_size) ||        // Out of range
+                (lookup.version != version))            // Key outdated
+            {
+                stats_hook().on_stale();
+                return false;
+            }
             return true;
         }
 
         void destroy_all()
         {
-            for (uint16_t idx = 0; idx < m_size; ++idx)
+            for (size_t idx = 0; idx < m_size; ++idx)
                 m_data.destroy(idx);
         }
 
-        size_t                    m_size;
-        index_type                m_free_head;
-        nonstd::raw_buffer<T, N>  m_data;
-        std::array<lookup_t, N>   m_lookups;
-        std::array<index_type, N> m_erase;
+        // The policy hooks are bases, taking no storage when empty
+        stats_type& stats_hook()          const noexcept { return stats_base::get(); }
+        journal_hook_type& journal_hook() const noexcept { return journal_base::get(); }
+
+        size_t                                 m_size;
+        free_slots_type                        m_free_slots;
+        size_t                                 m_high_water; // Slots below have been used
+        nonstd::raw_buffer<T, N, storage_type> m_data;
+        std::array<lookup_t, N>                m_lookups;
+        std::array<slot_index_type, N>         m_erase;
+        size_t                                 m_retired;
+        size_t                                 m_dead;       // Always zero unless deferred
     };
 }
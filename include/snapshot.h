@@ -0,0 +1,565 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "journal.h"
+#include "policy.h"
+#include "storage.h"
+
+#if defined(NONSTD_MMAP)
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace nonstd
+{
+    namespace detail
+    {
+        /// <summary>
+        /// Leads every snapshot file. A snapshot is this header, padding up
+        /// to data_offset, then the container's bytes as they were in
+        /// memory, with the bytes it never set left as zeros (see
+        /// save_snapshot). A delta snapshot has its own magic, and
+        /// data_offset is followed by the delta's length and the delta
+        /// itself. A snapshot is only loaded into the same container type,
+        /// built the same way, so every field must match.
+        /// </summary>
+        struct snapshot_header
+        {
+            static constexpr uint64_t snapshot_magic  = 0x6E6F6E7374647370; // "nonstdsp"
+            static constexpr uint64_t delta_magic     = 0x6E6F6E737464646C; // "nonstddl"
+            static constexpr uint64_t snapshot_format = 2;
+
+            uint64_t magic;           // Also rejects the other byte order
+            uint64_t format;
+            uint64_t capacity;
+            uint64_t value_size;
+            uint64_t value_align;
+            uint64_t key_layout;      // See key_layout below
+            uint64_t type_hash;       // See type_fingerprint below
+            uint64_t container_size;
+            uint64_t container_align;
+            uint64_t data_offset;     // From the start of the file
+        };
+
+        template<typename Key, typename = void>
+        struct has_key_bits : std::false_type {};
+
+        template<typename Key>
+        struct has_key_bits<Key, std::void_t<decltype(Key::index_bits)>>
+            : std::true_type {};
+
+        /// <summary>
+        /// Packs a key type's size and field widths into one integer: the
+        /// key's byte size, then its index, version and meta bits, a byte
+        /// each. Plain integer keys (as in packed_array) have no fields.
+        /// </summary>
+        template<typename Key>
+        constexpr uint64_t key_layout() noexcept
+        {
+            uint64_t layout = sizeof(Key);
+            if constexpr (has_key_bits<Key>::value)
+            {
+                layout |= uint64_t(Key::index_bits)   << 8;
+                layout |= uint64_t(Key::version_bits) << 16;
+                layout |= uint64_t(Key::meta_bits)    << 24;
+            }
+            else if constexpr (!std::is_integral_v<Key>)
+            {
+                layout |= uint64_t(sizeof(typename Key::index_type)   * 8) << 8;
+                layout |= uint64_t(sizeof(typename Key::version_type) * 8) << 16;
+                layout |= uint64_t(sizeof(typename Key::meta_type)    * 8) << 24;
+            }
+            return layout;
+        }
+
+        /// <summary>
+        /// Hashes the container's full type, as the compiler spells it in
+        /// this function's name, with FNV-1a. Containers with the same
+        /// layout can read it differently under other policies, such as
+        /// deferred_removal or another version type, and this tells them
+        /// apart. Snapshots are for the same build, so writer and reader
+        /// spell the type alike.
+        /// </summary>
+        template<typename Container>
+        constexpr uint64_t type_fingerprint() noexcept
+        {
+#if defined(_MSC_VER) && !defined(__clang__)
+            const char* name = __FUNCSIG__;
+#else
+            const char* name = __PRETTY_FUNCTION__;
+#endif
+            uint64_t hash = 0xCBF29CE484222325;
+            for (; *name != '\0'; ++name)
+                hash = (hash ^ static_cast<unsigned char>(*name)) * 0x100000001B3;
+            return hash;
+        }
+
+        template<typename Container, typename = void>
+        struct snapshot_key
+        {
+            using type = typename Container::index_type;
+        };
+
+        template<typename Container>
+        struct snapshot_key<Container, std::void_t<typename Container::key_type>>
+        {
+            using type = typename Container::key_type;
+        };
+
+        template<typename Container>
+        constexpr size_t snapshot_data_offset() noexcept
+        {
+            constexpr size_t align = (alignof(Container) > 64) ? alignof(Container) : 64;
+            return ((sizeof(snapshot_header) + align - 1) / align) * align;
+        }
+
+        template<typename Container>
+        snapshot_header make_snapshot_header(uint64_t magic = snapshot_header::snapshot_magic) noexcept
+        {
+            using value_type = typename Container::value_type;
+
+            snapshot_header header = {};
+            header.magic           = magic;
+            header.format          = snapshot_header::snapshot_format;
+            header.capacity        = Container::capacity;
+            header.value_size      = sizeof(value_type);
+            header.value_align     = alignof(value_type);
+            header.key_layout      = key_layout<typename snapshot_key<Container>::type>();
+            header.type_hash       = type_fingerprint<Container>();
+            header.container_size  = sizeof(Container);
+            header.container_align = alignof(Container);
+            header.data_offset     = snapshot_data_offset<Container>();
+            return header;
+        }
+
+        template<typename Container>
+        bool snapshot_matches(
+            const snapshot_header& header,
+            uint64_t magic = snapshot_header::snapshot_magic) noexcept
+        {
+            const snapshot_header expected = make_snapshot_header<Container>(magic);
+            return
+                (header.magic           == expected.magic) &&
+                (header.format          == expected.format) &&
+                (header.capacity        == expected.capacity) &&
+                (header.value_size      == expected.value_size) &&
+                (header.value_align     == expected.value_align) &&
+                (header.key_layout      == expected.key_layout) &&
+                (header.type_hash       == expected.type_hash) &&
+                (header.container_size  == expected.container_size) &&
+                (header.container_align == expected.container_align) &&
+                (header.data_offset     == expected.data_offset);
+        }
+
+        template<typename Container, typename = void>
+        struct is_journaled : std::false_type {};
+
+        template<typename Container>
+        struct is_journaled<Container, std::void_t<typename Container::journal_type>>
+            : std::is_same<typename Container::journal_type, op_journaling> {};
+
+        template<typename Container, typename = void>
+        struct snapshot_stats
+        {
+            using type = no_stats;
+        };
+
+        template<typename Container>
+        struct snapshot_stats<Container, std::enable_if_t<has_stats_type<Container>::value>>
+        {
+            using type = typename Container::stats_type;
+        };
+
+        /// <summary>
+        /// Snapshots copy a container's raw image, which is only meaningful
+        /// if everything in it is plain data: values stored inline and
+        /// trivially copyable, and stats likewise. The one pointer a
+        /// container may hold is its journal's, which load_snapshot puts
+        /// back as it was.
+        /// </summary>
+        template<typename Container>
+        constexpr void check_snapshot_type() noexcept
+        {
+            static_assert(
+                std::is_same_v<typename Container::storage_type, inline_storage>,
+                "snapshots need the container's values stored inline");
+            static_assert(
+                std::is_trivially_copyable_v<typename Container::value_type>,
+                "snapshot values must be trivially copyable");
+            static_assert(
+                std::is_trivially_copyable_v<typename snapshot_stats<Container>::type>,
+                "snapshot stats must be trivially copyable");
+        }
+
+#if defined(NONSTD_MMAP)
+        inline void write_all(int fd, const void* data, size_t bytes)
+        {
+            const unsigned char* next = static_cast<const unsigned char*>(data);
+            while (bytes > 0)
+            {
+                const ssize_t written = ::write(fd, next, bytes);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "snapshot write");
+                }
+                next += written;
+                bytes -= static_cast<size_t>(written);
+            }
+        }
+
+        /// <summary>
+        /// Advances the file position by bytes that read back as zeros:
+        /// seeking where the file allows it, leaving a hole that takes no
+        /// space, or writing zeros where it doesn't, as on a pipe. Seeking
+        /// past the end doesn't extend a file, so the last byte of a run
+        /// that ends the file is always written.
+        /// </summary>
+        inline void skip_zeros(int fd, size_t bytes, bool ends_file)
+        {
+            static const unsigned char zeros[4096] = {};
+            const size_t seek = ends_file ? (bytes - std::min<size_t>(bytes, 1)) : bytes;
+            if ((seek > 0) && (::lseek(fd, static_cast<off_t>(seek), SEEK_CUR) >= 0))
+                bytes -= seek;
+            else if ((seek > 0) && (errno != ESPIPE))
+                throw std::system_error(errno, std::generic_category(), "snapshot seek");
+
+            while (bytes > 0)
+            {
+                const size_t chunk = std::min(bytes, sizeof(zeros));
+                write_all(fd, zeros, chunk);
+                bytes -= chunk;
+            }
+        }
+
+        /// <summary>
+        /// Returns false if the file ends first.
+        /// </summary>
+        inline bool read_all(int fd, void* data, size_t bytes)
+        {
+            unsigned char* next = static_cast<unsigned char*>(data);
+            while (bytes > 0)
+            {
+                const ssize_t got = ::read(fd, next, bytes);
+                if (got < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    throw std::system_error(errno, std::generic_category(), "snapshot read");
+                }
+                if (got == 0)
+                    return false;
+                next += got;
+                bytes -= static_cast<size_t>(got);
+            }
+            return true;
+        }
+#endif
+    }
+
+#if defined(NONSTD_MMAP)
+    /// <summary>
+    /// Writes a snapshot of a slot_array, keyed_array or packed_array to a
+    /// file descriptor, at its current position. The containers hold only
+    /// indices and inline values, so the snapshot is a header followed by
+    /// the container's own bytes, metadata and values alike. Only the
+    /// bytes the container has set are written (see its regions); the
+    /// rest, such as slots past the high-water mark, are skipped over as
+    /// a hole in the file that reads back as zeros, or written as zeros if
+    /// the descriptor can't seek. A mostly empty container thus takes
+    /// little disk space and never leaks stale memory into the file.
+    /// Needs inline storage and trivially copyable values.
+    /// </summary>
+    template<typename Container>
+    void save_snapshot(int fd, const Container& container)
+    {
+        detail::check_snapshot_type<Container>();
+
+        // Gather the set byte ranges in address order, merging those that
+        // touch, so that each run is one write
+        const unsigned char* image = reinterpret_cast<const unsigned char*>(std::addressof(container));
+        std::vector<std::pair<size_t, size_t>> runs;
+        container.regions(
+            [&](const void* data, size_t bytes)
+            {
+                const size_t first = static_cast<size_t>(static_cast<const unsigned char*>(data) - image);
+                if (bytes > 0)
+                    runs.emplace_back(first, first + bytes);
+            });
+        std::sort(runs.begin(), runs.end());
+
+        unsigned char padding[detail::snapshot_data_offset<Container>()] = {};
+        const detail::snapshot_header header = detail::make_snapshot_header<Container>();
+        std::memcpy(padding, &header, sizeof(header));
+        detail::write_all(fd, padding, sizeof(padding));
+
+        size_t written = 0;
+        for (size_t run = 0; run < runs.size();)
+        {
+            const size_t first = std::max(runs[run].first, written);
+            size_t last = runs[run].second;
+            for (++run; (run < runs.size()) && (runs[run].first <= last); ++run)
+                last = std::max(last, runs[run].second);
+
+            if (last > first)
+            {
+                detail::skip_zeros(fd, first - written, false);
+                detail::write_all(fd, image + first, last - first);
+                written = last;
+            }
+        }
+        detail::skip_zeros(fd, sizeof(Container) - written, true);
+    }
+
+    /// <summary>
+    /// Replaces a container's contents with a snapshot read from a file
+    /// descriptor, at its current position. Keys issued before the
+    /// snapshot was saved resolve exactly as they did then. Throws
+    /// std::runtime_error if the snapshot is for another container type
+    /// or is cut short, leaving the container empty in the latter case,
+    /// or std::system_error if reading fails. A container under
+    /// op_journaling keeps its own journal, not the saved container's.
+    /// </summary>
+    template<typename Container>
+    void load_snapshot(int fd, Container& container)
+    {
+        detail::check_snapshot_type<Container>();
+
+        unsigned char padding[detail::snapshot_data_offset<Container>()];
+        if (detail::read_all(fd, padding, sizeof(padding)) == false)
+            throw std::runtime_error("snapshot is truncated");
+
+        detail::snapshot_header header;
+        std::memcpy(&header, padding, sizeof(header));
+        if (detail::snapshot_matches<Container>(header) == false)
+            throw std::runtime_error("snapshot is for a different container type");
+
+        op_journal* journal = nullptr;
+        if constexpr (detail::is_journaled<Container>::value)
+            journal = container.journal();
+
+        // Ends the old contents while they are still valid. The image read
+        // over them, or a fresh container if it falls short, replaces them.
+        container.~Container();
+
+        bool complete = false;
+        std::exception_ptr error;
+        try
+        {
+            complete = detail::read_all(fd, std::addressof(container), sizeof(Container));
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        if (complete == false)
+            ::new(static_cast<void*>(std::addressof(container))) Container();
+        if constexpr (detail::is_journaled<Container>::value)
+            container.attach_journal(journal);
+
+        if (error)
+            std::rethrow_exception(error);
+        if (complete == false)
+            throw std::runtime_error("snapshot is truncated");
+    }
+
+    /// <summary>
+    /// Writes a delta snapshot of a keyed_array using dirty_tracking to a
+    /// file descriptor, at its current position: only the slots changed
+    /// since the previous delta (see keyed_array::write_delta). The array
+    /// moves to its next checkpoint even if writing then fails, in which
+    /// case replicas must be brought back with a full snapshot.
+    /// </summary>
+    template<typename Container>
+    void write_delta(int fd, Container& container)
+    {
+        std::vector<unsigned char> delta;
+        container.write_delta(
+            [&](const void* data, size_t bytes)
+            {
+                const unsigned char* first = static_cast<const unsigned char*>(data);
+                delta.insert(delta.end(), first, first + bytes);
+            });
+
+        unsigned char padding[detail::snapshot_data_offset<Container>()] = {};
+        const detail::snapshot_header header =
+            detail::make_snapshot_header<Container>(detail::snapshot_header::delta_magic);
+        std::memcpy(padding, &header, sizeof(header));
+
+        const uint64_t length = delta.size();
+        detail::write_all(fd, padding, sizeof(padding));
+        detail::write_all(fd, &length, sizeof(length));
+        detail::write_all(fd, delta.data(), delta.size());
+    }
+
+    /// <summary>
+    /// Reads a delta snapshot from a file descriptor, at its current
+    /// position, and applies it to a keyed_array left at the checkpoint the
+    /// delta was taken from, such as by load_snapshot or an earlier delta.
+    /// The whole delta is read before anything changes. Throws
+    /// std::runtime_error if it is for another container type or another
+    /// checkpoint, or is truncated, or std::system_error if reading fails.
+    /// </summary>
+    template<typename Container>
+    void apply_delta(int fd, Container& container)
+    {
+        unsigned char padding[detail::snapshot_data_offset<Container>()];
+        if (detail::read_all(fd, padding, sizeof(padding)) == false)
+            throw std::runtime_error("delta is truncated");
+
+        detail::snapshot_header header;
+        std::memcpy(&header, padding, sizeof(header));
+        if (detail::snapshot_matches<Container>(header, detail::snapshot_header::delta_magic) == false)
+            throw std::runtime_error("delta is for a different container type");
+
+        // No delta holds more than every slot and the whole container
+        constexpr uint64_t max_length =
+            sizeof(Container) + (Container::capacity * sizeof(typename Container::value_type)) +
+            (((Container::capacity + 63) / 64) * 3 * sizeof(uint64_t)) + 64;
+
+        uint64_t length = 0;
+        if (detail::read_all(fd, &length, sizeof(length)) == false)
+            throw std::runtime_error("delta is truncated");
+        if (length > max_length)
+            throw std::runtime_error("delta is for a different container type");
+
+        std::vector<unsigned char> delta(static_cast<size_t>(length));
+        if (detail::read_all(fd, delta.data(), delta.size()) == false)
+            throw std::runtime_error("delta is truncated");
+
+        size_t offset = 0;
+        container.apply_delta(
+            [&](void* data, size_t bytes)
+            {
+                if (bytes > (delta.size() - offset))
+                    throw std::runtime_error("delta is truncated");
+                std::memcpy(data, delta.data() + offset, bytes);
+                offset += bytes;
+            });
+    }
+
+    /// <summary>
+    /// A snapshot file mapped into memory and used in place as a container,
+    /// without reading or copying it. Pages are read from the file as they
+    /// are first touched. The mapping is private, so stats recorded by
+    /// lookups stay in this process and never reach the file.
+    /// </summary>
+    template<typename Container>
+    class snapshot_view
+    {
+    public:
+        using container_type = Container;
+
+        snapshot_view(snapshot_view&& rhs) noexcept
+            : m_pages(std::exchange(rhs.m_pages, nullptr))
+        {
+            // Pass
+        }
+
+        snapshot_view& operator=(snapshot_view&& rhs) noexcept
+        {
+            if (this != &rhs)
+            {
+                release();
+                m_pages = std::exchange(rhs.m_pages, nullptr);
+            }
+            return *this;
+        }
+
+        snapshot_view(const snapshot_view&)            = delete;
+        snapshot_view& operator=(const snapshot_view&) = delete;
+
+        ~snapshot_view()
+        {
+            release();
+        }
+
+        const Container& get() const noexcept
+        {
+            return *std::launder(reinterpret_cast<const Container*>(
+                static_cast<unsigned char*>(m_pages) + detail::snapshot_data_offset<Container>()));
+        }
+
+        const Container& operator*() const noexcept  { return get(); }
+        const Container* operator->() const noexcept { return &get(); }
+
+    private:
+        template<typename C>
+        friend snapshot_view<C> view_snapshot(const std::string& path);
+
+        static constexpr size_t mapped_size =
+            detail::snapshot_data_offset<Container>() + sizeof(Container);
+
+        explicit snapshot_view(void* pages) noexcept
+            : m_pages(pages)
+        {
+            // Pass
+        }
+
+        void release() noexcept
+        {
+            if (m_pages != nullptr)
+                ::munmap(m_pages, mapped_size);
+            m_pages = nullptr;
+        }
+
+        void* m_pages;
+    };
+
+    /// <summary>
+    /// Maps a snapshot file written by save_snapshot, starting at offset 0.
+    /// The container can't be journaled, as the view can't replace the
+    /// saved journal pointer, which means nothing in this process.
+    /// Throws std::system_error if the file can't be opened or mapped, or
+    /// std::runtime_error if it is truncated or for another container type.
+    /// </summary>
+    template<typename Container>
+    snapshot_view<Container> view_snapshot(const std::string& path)
+    {
+        detail::check_snapshot_type<Container>();
+        static_assert(detail::is_journaled<Container>::value == false,
+            "snapshot views would hold the saved container's journal pointer");
+        static_assert(alignof(Container) <= 4096, "snapshot views are only page-aligned");
+
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "snapshot open");
+
+        struct stat info = {};
+        const bool sized = (::fstat(fd, &info) == 0);
+        const bool fits = sized && (static_cast<size_t>(info.st_size) >= snapshot_view<Container>::mapped_size);
+        void* pages = MAP_FAILED;
+        if (fits)
+            pages = ::mmap(nullptr, snapshot_view<Container>::mapped_size,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        const int error = errno;
+        ::close(fd);
+
+        if (sized && !fits)
+            throw std::runtime_error("snapshot is truncated");
+        if (pages == MAP_FAILED)
+            throw std::system_error(error, std::generic_category(), "snapshot map");
+
+        snapshot_view<Container> view(pages);
+        if (detail::snapshot_matches<Container>(*static_cast<const detail::snapshot_header*>(pages)) == false)
+            throw std::runtime_error("snapshot is for a different container type");
+        return view;
+    }
+#endif
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define NONSTD_MMAP 1
+#endif
+
+namespace nonstd
+{
+    /// <summary>
+    /// Storage policy that embeds a raw_buffer's slots in the buffer itself,
+    /// and so in the containing object, wherever that lives.
+    /// </summary>
+    struct inline_storage {};
+
+    /// <summary>
+    /// Storage policy that allocates a raw_buffer's slots on the heap when
+    /// the buffer is constructed, leaving them uninitialized, so that large
+    /// containers can be declared on the stack or as plain members.
+    /// </summary>
+    struct heap_storage {};
+
+    /// <summary>
+    /// Storage policy that maps a raw_buffer's slots as anonymous memory.
+    /// Where supported (Linux), mappings of 2MB or more are aligned to 2MB
+    /// and advised to use transparent huge pages, which cuts TLB misses on
+    /// random access. Pages are faulted in on first touch. Platforms
+    /// without mmap fall back to page-aligned heap memory.
+    /// </summary>
+    struct mmap_storage
+    {
+        static constexpr bool prefault = false;
+    };
+
+    /// <summary>
+    /// As mmap_storage, but every page is touched when the buffer is
+    /// constructed, so that no page faults are taken on later first use.
+    /// </summary>
+    struct prefaulted_mmap_storage
+    {
+        static constexpr bool prefault = true;
+    };
+
+    namespace detail
+    {
+        inline constexpr size_t huge_page_size = size_t(2) << 20;
+
+        inline size_t round_up(size_t value, size_t multiple) noexcept
+        {
+            return ((value + multiple - 1) / multiple) * multiple;
+        }
+
+        inline size_t page_size() noexcept
+        {
+#if defined(NONSTD_MMAP)
+            static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            return size;
+#else
+            return 4096;
+#endif
+        }
+
+        /// <summary>
+        /// The number of bytes map_pages actually maps for a request.
+        /// </summary>
+        inline size_t mapped_size(size_t bytes) noexcept
+        {
+#if defined(NONSTD_MMAP) && defined(MADV_HUGEPAGE)
+            if (bytes >= huge_page_size)
+                return round_up(bytes, huge_page_size);
+#endif
+            return round_up(bytes, page_size());
+        }
+
+        /// <summary>
+        /// Maps at least the given number of bytes of zeroed, page-aligned
+        /// memory, as described for mmap_storage. Throws std::bad_alloc on
+        /// failure. Returns nullptr for zero bytes.
+        /// </summary>
+        inline void* map_pages(size_t bytes, bool prefault)
+        {
+            if (bytes == 0)
+                return nullptr;
+
+            const size_t mapped = mapped_size(bytes);
+            unsigned char* begin = nullptr;
+
+#if defined(NONSTD_MMAP)
+            // Huge pages need a 2MB-aligned range, so over-map and trim
+            const size_t alignment = (mapped % huge_page_size == 0) ? huge_page_size : 0;
+            const size_t span = mapped + alignment;
+
+            void* raw = ::mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED)
+                throw std::bad_alloc();
+
+            unsigned char* const first = static_cast<unsigned char*>(raw);
+            begin = first;
+            if (alignment > 0)
+            {
+                begin = first + (round_up(reinterpret_cast<uintptr_t>(first), alignment) -
+                    reinterpret_cast<uintptr_t>(first));
+                if (begin != first)
+                    ::munmap(first, static_cast<size_t>(begin - first));
+                if ((begin + mapped) != (first + span))
+                    ::munmap(begin + mapped, static_cast<size_t>((first + span) - (begin + mapped)));
+            }
+
+#if defined(MADV_HUGEPAGE)
+            if (alignment > 0)
+                ::madvise(begin, mapped, MADV_HUGEPAGE); // Only advice, failure is fine
+#endif
+#else
+            begin = static_cast<unsigned char*>(
+                ::operator new(mapped, std::align_val_t(page_size())));
+
+            std::memset(begin, 0, mapped); // Heap memory isn't zeroed as mappings are
+#endif
+
+            if (prefault)
+            {
+                // Writes are needed, as reads would map the shared zero page
+                for (size_t offset = 0; offset < mapped; offset += page_size())
+                    static_cast<volatile unsigned char*>(begin)[offset] = 0;
+            }
+            return begin;
+        }
+
+        inline void unmap_pages(void* pages, size_t bytes) noexcept
+        {
+            if (pages == nullptr)
+                return;
+#if defined(NONSTD_MMAP)
+            ::munmap(pages, mapped_size(bytes));
+#else
+            ::operator delete(pages, std::align_val_t(page_size()));
+#endif
+        }
+
+        /// <summary>
+        /// Holds the N slots of a raw_buffer, as placed by Storage. Slots
+        /// are reached by subscript rather than through data(), which keeps
+        /// inline slot writes visibly inside the array for alias analysis.
+        /// </summary>
+        template<typename Storage, typename Slot, size_t N>
+        class buffer_storage;
+
+        template<typename Slot, size_t N>
+        class buffer_storage<inline_storage, Slot, N>
+        {
+        public:
+            Slot* data() noexcept             { return m_slots.data(); }
+            const Slot* data() const noexcept { return m_slots.data(); }
+
+            Slot& operator[](size_t pos) noexcept             { return m_slots[pos]; }
+            const Slot& operator[](size_t pos) const noexcept { return m_slots[pos]; }
+
+        private:
+            std::array<Slot, N> m_slots;
+        };
+
+        template<typename Slot, size_t N>
+        class buffer_storage<heap_storage, Slot, N>
+        {
+        public:
+            buffer_storage()
+                : m_slots(new Slot[N]) // Default-initialized, so untouched
+            {
+                // Pass
+            }
+
+            Slot* data() noexcept             { return m_slots.get(); }
+            const Slot* data() const noexcept { return m_slots.get(); }
+
+            Slot& operator[](size_t pos) noexcept             { return m_slots[pos]; }
+            const Slot& operator[](size_t pos) const noexcept { return m_slots[pos]; }
+
+        private:
+            std::unique_ptr<Slot[]> m_slots;
+        };
+
+        template<typename Slot, size_t N, bool Prefault>
+        class mapped_storage
+        {
+            static_assert(alignof(Slot) <= 4096, "mapped storage is only page-aligned");
+
+        public:
+            mapped_storage()
+                : m_slots(static_cast<Slot*>(map_pages(sizeof(Slot) * N, Prefault)))
+            {
+                // Pass
+            }
+
+            ~mapped_storage()
+            {
+                unmap_pages(m_slots, sizeof(Slot) * N);
+            }
+
+            mapped_storage(const mapped_storage&)            = delete;
+            mapped_storage& operator=(const mapped_storage&) = delete;
+
+            Slot* data() noexcept             { return m_slots; }
+            const Slot* data() const noexcept { return m_slots; }
+
+            Slot& operator[](size_t pos) noexcept             { return m_slots[pos]; }
+            const Slot& operator[](size_t pos) const noexcept { return m_slots[pos]; }
+
+        private:
+            Slot* m_slots;
+        };
+
+        template<typename Slot, size_t N>
+        class buffer_storage<mmap_storage, Slot, N>
+            : public mapped_storage<Slot, N, mmap_storage::prefault> {};
+
+        template<typename Slot, size_t N>
+        class buffer_storage<prefaulted_mmap_storage, Slot, N>
+            : public mapped_storage<Slot, N, prefaulted_mmap_storage::prefault> {};
+    }
+}
@@ -1,13 +1,41 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
 
 namespace nonstd
 {
+    /// <summary>
+    /// How the keyed containers read and build keys of a given type. The
+    /// default reads m_version and m_index members and builds keys with a
+    /// (version, index, meta) constructor, with limits taken from the full
+    /// range of each member type. Specialize this to support other layouts.
+    /// </summary>
+    template<typename Key>
+    struct key_traits
+    {
+        using version_type = typename Key::version_type;
+        using index_type   = typename Key::index_type;
+        using meta_type    = typename Key::meta_type;
+
+        static constexpr version_type max_version = std::numeric_limits<version_type>::max();
+        static constexpr index_type max_index = std::numeric_limits<index_type>::max();
+
+        static version_type version(const Key& key) noexcept { return key.m_version; }
+        static index_type index(const Key& key)     noexcept { return key.m_index; }
+
+        static Key make(version_type version, index_type index, meta_type meta) noexcept
+        {
+            return Key(version, index, meta);
+        }
+    };
+
     struct versioned_key
     {
-        template<class, size_t, typename> friend class slot_array;
-        template<class, size_t, typename> friend class keyed_array;
+        template<typename> friend struct key_traits;
 
     public:
         using version_type = uint32_t;
@@ -38,4 +66,164 @@ namespace nonstd
     protected:
         meta_type    m_meta; // User metadata field, hidden unless overridden
     };
+
+    namespace detail
+    {
+        /// <summary>
+        /// The smallest unsigned integer type with at least Bits bits.
+        /// </summary>
+        template<unsigned Bits>
+        using uint_least_t =
+            std::conditional_t<(Bits <= 8),  uint8_t,
+            std::conditional_t<(Bits <= 16), uint16_t,
+            std::conditional_t<(Bits <= 32), uint32_t,
+                                             uint64_t>>>;
+
+        /// <summary>
+        /// The smallest unsigned integer type that can represent Max.
+        /// </summary>
+        template<uint64_t Max>
+        using uint_fitting_t =
+            std::conditional_t<(Max <= UINT8_MAX),  uint8_t,
+            std::conditional_t<(Max <= UINT16_MAX), uint16_t,
+            std::conditional_t<(Max <= UINT32_MAX), uint32_t,
+                                                    uint64_t>>>;
+
+        constexpr uint64_t low_bits(unsigned bits) noexcept
+        {
+            return (bits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << bits) - 1);
+        }
+    }
+
+    /// <summary>
+    /// A versioned key packed into a single 64-bit integer, with the given
+    /// number of bits for each field. Wider index fields allow containers
+    /// far larger than versioned_key's 16-bit index, and keys compare and
+    /// hash as one integer. Meta data beyond MetaBits is truncated.
+    /// </summary>
+    template<
+        unsigned IndexBits,
+        unsigned VersionBits,
+        unsigned MetaBits = 64 - IndexBits - VersionBits>
+    class basic_versioned_key
+    {
+        template<typename> friend struct key_traits;
+
+        static_assert((IndexBits > 0) && (VersionBits > 0),
+            "basic_versioned_key needs index and version bits");
+        static_assert((IndexBits + VersionBits + MetaBits) <= 64,
+            "basic_versioned_key fields must fit in 64 bits");
+
+        static constexpr unsigned version_shift = IndexBits;
+        static constexpr unsigned meta_shift = IndexBits + VersionBits;
+
+    public:
+        using version_type = detail::uint_least_t<VersionBits>;
+        using index_type   = detail::uint_least_t<IndexBits>;
+        using meta_type    = detail::uint_least_t<(MetaBits > 0) ? MetaBits : 1>;
+
+        static constexpr unsigned index_bits   = IndexBits;
+        static constexpr unsigned version_bits = VersionBits;
+        static constexpr unsigned meta_bits    = MetaBits;
+
+        basic_versioned_key() = default;
+
+        bool is_null()    const noexcept { return (version() == 0); }
+        operator bool()   const noexcept { return (version() != 0); }
+        uint64_t bits()   const noexcept { return m_bits; }
+
+        meta_type meta() const noexcept
+        {
+            if constexpr (MetaBits == 0)
+                return 0;
+            else
+                return static_cast<meta_type>(
+                    (m_bits >> meta_shift) & detail::low_bits(MetaBits));
+        }
+
+        friend bool operator==(basic_versioned_key lhs, basic_versioned_key rhs) noexcept
+        {
+            return lhs.m_bits == rhs.m_bits;
+        }
+
+        friend bool operator!=(basic_versioned_key lhs, basic_versioned_key rhs) noexcept
+        {
+            return lhs.m_bits != rhs.m_bits;
+        }
+
+        friend bool operator<(basic_versioned_key lhs, basic_versioned_key rhs) noexcept
+        {
+            return lhs.m_bits < rhs.m_bits;
+        }
+
+    private:
+        basic_versioned_key(
+            version_type version,
+            index_type index,
+            meta_type meta)
+            : m_bits(
+                (uint64_t(index) & detail::low_bits(IndexBits)) |
+                ((uint64_t(version) & detail::low_bits(VersionBits)) << version_shift))
+        {
+            if constexpr (MetaBits > 0)
+                m_bits |= (uint64_t(meta) & detail::low_bits(MetaBits)) << meta_shift;
+        }
+
+        index_type index() const noexcept
+        {
+            return static_cast<index_type>(m_bits & detail::low_bits(IndexBits));
+        }
+
+        version_type version() const noexcept
+        {
+            return static_cast<version_type>(
+                (m_bits >> version_shift) & detail::low_bits(VersionBits));
+        }
+
+        uint64_t m_bits;
+    };
+
+    /// <summary>
+    /// Limits come from the bit widths of each field rather than the types.
+    /// </summary>
+    template<unsigned IndexBits, unsigned VersionBits, unsigned MetaBits>
+    struct key_traits<basic_versioned_key<IndexBits, VersionBits, MetaBits>>
+    {
+        using key_type     = basic_versioned_key<IndexBits, VersionBits, MetaBits>;
+        using version_type = typename key_type::version_type;
+        using index_type   = typename key_type::index_type;
+        using meta_type    = typename key_type::meta_type;
+
+        static constexpr version_type max_version =
+            static_cast<version_type>(detail::low_bits(VersionBits));
+        static constexpr index_type max_index =
+            static_cast<index_type>(detail::low_bits(IndexBits));
+
+        static version_type version(const key_type& key) noexcept { return key.version(); }
+        static index_type index(const key_type& key)     noexcept { return key.index(); }
+
+        static key_type make(version_type version, index_type index, meta_type meta) noexcept
+        {
+            return key_type(version, index, meta);
+        }
+    };
+
+    /// <summary>
+    /// A 64-bit key with room for about a million slots, four billion
+    /// versions per slot, and 12 bits of meta data.
+    /// </summary>
+    using wide_versioned_key = basic_versioned_key<20, 32, 12>;
+}
+
+namespace std
+{
+    template<unsigned IndexBits, unsigned VersionBits, unsigned MetaBits>
+    struct hash<nonstd::basic_versioned_key<IndexBits, VersionBits, MetaBits>>
+    {
+        size_t operator()(
+            nonstd::basic_versioned_key<IndexBits, VersionBits, MetaBits> key) const noexcept
+        {
+            return std::hash<uint64_t>()(key.bits());
+        }
+    };
 }
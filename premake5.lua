@@ -15,8 +15,8 @@ workspace "tests"
 		
 	-- Linux-specific platforms and functionality
 	filter "action:gmake"
-		linkoptions { "-lm" }   
-		buildoptions { "-Wno-unknown-pragmas" }
+		linkoptions { "-lm", "-pthread", "-lrt" }   
+		buildoptions { "-Wno-unknown-pragmas", "-pthread" }
 	  
 	-- Global debug settings
 	filter "configurations:debug"
@@ -36,3 +36,8 @@ project "tests"
 	kind "ConsoleApp"
 	location "tests/"
 	files { "include/**.h", "tests/**.h", "tests/**.cpp" }
+
+project "bench"
+	kind "ConsoleApp"
+	location "bench/"
+	files { "include/**.h", "bench/**.h", "bench/**.cpp" }
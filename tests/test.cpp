@@ -1,10 +1,21 @@
 #define CATCH_CONFIG_MAIN
 #include "test.h"
 
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "../include/key_validation.h"
+#include "../include/journal.h"
 #include "../include/keyed_array.h"
+#include "../include/multi_slot_array.h"
 #include "../include/packed_array.h"
+#include "../include/parallel.h"
 #include "../include/push_array.h"
 #include "../include/raw_buffer.h"
+#include "../include/shared_segment.h"
+#include "../include/snapshot.h"
 #include "../include/slot_array.h"
 #include "../include/versioned_key.h"
 
@@ -96,6 +107,33 @@ namespace test_raw_buffer
             }
         }
     }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::raw_buffer storage",
+        "[nonstd][raw-buffer]",
+        nonstd::inline_storage,
+        nonstd::heap_storage,
+        nonstd::mmap_storage,
+        nonstd::prefaulted_mmap_storage)
+    {
+        constexpr size_t size = 1 << 19; // 4MB of int64_t, enough for huge pages
+
+        auto buf = std::make_unique<nonstd::raw_buffer<int64_t, size, TestType>>();
+        REQUIRE((reinterpret_cast<uintptr_t>(buf->data()) % alignof(int64_t)) == 0);
+
+        for (size_t idx = 0; idx < size; ++idx)
+            buf->emplace(idx, static_cast<int64_t>(idx));
+        REQUIRE(buf->at(0) == 0);
+        REQUIRE(buf->at(size - 1) == static_cast<int64_t>(size - 1));
+        REQUIRE(buf->data()[size / 2] == static_cast<int64_t>(size / 2));
+        REQUIRE_THROWS_AS(buf->at(size), std::out_of_range);
+
+#if defined(MADV_HUGEPAGE)
+        if constexpr (!std::is_same_v<TestType, nonstd::inline_storage> &&
+                      !std::is_same_v<TestType, nonstd::heap_storage>)
+            REQUIRE((reinterpret_cast<uintptr_t>(buf->data()) % (size_t(2) << 20)) == 0);
+#endif
+    }
 }
 
 namespace test_keyed_array
@@ -270,6 +308,582 @@ namespace test_keyed_array
 
         REQUIRE(ref_proxy::test_refs(refcount, 0));
     }
+
+    TEST_CASE(
+        "nonstd::keyed_array statistics",
+        "[nonstd][keyed-array][stats]")
+    {
+        using structure_type = nonstd::keyed_array<
+            ref_proxy, 4, nonstd::versioned_key, nonstd::counting_policy>;
+        using foreign_type = nonstd::keyed_array<ref_proxy, 8>;
+
+        int32_t refcount = 0;
+        auto structure = structure_type();
+        auto foreign = foreign_type();
+
+        auto keys = std::array<typename structure_type::key_type, 3>();
+        for (auto& key : keys)
+            key = test_emplace(structure, 0, &refcount);
+
+        auto foreign_key = test_emplace(foreign, 0, &refcount);
+        for (size_t idx = 0; idx < 5; ++idx)
+            foreign_key = test_emplace(foreign, 0, &refcount);
+
+        const auto& stats = structure.stats();
+        REQUIRE(stats.insertions == 3);
+        REQUIRE(stats.size == 3);
+        REQUIRE(stats.size_high_water == 3);
+        REQUIRE(stats.max_version == 1);
+
+        SECTION("lookups and misses are counted")
+        {
+            REQUIRE(structure.try_remove(keys[0]));
+            REQUIRE(structure.try_get(keys[0]) == nullptr);
+            REQUIRE(structure.try_get(keys[1]) != nullptr);
+            REQUIRE(structure.try_get(foreign_key) == nullptr);
+
+            REQUIRE(stats.lookups == 4);
+            REQUIRE(stats.removals == 1);
+            REQUIRE(stats.stale_misses == 1);
+            REQUIRE(stats.out_of_range == 1);
+            REQUIRE(stats.size == 2);
+
+            SECTION("reusing a slot raises the maximum version")
+            {
+                test_emplace(structure, 0, &refcount);
+                REQUIRE(stats.max_version == 2);
+                REQUIRE(stats.size_high_water == 3);
+            }
+        }
+
+        SECTION("clearing and resetting keeps the size consistent")
+        {
+            structure.clear();
+            REQUIRE(stats.size == 0);
+            REQUIRE(stats.removals == 3);
+            REQUIRE(stats.size_high_water == 3);
+
+            structure.reset_stats();
+            REQUIRE(stats.removals == 0);
+            REQUIRE(stats.size_high_water == 0);
+            REQUIRE(stats.max_version == 1);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::keyed_array version overflow",
+        "[nonstd][keyed-array][overflow]")
+    {
+        // Cycles a single slot through every version it can hold
+        auto exhaust = [](auto& structure, int32_t* refcount)
+        {
+            for (size_t idx = 0; idx < 255; ++idx)
+                REQUIRE(structure.try_remove(test_emplace(structure, 0, refcount)));
+        };
+
+        int32_t refcount = 0;
+
+        SECTION("the default policy throws on overflow")
+        {
+            auto structure = nonstd::keyed_array<ref_proxy, 2, small_version_key>();
+            exhaust(structure, &refcount);
+
+            REQUIRE_THROWS_AS(
+                test_emplace(structure, 0, &refcount),
+                std::overflow_error);
+        }
+
+        SECTION("batch insertion checks reused versions before inserting")
+        {
+            auto structure = nonstd::keyed_array<ref_proxy, 2, small_version_key>();
+            for (size_t idx = 0; idx < 254; ++idx)
+                REQUIRE(structure.try_remove(test_emplace(structure, 0, &refcount)));
+
+            // Slot 1 is reused first, then slot 0, which has no versions left
+            auto saturated = test_emplace(structure, 0, &refcount);
+            auto fresh = test_emplace(structure, 1, &refcount);
+            REQUIRE(structure.try_remove(saturated));
+            REQUIRE(structure.try_remove(fresh));
+
+            auto keys = std::vector<small_version_key>();
+            REQUIRE_THROWS_AS(
+                structure.emplace_n(2, std::back_inserter(keys), int64_t(2), &refcount),
+                std::overflow_error);
+            REQUIRE(keys.empty());
+            REQUIRE(structure.size() == 0);
+            REQUIRE(refcount == 0);
+
+            structure.emplace_n(1, std::back_inserter(keys), int64_t(3), &refcount);
+            REQUIRE(structure.try_get(keys[0])->value() == 3);
+            REQUIRE(structure.try_get(fresh) == nullptr);
+        }
+
+        SECTION("the retire policy retires saturated slots")
+        {
+            using structure_type =
+                nonstd::keyed_array<ref_proxy, 2, small_version_key, retire_policy>;
+
+            auto structure = structure_type();
+            exhaust(structure, &refcount);
+
+            REQUIRE(structure.retired() == 1);
+            REQUIRE(structure.stats().retirements == 1);
+
+            auto key = test_emplace(structure, 1, &refcount);
+            REQUIRE(key);
+            REQUIRE(structure.try_get(key)->value() == 1);
+
+            REQUIRE_THROWS_AS(
+                test_emplace(structure, 0, &refcount),
+                std::out_of_range);
+
+            SECTION("retired slots stay retired after a clear")
+            {
+                structure.clear();
+                REQUIRE(structure.retired() == 1);
+                REQUIRE(test_emplace(structure, 2, &refcount));
+                REQUIRE_THROWS_AS(
+                    test_emplace(structure, 0, &refcount),
+                    std::out_of_range);
+            }
+        }
+
+        REQUIRE(refcount == 0);
+    }
+
+    TEST_CASE(
+        "nonstd::keyed_array lazy slot initialization",
+        "[nonstd][keyed-array][lazy]")
+    {
+        using structure_type = nonstd::keyed_array<ref_proxy, 8>;
+
+        int32_t refcount = 0;
+        auto structure = structure_type();
+        auto foreign = structure_type();
+
+        auto foreign_keys = std::array<typename structure_type::key_type, 8>();
+        for (auto& key : foreign_keys)
+            key = test_emplace(foreign, 0, &refcount);
+
+        auto key = test_emplace(structure, 1, &refcount);
+
+        SECTION("keys to slots that were never used are rejected")
+        {
+            for (size_t idx = 1; idx < foreign_keys.size(); ++idx)
+            {
+                REQUIRE(structure.try_get(foreign_keys[idx]) == nullptr);
+                REQUIRE(structure.try_remove(foreign_keys[idx]) == false);
+            }
+        }
+
+        SECTION("clearing only recycles used slots and keeps their versions")
+        {
+            structure.clear();
+            REQUIRE(structure.try_get(key) == nullptr);
+
+            auto reused = test_emplace(structure, 2, &refcount);
+            REQUIRE(structure.try_get(key) == nullptr);
+            REQUIRE(structure.try_get(reused)->value() == 2);
+
+            for (size_t idx = 1; idx < foreign_keys.size(); ++idx)
+                REQUIRE(test_emplace(structure, 3, &refcount));
+            REQUIRE_THROWS_AS(
+                test_emplace(structure, 0, &refcount),
+                std::out_of_range);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::keyed_array batch emplacement",
+        "[nonstd][keyed-array][batch]")
+    {
+        SECTION("emplace_n refills freed slots before fresh ones")
+        {
+            using structure_type = nonstd::keyed_array<ref_proxy, 8>;
+            int32_t refcount = 0;
+            {
+                auto structure = structure_type();
+                auto first = test_emplace(structure, 0, &refcount);
+                auto second = test_emplace(structure, 1, &refcount);
+                REQUIRE(structure.try_remove(first));
+
+                auto keys = std::vector<typename structure_type::key_type>();
+                structure.emplace_n(4, std::back_inserter(keys), int64_t(7), &refcount);
+                REQUIRE(keys.size() == 4);
+                REQUIRE(structure.size() == 5);
+                REQUIRE(refcount == 5);
+
+                REQUIRE(structure.try_get(first) == nullptr);
+                REQUIRE(structure.try_get(second)->value() == 1);
+                for (auto key : keys)
+                    REQUIRE(structure.try_get(key)->value() == 7);
+
+                SECTION("a batch that doesn't fit inserts nothing")
+                {
+                    REQUIRE_THROWS_AS(
+                        structure.emplace_n(4, keys.begin(), int64_t(0), &refcount),
+                        std::out_of_range);
+                    REQUIRE(structure.size() == 5);
+                    REQUIRE(refcount == 5);
+
+                    structure.emplace_n(3, keys.begin(), int64_t(0), &refcount);
+                    REQUIRE(structure.size() == 8);
+                }
+            }
+            REQUIRE(refcount == 0);
+        }
+
+        SECTION("emplace_range writes one key per element in order")
+        {
+            auto structure = nonstd::keyed_array<int64_t, 8>();
+            auto values = test_range<int64_t, 6>(10);
+            auto keys = std::array<nonstd::versioned_key, 6>();
+
+            auto end = structure.emplace_range(values.begin(), values.end(), keys.begin());
+            REQUIRE(end == keys.end());
+            for (size_t idx = 0; idx < values.size(); ++idx)
+                REQUIRE(*structure.try_get(keys[idx]) == values[idx]);
+
+            SECTION("single-pass input ranges are inserted one at a time")
+            {
+                auto stream = std::istringstream("1 2 3");
+                auto more = std::vector<nonstd::versioned_key>();
+                REQUIRE_THROWS_AS(
+                    structure.emplace_range(
+                        std::istream_iterator<int64_t>(stream),
+                        std::istream_iterator<int64_t>(),
+                        std::back_inserter(more)),
+                    std::out_of_range);
+                REQUIRE(more.size() == 2);
+                REQUIRE(*structure.try_get(more[1]) == 2);
+            }
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::keyed_array batch lookup",
+        "[nonstd][keyed-array][batch]")
+    {
+        using structure_type = nonstd::keyed_array<int64_t, 100>;
+        using key_type = typename structure_type::key_type;
+
+        auto structure = structure_type();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 100; ++idx)
+            keys.push_back(structure.emplace_back<int64_t>(std::move(idx)));
+        for (size_t idx = 0; idx < 100; idx += 4)
+            REQUIRE(structure.try_remove(keys[idx]));
+
+        // Add keys with indices beyond this structure's capacity
+        auto larger = nonstd::keyed_array<int64_t, 200>();
+        for (int64_t idx = 0; idx < 120; ++idx)
+        {
+            auto key = larger.emplace_back<int64_t>(std::move(idx));
+            if (idx >= 100)
+                keys.push_back(key);
+        }
+
+        auto results = std::vector<int64_t*>(keys.size());
+        REQUIRE(structure.get_many(keys.data(), keys.size(), results.data()) == 75);
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+            REQUIRE(results[idx] == structure.try_get(keys[idx]));
+
+        const auto& view = structure;
+        auto const_results = std::vector<const int64_t*>(keys.size());
+        REQUIRE(view.get_many(keys.data(), 10, const_results.data()) == 7);
+        REQUIRE(*const_results[9] == 9);
+    }
+
+    TEST_CASE(
+        "nonstd::keyed_array occupied iteration",
+        "[nonstd][keyed-array]")
+    {
+        using structure_type = nonstd::keyed_array<testing::ref_proxy, 300>;
+        using key_type = typename structure_type::key_type;
+
+        int32_t refcount = 0;
+        auto structure = std::make_unique<structure_type>();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 100; ++idx)
+            keys.push_back(structure->emplace_back<int64_t, int32_t*>(std::move(idx), &refcount));
+        keys.resize(230);
+        structure->emplace_n(130, keys.begin() + 100, 0, &refcount);
+
+        // Leave 64-slot words empty, partly filled and full
+        for (size_t idx = 0; idx < 230; ++idx)
+            if (((idx >= 64) && (idx < 128)) || ((idx % 3) == 0))
+                REQUIRE(structure->try_remove(keys[idx]));
+
+        auto live = std::vector<size_t>();
+        for (size_t idx = 0; idx < 230; ++idx)
+            if (structure->try_get(keys[idx]) != nullptr)
+                live.push_back(idx);
+        REQUIRE(live.size() == structure->size());
+        REQUIRE(refcount == static_cast<int32_t>(live.size()));
+
+        SECTION("for_each_occupied visits live values in slot order")
+        {
+            auto expected = std::vector<testing::ref_proxy*>();
+            for (size_t idx : live)
+                expected.push_back(structure->try_get(keys[idx]));
+
+            auto visited = std::vector<testing::ref_proxy*>();
+            bool all_match = true;
+            structure->for_each_occupied([&](key_type key, testing::ref_proxy& value)
+            {
+                all_match &= (structure->try_get(key) == &value);
+                visited.push_back(&value);
+            });
+            REQUIRE(all_match);
+            REQUIRE(visited == expected);
+
+            const auto& view = *structure;
+            size_t count = 0;
+            view.for_each_occupied([&](key_type, const testing::ref_proxy&) { ++count; });
+            REQUIRE(count == live.size());
+        }
+
+        SECTION("keys yields the key of every live value")
+        {
+            auto visited = std::vector<key_type>();
+            for (key_type key : structure->keys())
+                visited.push_back(key);
+
+            REQUIRE(visited.size() == live.size());
+            bool all_match = true;
+            for (size_t idx = 0; idx < live.size(); ++idx)
+                all_match &= (structure->try_get(visited[idx]) == structure->try_get(keys[live[idx]]));
+            REQUIRE(all_match);
+
+            REQUIRE(structure->try_remove(keys[live.back()]));
+            REQUIRE(structure->try_get(visited.back()) == nullptr);
+            REQUIRE(std::distance(structure->keys().begin(), structure->keys().end()) ==
+                static_cast<std::ptrdiff_t>(live.size() - 1));
+        }
+
+        SECTION("values can be removed while iterating")
+        {
+            structure->for_each_occupied([&](key_type key, testing::ref_proxy& value)
+            {
+                if ((value.value() % 2) == 0)
+                    REQUIRE(structure->try_remove(key));
+            });
+            for (key_type key : structure->keys())
+                REQUIRE((structure->try_get(key)->value() % 2) != 0);
+            REQUIRE(refcount == static_cast<int32_t>(structure->size()));
+        }
+
+        SECTION("clear frees every value and reuses the lowest slot first")
+        {
+            structure->clear();
+            REQUIRE(structure->empty());
+            REQUIRE(refcount == 0);
+            REQUIRE(structure->keys().begin() == structure->keys().end());
+
+            auto key = structure->emplace_back<int64_t, int32_t*>(7, &refcount);
+            REQUIRE(nonstd::key_traits<key_type>::index(key) == live[0]);
+            REQUIRE(*structure->keys().begin() == key);
+        }
+
+        structure.reset();
+        REQUIRE(refcount == 0);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::keyed_array allocation order",
+        "[nonstd][keyed-array]",
+        nonstd::default_policy,
+        testing::fifo_policy,
+        testing::lowest_index_policy)
+    {
+        using structure_type = nonstd::keyed_array<int64_t, 300, nonstd::versioned_key, TestType>;
+        using key_type = typename structure_type::key_type;
+        using traits = nonstd::key_traits<key_type>;
+
+        auto structure = structure_type();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 10; ++idx)
+            keys.push_back(structure.template emplace_back<int64_t>(std::move(idx)));
+
+        SECTION("freed slots are reused in policy order")
+        {
+            for (size_t idx : { 5, 2, 7 })
+                REQUIRE(structure.try_remove(keys[idx]));
+
+            const auto expected = expected_reuse_order<typename TestType::allocation_type>();
+            for (size_t idx : expected)
+                REQUIRE(traits::index(structure.template emplace_back<int64_t>(0)) == idx);
+            REQUIRE(traits::index(structure.template emplace_back<int64_t>(0)) == 10);
+
+            auto more = std::vector<key_type>(2);
+            structure.try_remove(keys[1]);
+            structure.emplace_n(2, more.begin(), 0);
+            REQUIRE(traits::index(more[0]) == 1);
+            REQUIRE(traits::index(more[1]) == 11);
+        }
+
+        SECTION("churn keeps every slot reachable")
+        {
+            for (int64_t idx = 10; idx < 300; ++idx)
+                keys.push_back(structure.template emplace_back<int64_t>(std::move(idx)));
+
+            // Free a spread of slots across several bitmap words, then refill
+            uint32_t state = 777;
+            auto next = [&] { return (state = (state * 1103515245u) + 12345u) >> 8; };
+            bool all_match = true;
+            for (size_t round = 0; round < 20; ++round)
+            {
+                auto freed = std::vector<size_t>();
+                for (size_t idx = 0; idx < 300; ++idx)
+                    if ((next() % 4) == 0)
+                        if (structure.try_remove(keys[idx]))
+                            freed.push_back(idx);
+
+                for (size_t count = 0; count < freed.size(); ++count)
+                {
+                    auto key = structure.template emplace_back<int64_t>(int64_t(round));
+                    const size_t index = traits::index(key);
+                    if constexpr (std::is_same_v<TestType, testing::lowest_index_policy>)
+                        all_match &= (index == freed[count]);
+                    keys[index] = key;
+                }
+                all_match &= structure.full();
+            }
+            REQUIRE(all_match);
+        }
+    }
+
+    template<typename Structure, typename Keys>
+    bool validation_matches(Structure& structure, const Keys& keys)
+    {
+        auto valid = std::vector<uint64_t>((keys.size() + 63) / 64);
+        const size_t found = structure.validate_many(keys.data(), keys.size(), valid.data());
+
+        size_t expected = 0;
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+        {
+            const bool bit = ((valid[idx / 64] >> (idx % 64)) & 1) != 0;
+            const bool live = (structure.try_get(keys[idx]) != nullptr);
+            if (bit != live)
+                return false;
+            expected += live;
+        }
+        return (found == expected);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::keyed_array batch validation",
+        "[nonstd][keyed-array][batch]",
+        nonstd::default_policy,
+        nonstd::counting_policy)
+    {
+        using structure_type = nonstd::keyed_array<int64_t, 1000, nonstd::versioned_key, TestType>;
+        using key_type = typename structure_type::key_type;
+
+        auto structure = structure_type();
+        auto keys = std::vector<key_type>();
+        keys.push_back(key_type());
+
+        SECTION("an empty structure matches nothing")
+        {
+            REQUIRE(validation_matches(structure, keys));
+        }
+
+        for (int64_t idx = 0; idx < 1000; ++idx)
+            keys.push_back(structure.template emplace_back<int64_t>(std::move(idx), uint16_t(idx)));
+        for (size_t idx = 1; idx < keys.size(); idx += 3)
+            REQUIRE(structure.try_remove(keys[idx]));
+        for (size_t idx = 1; idx < keys.size(); idx += 6)
+            keys.push_back(structure.template emplace_back<int64_t>(0));
+
+        // Add keys with indices beyond this structure's capacity
+        auto larger = nonstd::keyed_array<int64_t, 2000>();
+        for (int64_t idx = 0; idx < 1037; ++idx)
+        {
+            auto key = larger.emplace_back<int64_t>(std::move(idx));
+            if (idx >= 1000)
+                keys.push_back(key);
+        }
+
+        REQUIRE(validation_matches(structure, keys));
+    }
+
+    TEST_CASE(
+        "nonstd::detail validation kernels agree",
+        "[nonstd][keyed-array][batch]")
+    {
+        // Versions 0-3 and indices up to 600 against 500 slots, 400 in use
+        auto versions = std::vector<uint32_t>(500);
+        auto free = std::vector<uint16_t>(501);
+        auto records = std::vector<nonstd::detail::key_record>(1001);
+        uint32_t state = 12345;
+        auto next = [&] { return (state = (state * 1103515245u) + 12345u) >> 8; };
+
+        for (size_t idx = 0; idx < versions.size(); ++idx)
+        {
+            versions[idx] = next() % 4;
+            free[idx] = ((next() % 4) == 0) ? 0 : 0xFFFE;
+        }
+        for (auto& record : records)
+            record = { next() % 4, uint16_t(next() % 600), uint16_t(next()) };
+
+        const nonstd::detail::key_slots slots = { versions.data(), free.data(), 400, 0xFFFE };
+        auto expected = std::vector<uint64_t>(16);
+        auto actual = std::vector<uint64_t>(16);
+        const size_t found = nonstd::detail::validate_keys(
+            nonstd::detail::validate_keys_scalar,
+            records.data(), records.size(), slots, expected.data());
+        REQUIRE(found > 0);
+
+        auto kernels = std::vector<nonstd::detail::validate_kernel>();
+#if defined(NONSTD_SIMD_DISPATCH)
+        if (nonstd::cpu_features().avx2)
+            kernels.push_back(nonstd::detail::validate_keys_avx2);
+        if (nonstd::cpu_features().avx512f)
+            kernels.push_back(nonstd::detail::validate_keys_avx512);
+#endif
+        kernels.push_back(nonstd::detail::select_validate_kernel());
+
+        for (auto kernel : kernels)
+        {
+            REQUIRE(nonstd::detail::validate_keys(
+                kernel, records.data(), records.size(), slots, actual.data()) == found);
+            REQUIRE(actual == expected);
+        }
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::keyed_array storage",
+        "[nonstd][keyed-array]",
+        testing::heap_policy,
+        testing::mmap_policy,
+        testing::prefaulted_mmap_policy)
+    {
+        using structure_type = nonstd::keyed_array<std::string, 1000, nonstd::versioned_key, TestType>;
+        using key_type = typename structure_type::key_type;
+
+        auto structure = std::make_unique<structure_type>();
+        auto keys = std::vector<key_type>();
+        for (size_t idx = 0; idx < 1000; ++idx)
+            keys.push_back(structure->template emplace_back<std::string>(std::to_string(idx)));
+
+        for (size_t idx = 0; idx < 1000; idx += 2)
+            REQUIRE(structure->try_remove(keys[idx]));
+        REQUIRE(structure->size() == 500);
+
+        size_t visited = 0;
+        structure->for_each_occupied(
+            [&](key_type, const std::string& value)
+            {
+                REQUIRE((std::stoul(value) % 2) == 1);
+                ++visited;
+            });
+        REQUIRE(visited == 500);
+
+        const std::string* value = structure->try_get(keys[999]);
+        REQUIRE(value != nullptr);
+        REQUIRE(*value == "999");
+    }
 }
 
 namespace test_slot_array
@@ -484,144 +1098,2306 @@ namespace test_slot_array
 
         REQUIRE(ref_proxy::test_refs(refcount, 0));
     }
-}
 
-namespace test_packed_array
-{
-    template<typename TVal>
-    struct test_clear
+    TEST_CASE(
+        "nonstd::slot_array statistics",
+        "[nonstd][slot-array][stats]")
     {
-        using val_type = TVal;
+        using structure_type = nonstd::slot_array<
+            ref_proxy, 4, nonstd::versioned_key, nonstd::counting_policy>;
+        using foreign_type = nonstd::slot_array<ref_proxy, 8>;
 
-        template<typename T>
-        static void clear(T& structure)
+        int32_t refcount = 0;
+        auto structure = structure_type();
+        auto foreign = foreign_type();
+
+        auto keys = std::array<typename structure_type::key_type, 3>();
+        for (auto& key : keys)
+            key = test_emplace(structure, 0, &refcount);
+
+        auto foreign_key = test_emplace(foreign, 0, &refcount);
+        for (size_t idx = 0; idx < 5; ++idx)
+            foreign_key = test_emplace(foreign, 0, &refcount);
+
+        const auto& stats = structure.stats();
+        REQUIRE(stats.insertions == 3);
+        REQUIRE(stats.size == 3);
+        REQUIRE(stats.size_high_water == 3);
+        REQUIRE(stats.max_version == 1);
+
+        SECTION("lookups and misses are counted")
         {
-            structure.clear();
+            REQUIRE(structure.try_remove(keys[0]));
+            REQUIRE(structure.try_get(keys[0]) == nullptr);
+            REQUIRE(structure.try_get(keys[1]) != nullptr);
+            REQUIRE(structure.try_get(foreign_key) == nullptr);
+
+            REQUIRE(stats.lookups == 4);
+            REQUIRE(stats.removals == 1);
+            REQUIRE(stats.stale_misses == 1);
+            REQUIRE(stats.out_of_range == 1);
+            REQUIRE(stats.size == 2);
+
+            SECTION("reusing a slot raises the maximum version")
+            {
+                test_emplace(structure, 0, &refcount);
+                REQUIRE(stats.max_version == 2);
+                REQUIRE(stats.size_high_water == 3);
+            }
         }
-    };
 
-    template<typename T>
-    void test_emplace(
-        T& structure,
-        int64_t value,
-        int32_t* dummy)
-    {
-        structure.template emplace_back<int64_t, int32_t*>(
-            std::move(value),
-            std::move(dummy));
+        SECTION("clearing and resetting keeps the size consistent")
+        {
+            structure.clear();
+            REQUIRE(stats.size == 0);
+            REQUIRE(stats.removals == 3);
+            REQUIRE(stats.size_high_water == 3);
+
+            structure.reset_stats();
+            REQUIRE(stats.removals == 0);
+            REQUIRE(stats.size_high_water == 0);
+            REQUIRE(stats.max_version == 1);
+        }
     }
 
-    template<typename T>
-    int64_t test_sum(T& structure)
+    TEST_CASE(
+        "nonstd::slot_array version overflow",
+        "[nonstd][slot-array][overflow]")
     {
-        int64_t sum = 0;
-        for (auto& proxy : structure)
-            sum += proxy.value();
-        return sum;
-    }
+        // Cycles a single slot through every version it can hold
+        auto exhaust = [](auto& structure, int32_t* refcount)
+        {
+            for (size_t idx = 0; idx < 255; ++idx)
+                REQUIRE(structure.try_remove(test_emplace(structure, 0, refcount)));
+        };
 
-    TEMPLATE_PRODUCT_TEST_CASE(
-        "nonstd::packed_array test cases",
-        "[nonstd][packed-array]",
-        (test_clear),
-        (val_t<0>, val_t<1>, val_t<20>, val_t<100>))
-    {
-        constexpr size_t size = TestType::val_type::val;
-        using structure_type = nonstd::packed_array<ref_proxy, size>;
+        int32_t refcount = 0;
 
-        auto arr = test_range<int64_t, size>();
-        auto refcount = std::array<int32_t, size>();
+        SECTION("the default policy throws on overflow")
+        {
+            auto structure = nonstd::slot_array<ref_proxy, 2, small_version_key>();
+            exhaust(structure, &refcount);
 
-        /* Do not use a section tag here! */
+            REQUIRE_THROWS_AS(
+                test_emplace(structure, 0, &refcount),
+                std::overflow_error);
+        }
+
+        SECTION("batch insertion checks reused versions before inserting")
         {
-            auto structure = structure_type();
+            auto structure = nonstd::slot_array<ref_proxy, 2, small_version_key>();
+            for (size_t idx = 0; idx < 254; ++idx)
+                REQUIRE(structure.try_remove(test_emplace(structure, 0, &refcount)));
+
+            // Slot 1 is reused first, then slot 0, which has no versions left
+            auto saturated = test_emplace(structure, 0, &refcount);
+            auto fresh = test_emplace(structure, 1, &refcount);
+            REQUIRE(structure.try_remove(saturated));
+            REQUIRE(structure.try_remove(fresh));
+
+            auto keys = std::vector<small_version_key>();
+            REQUIRE_THROWS_AS(
+                structure.emplace_n(2, std::back_inserter(keys), int64_t(2), &refcount),
+                std::overflow_error);
+            REQUIRE(keys.empty());
+            REQUIRE(structure.size() == 0);
+            REQUIRE(refcount == 0);
+
+            structure.emplace_n(1, std::back_inserter(keys), int64_t(3), &refcount);
+            REQUIRE(structure.try_get(keys[0])->value() == 3);
+            REQUIRE(structure.try_get(fresh) == nullptr);
+        }
 
-            for (size_t idx = 0; idx < structure.max_size(); ++idx)
-            {
-                test_emplace(structure, arr[idx], &refcount[idx]);
-            }
+        SECTION("the retire policy retires saturated slots")
+        {
+            using structure_type =
+                nonstd::slot_array<ref_proxy, 2, small_version_key, retire_policy>;
 
-            SECTION("the structure is filled properly")
-            {
-                REQUIRE(ref_proxy::test_refs(refcount, 1));
-                REQUIRE(structure.size() == size);
-            }
+            auto structure = structure_type();
+            exhaust(structure, &refcount);
 
-            SECTION("iterating over the structure matches expectations")
-            {
-                int64_t sum_expected = 0;
-                int64_t sum_computed = 0;
+            REQUIRE(structure.retired() == 1);
+            REQUIRE(structure.stats().retirements == 1);
 
-                for (auto& val : arr)
-                    sum_expected += val;
-                for (auto& val : structure)
-                    sum_computed += val.value();
+            auto key = test_emplace(structure, 1, &refcount);
+            REQUIRE(key);
+            REQUIRE(structure.try_get(key)->value() == 1);
 
-                REQUIRE(sum_expected == sum_computed);
-            }
+            REQUIRE_THROWS_AS(
+                test_emplace(structure, 0, &refcount),
+                std::out_of_range);
 
-            SECTION("the structure throws if added to")
+            SECTION("retired slots stay retired after a clear")
             {
-                int32_t dummy = 0;
+                structure.clear();
+                REQUIRE(structure.retired() == 1);
+                REQUIRE(test_emplace(structure, 2, &refcount));
                 REQUIRE_THROWS_AS(
-                    test_emplace(structure, 0, &dummy),
+                    test_emplace(structure, 0, &refcount),
                     std::out_of_range);
             }
+        }
 
-            SECTION("clearing works correctly")
-            {
-                TestType::clear(structure);
+        REQUIRE(refcount == 0);
+    }
 
-                REQUIRE(structure.size() == 0);
-                REQUIRE(ref_proxy::test_refs(refcount, 0));
+    TEST_CASE(
+        "nonstd::slot_array lazy slot initialization",
+        "[nonstd][slot-array][lazy]")
+    {
+        using structure_type = nonstd::slot_array<ref_proxy, 8>;
 
-                if constexpr (size > 0)
-                {
-                    SECTION("adding a new element is successful")
-                    {
-                        int32_t dummy = 0;
-                        test_emplace(structure, 0, &dummy);
-                        REQUIRE(structure.size() == 1);
-                    }
-                }
+        int32_t refcount = 0;
+        auto structure = structure_type();
+        auto foreign = structure_type();
 
-                SECTION("repopulating after a clear works correctly")
-                {
-                    int64_t offset = static_cast<int64_t>(size);
+        auto foreign_keys = std::array<typename structure_type::key_type, 8>();
+        for (auto& key : foreign_keys)
+            key = test_emplace(foreign, 0, &refcount);
 
-                    for (size_t idx = 0; idx < structure.max_size(); ++idx)
+        auto key = test_emplace(structure, 1, &refcount);
+
+        SECTION("keys to slots that were never used are rejected")
+        {
+            for (size_t idx = 1; idx < foreign_keys.size(); ++idx)
+            {
+                REQUIRE(structure.try_get(foreign_keys[idx]) == nullptr);
+                REQUIRE(structure.try_remove(foreign_keys[idx]) == false);
+            }
+        }
+
+        SECTION("clearing only recycles used slots and keeps their versions")
+        {
+            structure.clear();
+            REQUIRE(structure.try_get(key) == nullptr);
+
+            auto reused = test_emplace(structure, 2, &refcount);
+            REQUIRE(structure.try_get(key) == nullptr);
+            REQUIRE(structure.try_get(reused)->value() == 2);
+
+            for (size_t idx = 1; idx < foreign_keys.size(); ++idx)
+                REQUIRE(test_emplace(structure, 3, &refcount));
+            REQUIRE_THROWS_AS(
+                test_emplace(structure, 0, &refcount),
+                std::out_of_range);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array removal relocates the tail element",
+        "[nonstd][slot-array][relocate]")
+    {
+        op_counts counts;
+
+        SECTION("removal performs a single move construction")
+        {
+            auto structure = nonstd::slot_array<counted, 4>();
+            auto first = structure.emplace_back<int64_t, op_counts*>(1, &counts);
+            auto second = structure.emplace_back<int64_t, op_counts*>(2, &counts);
+            auto third = structure.emplace_back<int64_t, op_counts*>(3, &counts);
+
+            REQUIRE(structure.try_remove(first));
+            REQUIRE(counts.move_constructs == 1);
+            REQUIRE(counts.move_assigns == 0);
+            REQUIRE(counts.destroys == 2);
+
+            REQUIRE(structure.try_get(second)->value() == 2);
+            REQUIRE(structure.try_get(third)->value() == 3);
+            REQUIRE(structure.begin()->value() == 3);
+
+            SECTION("removing the tail element moves nothing")
+            {
+                REQUIRE(structure.try_remove(second));
+                REQUIRE(counts.move_constructs == 1);
+                REQUIRE(counts.destroys == 3);
+                REQUIRE(structure.try_get(third)->value() == 3);
+            }
+        }
+
+        SECTION("types whose moves may throw are move-assigned instead")
+        {
+            auto structure = std::make_unique<nonstd::slot_array<throwing_counted, 4>>();
+            auto first = structure->emplace_back<int64_t, op_counts*>(1, &counts);
+            auto second = structure->emplace_back<int64_t, op_counts*>(2, &counts);
+            auto third = structure->emplace_back<int64_t, op_counts*>(3, &counts);
+
+            REQUIRE(structure->try_remove(first));
+            REQUIRE(counts.move_constructs == 0);
+            REQUIRE(counts.move_assigns == 1);
+            REQUIRE(counts.destroys == 1);
+            REQUIRE(structure->try_get(third)->value() == 3);
+
+            SECTION("a throwing move leaves every value constructed")
+            {
+                counts.throw_on_move = true;
+                REQUIRE_THROWS_AS(structure->try_remove(third), std::runtime_error);
+                REQUIRE(counts.destroys == 1);
+                REQUIRE(structure->size() == 2);
+                REQUIRE(structure->try_get(second)->value() == 2);
+
+                // Each remaining value is destroyed exactly once
+                structure.reset();
+                REQUIRE(counts.destroys == 3);
+            }
+        }
+
+        SECTION("trivially relocatable types are copied bytewise")
+        {
+            auto structure = nonstd::slot_array<relocatable_counted, 4>();
+            auto first = structure.emplace_back<int64_t, op_counts*>(1, &counts);
+            auto second = structure.emplace_back<int64_t, op_counts*>(2, &counts);
+
+            REQUIRE(structure.try_remove(first));
+            REQUIRE(counts.move_constructs == 0);
+            REQUIRE(counts.move_assigns == 0);
+            REQUIRE(counts.destroys == 1);
+            REQUIRE(structure.try_get(second)->value() == 2);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array batch emplacement",
+        "[nonstd][slot-array][batch]")
+    {
+        SECTION("emplace_n refills freed slots before fresh ones")
+        {
+            using structure_type = nonstd::slot_array<ref_proxy, 8>;
+            int32_t refcount = 0;
+            {
+                auto structure = structure_type();
+                auto first = test_emplace(structure, 0, &refcount);
+                auto second = test_emplace(structure, 1, &refcount);
+                REQUIRE(structure.try_remove(first));
+
+                auto keys = std::vector<typename structure_type::key_type>();
+                structure.emplace_n(4, std::back_inserter(keys), int64_t(7), &refcount);
+                REQUIRE(keys.size() == 4);
+                REQUIRE(structure.size() == 5);
+                REQUIRE(refcount == 5);
+
+                REQUIRE(structure.try_get(first) == nullptr);
+                REQUIRE(structure.try_get(second)->value() == 1);
+                for (auto key : keys)
+                    REQUIRE(structure.try_get(key)->value() == 7);
+
+                SECTION("a batch that doesn't fit inserts nothing")
+                {
+                    REQUIRE_THROWS_AS(
+                        structure.emplace_n(4, keys.begin(), int64_t(0), &refcount),
+                        std::out_of_range);
+                    REQUIRE(structure.size() == 5);
+                    REQUIRE(refcount == 5);
+
+                    structure.emplace_n(3, keys.begin(), int64_t(0), &refcount);
+                    REQUIRE(structure.size() == 8);
+                }
+            }
+            REQUIRE(refcount == 0);
+        }
+
+        SECTION("emplace_range writes one key per element in order")
+        {
+            auto structure = nonstd::slot_array<int64_t, 8>();
+            auto values = test_range<int64_t, 6>(10);
+            auto keys = std::array<nonstd::versioned_key, 6>();
+
+            auto end = structure.emplace_range(values.begin(), values.end(), keys.begin());
+            REQUIRE(end == keys.end());
+            for (size_t idx = 0; idx < values.size(); ++idx)
+                REQUIRE(*structure.try_get(keys[idx]) == values[idx]);
+
+            SECTION("single-pass input ranges are inserted one at a time")
+            {
+                auto stream = std::istringstream("1 2 3");
+                auto more = std::vector<nonstd::versioned_key>();
+                REQUIRE_THROWS_AS(
+                    structure.emplace_range(
+                        std::istream_iterator<int64_t>(stream),
+                        std::istream_iterator<int64_t>(),
+                        std::back_inserter(more)),
+                    std::out_of_range);
+                REQUIRE(more.size() == 2);
+                REQUIRE(*structure.try_get(more[1]) == 2);
+            }
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array batch removal",
+        "[nonstd][slot-array][batch]")
+    {
+        using structure_type = nonstd::slot_array<ref_proxy, 20>;
+        using key_type = typename structure_type::key_type;
+
+        int32_t refcount = 0;
+        auto structure = structure_type();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 20; ++idx)
+            keys.push_back(test_emplace(structure, idx, &refcount));
+
+        auto survivors_match = [&](auto removed)
+        {
+            int64_t sum = 0;
+            for (auto& proxy : structure)
+                sum += proxy.value();
+
+            int64_t expected = 0;
+            for (int64_t idx = 0; idx < 20; ++idx)
+            {
+                auto* value = structure.try_get(keys[idx]);
+                if (removed(idx))
+                {
+                    if (value != nullptr)
+                        return false;
+                }
+                else
+                {
+                    if ((value == nullptr) || (value->value() != idx))
+                        return false;
+                    expected += idx;
+                }
+            }
+            return (sum == expected) && (refcount == int32_t(structure.size()));
+        };
+
+        SECTION("remove_many skips duplicate and stale keys")
+        {
+            auto doomed = std::vector<key_type>();
+            for (size_t idx = 0; idx < 20; idx += 3)
+                doomed.push_back(keys[idx]);
+            doomed.push_back(keys[3]);
+
+            REQUIRE(structure.remove_many(doomed.data(), doomed.size()) == 7);
+            REQUIRE(structure.size() == 13);
+            REQUIRE(survivors_match([](int64_t idx) { return (idx % 3) == 0; }));
+            REQUIRE(structure.remove_many(doomed.begin(), doomed.end()) == 0);
+
+            SECTION("freed slots are reused with new versions")
+            {
+                for (size_t idx = 0; idx < 7; ++idx)
+                    REQUIRE(test_emplace(structure, 0, &refcount));
+                REQUIRE(structure.size() == 20);
+                REQUIRE(survivors_match([](int64_t idx) { return (idx % 3) == 0; }));
+            }
+        }
+
+        SECTION("remove_if removes matching values")
+        {
+            auto odd = [](const ref_proxy& proxy) { return (proxy.value() % 2) != 0; };
+            REQUIRE(structure.remove_if(odd) == 10);
+            REQUIRE(survivors_match([](int64_t idx) { return (idx % 2) != 0; }));
+
+            REQUIRE(structure.remove_if([](const ref_proxy&) { return true; }) == 10);
+            REQUIRE(structure.empty());
+            REQUIRE(refcount == 0);
+        }
+
+        SECTION("a throwing predicate leaves the structure consistent")
+        {
+            int32_t calls = 0;
+            auto fussy = [&](const ref_proxy& proxy)
+            {
+                if (++calls > 10)
+                    throw std::runtime_error("fussy");
+                return (proxy.value() % 2) == 0;
+            };
+
+            // ref_proxy's moves may throw, so values are removed one at a
+            // time, testing the dense array from the top down
+            REQUIRE_THROWS_AS(structure.remove_if(fussy), std::runtime_error);
+            REQUIRE(structure.size() == 15);
+            REQUIRE(survivors_match([](int64_t idx) { return (idx >= 10) && ((idx % 2) == 0); }));
+            REQUIRE(refcount == 15);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array batch removal moves each survivor at most once",
+        "[nonstd][slot-array][batch]")
+    {
+        op_counts counts;
+        auto structure = nonstd::slot_array<counted, 8>();
+        for (int64_t idx = 0; idx < 8; ++idx)
+            structure.emplace_back<int64_t, op_counts*>(std::move(idx), &counts);
+
+        // Removing the front half needs exactly one move per hole
+        REQUIRE(structure.remove_if([](const counted& value) { return value.value() < 4; }) == 4);
+        REQUIRE(counts.move_constructs == 4);
+        REQUIRE(counts.destroys == 8);
+
+        // Survivors are now stored as 7, 6, 5, 4, so removing the tail needs none
+        REQUIRE(structure.remove_if([](const counted& value) { return value.value() < 6; }) == 2);
+        REQUIRE(counts.move_constructs == 4);
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array batch removal is exception safe",
+        "[nonstd][slot-array][batch]")
+    {
+        SECTION("a throwing predicate still closes every hole")
+        {
+            auto structure = nonstd::slot_array<int64_t, 20>();
+            for (int64_t idx = 0; idx < 20; ++idx)
+                structure.emplace_back<int64_t>(std::move(idx));
+
+            int32_t calls = 0;
+            auto fussy = [&](int64_t value)
+            {
+                if (++calls > 10)
+                    throw std::runtime_error("fussy");
+                return (value % 2) == 0;
+            };
+
+            REQUIRE_THROWS_AS(structure.remove_if(fussy), std::runtime_error);
+            REQUIRE(structure.size() == 15);
+
+            int64_t sum = 0;
+            for (int64_t value : structure)
+                sum += value;
+            REQUIRE(sum == (190 - (0 + 2 + 4 + 6 + 8)));
+        }
+
+        op_counts counts;
+        auto structure = std::make_unique<nonstd::slot_array<throwing_counted, 8>>();
+        auto keys = std::vector<nonstd::versioned_key>();
+        for (int64_t idx = 0; idx < 8; ++idx)
+            keys.push_back(structure->emplace_back<int64_t, op_counts*>(std::move(idx), &counts));
+
+        SECTION("values whose moves may throw are removed one at a time")
+        {
+            REQUIRE(structure->remove_many(keys.data(), 2) == 2);
+            REQUIRE(counts.move_constructs == 0);
+            REQUIRE(counts.move_assigns == 2);
+            REQUIRE(counts.destroys == 2);
+
+            counts.throw_on_move = true;
+            REQUIRE_THROWS_AS(structure->remove_many(keys.data() + 2, 2), std::runtime_error);
+            REQUIRE(structure->size() == 6);
+            for (size_t idx = 2; idx < keys.size(); ++idx)
+                REQUIRE(structure->try_get(keys[idx])->value() == int64_t(idx));
+
+            // Each remaining value is destroyed exactly once
+            structure.reset();
+            REQUIRE(counts.destroys == 8);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array compaction of values whose moves may throw",
+        "[nonstd][slot-array][deferred]")
+    {
+        using structure_type =
+            nonstd::slot_array<throwing_counted, 8, nonstd::versioned_key, deferred_policy>;
+
+        op_counts counts;
+        auto structure = std::make_unique<structure_type>();
+        auto keys = std::vector<nonstd::versioned_key>();
+        for (int64_t idx = 0; idx < 8; ++idx)
+            keys.push_back(structure->emplace_back<int64_t, op_counts*>(std::move(idx), &counts));
+
+        REQUIRE(structure->try_remove(keys[1]));
+        REQUIRE(structure->try_remove(keys[2]));
+        REQUIRE(structure->dead() == 2);
+
+        SECTION("survivors are moved over dead values")
+        {
+            structure->compact();
+            REQUIRE(structure->dead() == 0);
+            REQUIRE(structure->size() == 6);
+            REQUIRE(counts.move_constructs == 0);
+            REQUIRE(counts.move_assigns == 2);
+            REQUIRE(counts.destroys == 2);
+            for (size_t idx : { 0, 3, 4, 5, 6, 7 })
+                REQUIRE(structure->try_get(keys[idx])->value() == int64_t(idx));
+        }
+
+        SECTION("a throwing move leaves the dead values marked")
+        {
+            counts.throw_on_move = true;
+            REQUIRE_THROWS_AS(structure->compact(), std::runtime_error);
+            REQUIRE(structure->dead() == 2);
+            REQUIRE(structure->size() == 6);
+            for (size_t idx : { 0, 3, 4, 5, 6, 7 })
+                REQUIRE(structure->try_get(keys[idx])->value() == int64_t(idx));
+
+            counts.throw_on_move = false;
+            structure->compact();
+            REQUIRE(structure->dead() == 0);
+            structure.reset();
+            REQUIRE(counts.destroys == 8);
+        }
+    }
+
+    inline size_t compaction_index(int64_t value) { return static_cast<size_t>(value); }
+    inline size_t compaction_index(const std::string& value) { return std::stoul(value); }
+
+    template<typename Structure, typename Keys, typename Removed>
+    bool compaction_matches(Structure& structure, const Keys& keys, const Removed& removed)
+    {
+        bool all_match = true;
+        size_t live = 0;
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+        {
+            auto* value = structure.try_get(keys[idx]);
+            all_match &= ((value == nullptr) == removed(idx));
+            if (value != nullptr)
+            {
+                all_match &= (compaction_index(*value) == idx);
+                ++live;
+            }
+        }
+        all_match &= (live == structure.size());
+
+        // Every survivor can still be removed through its key
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+            if (removed(idx) == false)
+                all_match &= structure.try_remove(keys[idx]);
+        return all_match && structure.empty();
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::slot_array parallel compaction",
+        "[nonstd][slot-array][batch][parallel]",
+        int64_t,
+        std::string)
+    {
+        struct as_value
+        {
+            static TestType make(size_t idx)
+            {
+                if constexpr (std::is_same_v<TestType, std::string>)
+                    return std::to_string(idx) + std::string(32, ' ');
+                else
+                    return static_cast<TestType>(idx);
+            }
+        };
+
+        using key_type = nonstd::versioned_key;
+        auto pool = nonstd::thread_pool(3);
+        auto keys = std::vector<key_type>();
+
+        // Drop two in three, with runs of survivors and holes of all sizes
+        auto removed = [](size_t idx) { return ((idx % 3) != 0) || ((idx / 1000) % 5 == 2); };
+
+        SECTION("remove_many")
+        {
+            auto structure = std::make_unique<nonstd::slot_array<TestType, 60000>>();
+            for (size_t idx = 0; idx < 60000; ++idx)
+                keys.push_back(structure->template emplace_back<TestType>(as_value::make(idx)));
+
+            auto doomed = std::vector<key_type>();
+            for (size_t idx = 0; idx < keys.size(); ++idx)
+                if (removed(idx))
+                    doomed.push_back(keys[idx]);
+            REQUIRE(structure->remove_many(doomed.begin(), doomed.end(), pool) == doomed.size());
+            REQUIRE(compaction_matches(*structure, keys, removed));
+        }
+
+        SECTION("remove_if")
+        {
+            auto structure = std::make_unique<nonstd::slot_array<TestType, 60000>>();
+            for (size_t idx = 0; idx < 60000; ++idx)
+                keys.push_back(structure->template emplace_back<TestType>(as_value::make(idx)));
+
+            auto pred = [&](const TestType& value) { return removed(compaction_index(value)); };
+            const size_t count = structure->remove_if(pred, pool);
+            REQUIRE(count == 60000 - structure->size());
+            REQUIRE(compaction_matches(*structure, keys, removed));
+        }
+
+        SECTION("deferred compact")
+        {
+            auto structure = std::make_unique<
+                nonstd::slot_array<TestType, 60000, nonstd::versioned_key, deferred_policy>>();
+            for (size_t idx = 0; idx < 60000; ++idx)
+                keys.push_back(structure->template emplace_back<TestType>(as_value::make(idx)));
+
+            for (size_t idx = 0; idx < keys.size(); ++idx)
+                if (removed(idx))
+                    structure->try_remove(keys[idx]);
+            structure->compact(pool);
+            REQUIRE(structure->dead() == 0);
+            REQUIRE(compaction_matches(*structure, keys, removed));
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array deferred removal",
+        "[nonstd][slot-array][deferred]")
+    {
+        using structure_type = nonstd::slot_array<ref_proxy, 8, nonstd::versioned_key, deferred_policy>;
+        using key_type = typename structure_type::key_type;
+
+        int32_t refcount = 0;
+        {
+            auto structure = structure_type();
+            auto keys = std::vector<key_type>();
+            for (int64_t idx = 0; idx < 8; ++idx)
+                keys.push_back(test_emplace(structure, idx, &refcount));
+
+            // Remove every even value while iterating over the whole range
+            int64_t visited = 0;
+            for (auto& proxy : structure)
+            {
+                REQUIRE(proxy.value() == visited);
+                if ((visited % 2) == 0)
+                    REQUIRE(structure.try_remove(keys[visited]));
+                ++visited;
+            }
+
+            REQUIRE(visited == 8);
+            REQUIRE(structure.size() == 4);
+            REQUIRE(structure.dead() == 4);
+            REQUIRE(structure.stats().size == 4);
+            REQUIRE(refcount == 8);
+            REQUIRE(structure.try_get(keys[0]) == nullptr);
+            REQUIRE(structure.try_remove(keys[0]) == false);
+
+            int64_t sum = 0;
+            structure.for_each([&](const ref_proxy& proxy) { sum += proxy.value(); });
+            REQUIRE(sum == 16);
+
+            SECTION("the dense range can't grow until compacted")
+            {
+                REQUIRE_THROWS_AS(
+                    test_emplace(structure, 0, &refcount),
+                    std::out_of_range);
+                REQUIRE_THROWS_AS(
+                    structure.emplace_n(1, keys.begin(), int64_t(0), &refcount),
+                    std::out_of_range);
+
+                structure.compact();
+                REQUIRE(structure.dead() == 0);
+                REQUIRE(refcount == 4);
+                REQUIRE(std::distance(structure.begin(), structure.end()) == 4);
+                for (int64_t idx = 1; idx < 8; idx += 2)
+                    REQUIRE(structure.try_get(keys[idx])->value() == idx);
+
+                auto reused = test_emplace(structure, 8, &refcount);
+                REQUIRE(structure.try_get(reused)->value() == 8);
+                REQUIRE(structure.try_get(keys[0]) == nullptr);
+            }
+
+            SECTION("batch removal also defers")
+            {
+                REQUIRE(structure.remove_many(keys.begin(), keys.end()) == 4);
+                REQUIRE(structure.empty());
+                REQUIRE(structure.dead() == 8);
+                REQUIRE(refcount == 8);
+                REQUIRE(structure.remove_if([](const ref_proxy&) { return true; }) == 0);
+
+                structure.compact();
+                REQUIRE(refcount == 0);
+                REQUIRE(structure.begin() == structure.end());
+            }
+
+            SECTION("clearing destroys dead values too")
+            {
+                structure.clear();
+                REQUIRE(refcount == 0);
+                REQUIRE(structure.dead() == 0);
+                REQUIRE(structure.stats().size == 0);
+                for (int64_t idx = 0; idx < 8; ++idx)
+                    REQUIRE(test_emplace(structure, idx, &refcount));
+            }
+        }
+        REQUIRE(refcount == 0);
+    }
+
+    TEST_CASE(
+        "nonstd::slot_array batch lookup",
+        "[nonstd][slot-array][batch]")
+    {
+        using structure_type = nonstd::slot_array<int64_t, 100>;
+        using key_type = typename structure_type::key_type;
+
+        auto structure = structure_type();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 100; ++idx)
+            keys.push_back(structure.emplace_back<int64_t>(std::move(idx)));
+        for (size_t idx = 0; idx < 100; idx += 4)
+            REQUIRE(structure.try_remove(keys[idx]));
+
+        // Add keys with indices beyond this structure's capacity
+        auto larger = nonstd::slot_array<int64_t, 200>();
+        for (int64_t idx = 0; idx < 120; ++idx)
+        {
+            auto key = larger.emplace_back<int64_t>(std::move(idx));
+            if (idx >= 100)
+                keys.push_back(key);
+        }
+
+        auto results = std::vector<int64_t*>(keys.size());
+        REQUIRE(structure.get_many(keys.data(), keys.size(), results.data()) == 75);
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+            REQUIRE(results[idx] == structure.try_get(keys[idx]));
+
+        const auto& view = structure;
+        auto const_results = std::vector<const int64_t*>(keys.size());
+        REQUIRE(view.get_many(keys.data(), 10, const_results.data()) == 7);
+        REQUIRE(*const_results[9] == 9);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::slot_array allocation order",
+        "[nonstd][slot-array]",
+        nonstd::default_policy,
+        testing::fifo_policy,
+        testing::lowest_index_policy)
+    {
+        using structure_type = nonstd::slot_array<int64_t, 200, nonstd::versioned_key, TestType>;
+        using key_type = typename structure_type::key_type;
+        using traits = nonstd::key_traits<key_type>;
+
+        auto structure = structure_type();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 10; ++idx)
+            keys.push_back(structure.template emplace_back<int64_t>(std::move(idx)));
+
+        for (size_t idx : { 5, 2, 7 })
+            REQUIRE(structure.try_remove(keys[idx]));
+
+        const auto expected = expected_reuse_order<typename TestType::allocation_type>();
+        for (size_t idx : expected)
+            REQUIRE(traits::index(structure.template emplace_back<int64_t>(0)) == idx);
+        REQUIRE(traits::index(structure.template emplace_back<int64_t>(0)) == 10);
+
+        // Every freed slot comes back, wherever it is in the free list
+        structure.clear();
+        auto seen = std::vector<bool>(11);
+        for (size_t idx = 0; idx < 11; ++idx)
+            seen[traits::index(structure.template emplace_back<int64_t>(0))] = true;
+        REQUIRE(std::count(seen.begin(), seen.end(), true) == 11);
+        REQUIRE(traits::index(structure.template emplace_back<int64_t>(0)) == 11);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::slot_array storage",
+        "[nonstd][slot-array]",
+        testing::heap_policy,
+        testing::mmap_policy,
+        testing::prefaulted_mmap_policy)
+    {
+        using structure_type = nonstd::slot_array<std::string, 1000, nonstd::versioned_key, TestType>;
+        using key_type = typename structure_type::key_type;
+
+        auto structure = std::make_unique<structure_type>();
+        auto keys = std::vector<key_type>();
+        for (size_t idx = 0; idx < 1000; ++idx)
+            keys.push_back(structure->template emplace_back<std::string>(std::to_string(idx)));
+        REQUIRE_THROWS_AS(structure->template emplace_back<std::string>("full"), std::out_of_range);
+
+        for (size_t idx = 0; idx < 1000; idx += 2)
+            REQUIRE(structure->try_remove(keys[idx]));
+        REQUIRE(structure->size() == 500);
+
+        for (size_t idx = 0; idx < 1000; ++idx)
+        {
+            const std::string* value = structure->try_get(keys[idx]);
+            REQUIRE((value != nullptr) == ((idx % 2) == 1));
+            if (value != nullptr)
+                REQUIRE(*value == std::to_string(idx));
+        }
+    }
+}
+
+namespace test_multi_slot_array
+{
+    /// <summary>
+    /// Throws from its constructor when given a negative value.
+    /// </summary>
+    struct picky
+    {
+        explicit picky(int64_t value)
+            : value(value)
+        {
+            if (value < 0)
+                throw std::invalid_argument("picky value");
+        }
+
+        int64_t value;
+    };
+
+    TEST_CASE(
+        "nonstd::multi_slot_array test cases",
+        "[nonstd][multi-slot-array]")
+    {
+        using structure_type = nonstd::multi_slot_array<100, int64_t, ref_proxy, picky>;
+        using key_type = typename structure_type::key_type;
+
+        int32_t refcount = 0;
+        auto structure = std::make_unique<structure_type>();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 100; ++idx)
+            keys.push_back(structure->emplace_back(idx, ref_proxy(idx * 10, &refcount), picky(idx)));
+
+        REQUIRE(structure->size() == 100);
+        REQUIRE(refcount == 100);
+        REQUIRE_THROWS_AS(structure->emplace_back(0, ref_proxy(0, &refcount), picky(0)), std::out_of_range);
+
+        SECTION("every column is reached through one key")
+        {
+            bool all_match = true;
+            for (int64_t idx = 0; idx < 100; ++idx)
+            {
+                all_match &= (*structure->try_get<0>(keys[idx]) == idx);
+                all_match &= (structure->try_get<1>(keys[idx])->value() == idx * 10);
+                all_match &= (structure->try_get<2>(keys[idx])->value == idx);
+            }
+            REQUIRE(all_match);
+        }
+
+        SECTION("removal moves the same row in every column")
+        {
+            for (size_t idx = 0; idx < 100; idx += 3)
+                REQUIRE(structure->try_remove(keys[idx]));
+            REQUIRE(structure->try_remove(keys[0]) == false);
+            REQUIRE(structure->size() == 66);
+            REQUIRE(refcount == 66);
+
+            bool all_match = true;
+            for (size_t idx = 0; idx < 100; ++idx)
+            {
+                const bool live = (idx % 3) != 0;
+                all_match &= (structure->contains(keys[idx]) == live);
+                all_match &= ((structure->try_get<1>(keys[idx]) != nullptr) == live);
+            }
+            REQUIRE(all_match);
+
+            // Rows stay aligned across the dense columns
+            for (size_t row = 0; row < structure->size(); ++row)
+            {
+                const int64_t value = structure->data<0>()[row];
+                all_match &= (structure->data<1>()[row].value() == value * 10);
+                all_match &= (structure->data<2>()[row].value == value);
+            }
+            REQUIRE(all_match);
+
+            int64_t sum = 0;
+            for (auto it = structure->begin<0>(); it != structure->end<0>(); ++it)
+                sum += *it;
+            REQUIRE(sum == (99 * 100 / 2) - (99 * 34 / 2));
+        }
+
+        SECTION("a throwing column leaves no partial row")
+        {
+            REQUIRE(structure->try_remove(keys[50]));
+            REQUIRE(refcount == 99);
+            REQUIRE_THROWS_AS(
+                structure->emplace_back(7, ref_proxy(7, &refcount), -1),
+                std::invalid_argument);
+            REQUIRE(structure->size() == 99);
+            REQUIRE(refcount == 99);
+
+            auto key = structure->emplace_back_with_meta(12, 7, ref_proxy(70, &refcount), 7);
+            REQUIRE(key.meta() == 12);
+            REQUIRE(structure->try_get<1>(key)->value() == 70);
+            REQUIRE(structure->try_get<0>(keys[50]) == nullptr);
+        }
+
+        SECTION("clearing destroys every column")
+        {
+            structure->clear();
+            REQUIRE(structure->empty());
+            REQUIRE(refcount == 0);
+            REQUIRE(structure->contains(keys[10]) == false);
+
+            auto key = structure->emplace_back(1, ref_proxy(1, &refcount), picky(1));
+            REQUIRE(structure->try_get<0>(key) != nullptr);
+        }
+
+        structure.reset();
+        REQUIRE(refcount == 0);
+    }
+
+    TEST_CASE(
+        "nonstd::multi_slot_array removal with a column whose moves may throw",
+        "[nonstd][multi-slot-array]")
+    {
+        using structure_type = nonstd::multi_slot_array<4, int64_t, throwing_counted>;
+
+        op_counts counts;
+        auto structure = std::make_unique<structure_type>();
+        auto first = structure->emplace_back(1, throwing_counted(1, &counts));
+        auto second = structure->emplace_back(2, throwing_counted(2, &counts));
+        auto third = structure->emplace_back(3, throwing_counted(3, &counts));
+        counts = op_counts();
+
+        // The removed value is moved aside until the whole row has moved
+        REQUIRE(structure->try_remove(first));
+        REQUIRE(counts.move_constructs == 1);
+        REQUIRE(counts.move_assigns == 1);
+        REQUIRE(counts.destroys == 2);
+        REQUIRE(*structure->try_get<0>(third) == 3);
+        REQUIRE(structure->try_get<1>(third)->value() == 3);
+
+        SECTION("a throwing move leaves every value constructed")
+        {
+            counts.throw_on_move = true;
+            REQUIRE_THROWS_AS(structure->try_remove(third), std::runtime_error);
+            REQUIRE(structure->size() == 2);
+            REQUIRE(counts.destroys == 2);
+            REQUIRE(structure->try_get<1>(second)->value() == 2);
+
+            // Each remaining value is destroyed exactly once
+            structure.reset();
+            REQUIRE(counts.destroys == 4);
+        }
+    }
+
+    TEST_CASE(
+        "nonstd::multi_slot_array removal is undone when a later column throws",
+        "[nonstd][multi-slot-array]")
+    {
+        using structure_type = nonstd::multi_slot_array<4, throwing_counted, throwing_counted>;
+
+        op_counts counts;
+        op_counts tail_counts;
+        auto structure = std::make_unique<structure_type>();
+        auto first = structure->emplace_back(throwing_counted(1, &counts), throwing_counted(10, &counts));
+        auto second = structure->emplace_back(throwing_counted(2, &counts), throwing_counted(20, &counts));
+        auto third = structure->emplace_back(throwing_counted(3, &counts), throwing_counted(30, &tail_counts));
+
+        // The first column moves, then the second throws moving the last row
+        tail_counts.throw_on_move = true;
+        REQUIRE_THROWS_AS(structure->try_remove(first), std::runtime_error);
+        REQUIRE(structure->size() == 3);
+
+        const std::array<std::pair<decltype(first), int64_t>, 3> rows = {
+            std::make_pair(first, int64_t(1)),
+            std::make_pair(second, int64_t(2)),
+            std::make_pair(third, int64_t(3)) };
+        for (const auto& [key, value] : rows)
+        {
+            REQUIRE(structure->try_get<0>(key) != nullptr);
+            REQUIRE(structure->try_get<0>(key)->value() == value);
+            REQUIRE(structure->try_get<1>(key)->value() == (value * 10));
+        }
+        REQUIRE(structure->try_get<1>(third)->counts() == &tail_counts);
+
+        tail_counts.throw_on_move = false;
+        REQUIRE(structure->try_remove(first));
+        REQUIRE(structure->try_get<0>(first) == nullptr);
+        REQUIRE(structure->try_get<0>(third)->value() == 3);
+        REQUIRE(structure->try_get<1>(third)->value() == 30);
+    }
+}
+
+namespace test_packed_array
+{
+    template<typename TVal>
+    struct test_clear
+    {
+        using val_type = TVal;
+
+        template<typename T>
+        static void clear(T& structure)
+        {
+            structure.clear();
+        }
+    };
+
+    template<typename T>
+    void test_emplace(
+        T& structure,
+        int64_t value,
+        int32_t* dummy)
+    {
+        structure.template emplace_back<int64_t, int32_t*>(
+            std::move(value),
+            std::move(dummy));
+    }
+
+    template<typename T>
+    int64_t test_sum(T& structure)
+    {
+        int64_t sum = 0;
+        for (auto& proxy : structure)
+            sum += proxy.value();
+        return sum;
+    }
+
+    TEMPLATE_PRODUCT_TEST_CASE(
+        "nonstd::packed_array test cases",
+        "[nonstd][packed-array]",
+        (test_clear),
+        (val_t<0>, val_t<1>, val_t<20>, val_t<100>))
+    {
+        constexpr size_t size = TestType::val_type::val;
+        using structure_type = nonstd::packed_array<ref_proxy, size>;
+
+        auto arr = test_range<int64_t, size>();
+        auto refcount = std::array<int32_t, size>();
+
+        /* Do not use a section tag here! */
+        {
+            auto structure = structure_type();
+
+            for (size_t idx = 0; idx < structure.max_size(); ++idx)
+            {
+                test_emplace(structure, arr[idx], &refcount[idx]);
+            }
+
+            SECTION("the structure is filled properly")
+            {
+                REQUIRE(ref_proxy::test_refs(refcount, 1));
+                REQUIRE(structure.size() == size);
+            }
+
+            SECTION("iterating over the structure matches expectations")
+            {
+                int64_t sum_expected = 0;
+                int64_t sum_computed = 0;
+
+                for (auto& val : arr)
+                    sum_expected += val;
+                for (auto& val : structure)
+                    sum_computed += val.value();
+
+                REQUIRE(sum_expected == sum_computed);
+            }
+
+            SECTION("the structure throws if added to")
+            {
+                int32_t dummy = 0;
+                REQUIRE_THROWS_AS(
+                    test_emplace(structure, 0, &dummy),
+                    std::out_of_range);
+            }
+
+            SECTION("clearing works correctly")
+            {
+                TestType::clear(structure);
+
+                REQUIRE(structure.size() == 0);
+                REQUIRE(ref_proxy::test_refs(refcount, 0));
+
+                if constexpr (size > 0)
+                {
+                    SECTION("adding a new element is successful")
+                    {
+                        int32_t dummy = 0;
+                        test_emplace(structure, 0, &dummy);
+                        REQUIRE(structure.size() == 1);
+                    }
+                }
+
+                SECTION("repopulating after a clear works correctly")
+                {
+                    int64_t offset = static_cast<int64_t>(size);
+
+                    for (size_t idx = 0; idx < structure.max_size(); ++idx)
+                    {
+                        auto val = arr[idx] + offset;
+                        test_emplace(structure, val, &refcount[idx]);
+                    }
+
+                    REQUIRE(ref_proxy::test_refs(refcount, 1));
+                    REQUIRE(structure.size() == size);
+
+                    SECTION("iterating the structure matches expectations")
+                    {
+                        int64_t sum_expected = 0;
+                        int64_t sum_computed = 0;
+
+                        for (auto& val : arr)
+                            sum_expected += val + offset;
+                        for (auto& val : structure)
+                            sum_computed += val.value();
+
+                        REQUIRE(sum_expected == sum_computed);
+                    }
+
+                    SECTION("the structure throws if added to")
+                    {
+                        int32_t dummy = 0;
+                        REQUIRE_THROWS_AS(
+                            test_emplace(structure, 0, &dummy),
+                            std::out_of_range);
+                    }
+                }
+            }
+        }
+
+        REQUIRE(ref_proxy::test_refs(refcount, 0));
+    }
+
+    TEST_CASE(
+        "nonstd::packed_array batch emplacement",
+        "[nonstd][packed-array][batch]")
+    {
+        auto structure = nonstd::packed_array<int64_t, 8>();
+        auto keys = std::vector<size_t>();
+
+        structure.emplace_n(3, std::back_inserter(keys), int64_t(5));
+        auto values = test_range<int64_t, 4>(10);
+        structure.emplace_range(values.begin(), values.end(), std::back_inserter(keys));
+
+        REQUIRE(structure.size() == 7);
+        REQUIRE(keys == std::vector<size_t>{ 0, 1, 2, 3, 4, 5, 6 });
+        REQUIRE(structure[2] == 5);
+        REQUIRE(structure[6] == 13);
+
+        REQUIRE_THROWS_AS(
+            structure.emplace_n(2, std::back_inserter(keys), int64_t(0)),
+            std::out_of_range);
+        REQUIRE_THROWS_AS(
+            structure.emplace_range(values.begin(), values.end(), std::back_inserter(keys)),
+            std::out_of_range);
+        REQUIRE(structure.size() == 7);
+        REQUIRE(keys.size() == 7);
+    }
+}
+
+namespace test_parallel
+{
+    TEMPLATE_TEST_CASE(
+        "nonstd::parallel_for_each visits every value once",
+        "[nonstd][parallel]",
+        (nonstd::slot_array<int64_t, 10000>),
+        (nonstd::packed_array<int64_t, 10000>))
+    {
+        auto structure = std::make_unique<TestType>();
+        for (int64_t idx = 0; idx < 9999; ++idx)
+            structure->template emplace_back<int64_t>(std::move(idx));
+
+        auto pool = nonstd::thread_pool(3);
+        REQUIRE(pool.workers() == 3);
+
+        for (size_t grain : { 1, 64, 1000, 20000 })
+        {
+            nonstd::parallel_for_each(*structure, [](int64_t& value) { value += 1; }, grain, pool);
+
+            bool all_match = true;
+            int64_t expected = 1;
+            for (int64_t value : *structure)
+                all_match &= (value == expected++);
+            REQUIRE(all_match);
+
+            nonstd::parallel_for_each(*structure, [](int64_t& value) { value -= 1; }, grain, pool);
+        }
+
+        auto sum = std::atomic<int64_t>(0);
+        nonstd::parallel_for_each(*structure, [&](const int64_t& value) { sum += value; });
+        REQUIRE(sum == (9998 * 9999) / 2);
+    }
+
+    TEST_CASE(
+        "nonstd::parallel_for_each edge cases",
+        "[nonstd][parallel]")
+    {
+        auto pool = nonstd::thread_pool(2);
+        auto structure = std::make_unique<nonstd::slot_array<int64_t, 1000, nonstd::versioned_key, deferred_policy>>();
+
+        SECTION("an empty range does nothing")
+        {
+            size_t calls = 0;
+            nonstd::parallel_for_each(*structure, [&](int64_t&) { ++calls; }, 16, pool);
+            REQUIRE(calls == 0);
+        }
+
+        auto keys = std::vector<nonstd::versioned_key>();
+        for (int64_t idx = 0; idx < 1000; ++idx)
+            keys.push_back(structure->emplace_back<int64_t>(std::move(idx)));
+
+        SECTION("the first exception thrown is rethrown")
+        {
+            REQUIRE_THROWS_AS(
+                nonstd::parallel_for_each(*structure,
+                    [](int64_t& value)
+                    {
+                        if (value == 500)
+                            throw std::runtime_error("value");
+                    }, 10, pool),
+                std::runtime_error);
+
+            // The pool is still usable afterwards
+            auto count = std::atomic<size_t>(0);
+            nonstd::parallel_for_each(*structure, [&](int64_t&) { ++count; }, 10, pool);
+            REQUIRE(count == 1000);
+        }
+
+        SECTION("nested loops run inline")
+        {
+            auto count = std::atomic<size_t>(0);
+            nonstd::parallel_for_each(*structure,
+                [&](int64_t& value)
+                {
+                    if (value % 100 == 0)
+                        nonstd::parallel_for_each(*structure, [&](int64_t&) { ++count; }, 10, pool);
+                }, 10, pool);
+            REQUIRE(count == 10 * 1000);
+        }
+
+        SECTION("dead values must be compacted first")
+        {
+            REQUIRE(structure->try_remove(keys[3]));
+            REQUIRE_THROWS_AS(
+                nonstd::parallel_for_each(*structure, [](int64_t&) {}, 10, pool),
+                std::logic_error);
+
+            structure->compact();
+            auto count = std::atomic<size_t>(0);
+            nonstd::parallel_for_each(*structure, [&](int64_t&) { ++count; }, 10, pool);
+            REQUIRE(count == 999);
+        }
+    }
+}
+
+namespace test_shared_segment
+{
+    struct position
+    {
+        int64_t x;
+        int64_t y;
+    };
+
+    inline std::string segment_name(const char* test)
+    {
+        return "/nonstd_test_" + std::string(test) + "_" + std::to_string(::getpid());
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::shared_segment shares a container across mappings",
+        "[nonstd][shared-segment]",
+        (nonstd::slot_array<position, 1000>),
+        (nonstd::keyed_array<position, 1000>))
+    {
+        using segment_type = nonstd::shared_segment<TestType>;
+        using key_type = typename TestType::key_type;
+
+        const std::string name = segment_name("share");
+        segment_type::remove(name);
+        auto writer = segment_type::create(name);
+        REQUIRE(writer.writable());
+        REQUIRE_THROWS_AS(segment_type::create(name), std::system_error);
+
+        auto keys = std::vector<key_type>();
+        writer.write(
+            [&](TestType& structure)
+            {
+                for (int64_t idx = 0; idx < 100; ++idx)
+                    keys.push_back(structure.template emplace_back<position>(position{ idx, -idx }));
+            });
+
+        // The reader maps the same segment at a different address
+        auto reader = segment_type::open(name);
+        REQUIRE_FALSE(reader.writable());
+        REQUIRE(reader.version() == 1);
+
+        for (int64_t idx = 0; idx < 100; ++idx)
+        {
+            const position found = reader.read(
+                [&](const TestType& structure)
+                {
+                    const position* value = structure.try_get(keys[idx]);
+                    return (value != nullptr) ? *value : position{ -1, -1 };
+                });
+            REQUIRE(found.x == idx);
+            REQUIRE(found.y == -idx);
+        }
+
+        writer.write([&](TestType& structure) { return structure.try_remove(keys[42]); });
+        REQUIRE(reader.version() == 2);
+        REQUIRE(reader.read([&](const TestType& structure) { return structure.try_get(keys[42]) == nullptr; }));
+        REQUIRE(reader.read([&](const TestType& structure) { return structure.size(); }) == 99);
+        REQUIRE_THROWS_AS(reader.write([](TestType&) {}), std::logic_error);
+    }
+
+    TEST_CASE(
+        "nonstd::shared_segment reads give up on an unfinished write",
+        "[nonstd][shared-segment]")
+    {
+        using structure_type = nonstd::slot_array<position, 1000>;
+        using segment_type = nonstd::shared_segment<structure_type>;
+
+        const std::string name = segment_name("timeout");
+        segment_type::remove(name);
+        auto writer = segment_type::create(name);
+        auto reader = segment_type::open(name);
+
+        // A write that never finishes looks the same to the reader as one
+        // whose writer died partway through
+        writer.write(
+            [&](structure_type&)
+            {
+                REQUIRE_THROWS_AS(
+                    reader.read(
+                        [](const structure_type& structure) { return structure.size(); },
+                        std::chrono::milliseconds(20)),
+                    std::system_error);
+            });
+
+        REQUIRE(reader.read([](const structure_type& structure) { return structure.size(); }) == 0);
+    }
+
+    TEST_CASE(
+        "nonstd::shared_segment refuses bad segments",
+        "[nonstd][shared-segment]")
+    {
+        using segment_type = nonstd::shared_segment<nonstd::slot_array<position, 1000>>;
+        using other_type = nonstd::shared_segment<nonstd::slot_array<position, 999>>;
+
+        const std::string name = segment_name("refuse");
+        segment_type::remove(name);
+        REQUIRE_THROWS_AS(segment_type::open(name), std::system_error);
+
+        {
+            auto writer = segment_type::create(name);
+            REQUIRE_THROWS_AS(other_type::open(name), std::runtime_error);
+        }
+
+        // The writer removed the segment when it was destroyed
+        REQUIRE_THROWS_AS(segment_type::open(name), std::system_error);
+        REQUIRE_FALSE(segment_type::remove(name));
+    }
+
+    TEST_CASE(
+        "nonstd::shared_segment reads are never torn",
+        "[nonstd][shared-segment]")
+    {
+        using structure_type = nonstd::slot_array<position, 16>;
+        using segment_type = nonstd::shared_segment<structure_type>;
+
+        const std::string name = segment_name("torn");
+        segment_type::remove(name);
+        auto writer = segment_type::create(name);
+        const auto key = writer.write(
+            [](structure_type& structure) { return structure.emplace_back<position>(position{ 0, 0 }); });
+        auto reader = segment_type::open(name);
+
+        auto done = std::atomic<bool>(false);
+        auto thread = std::thread(
+            [&]
+            {
+                for (int64_t idx = 1; idx <= 20000; ++idx)
+                {
+                    writer.write(
+                        [&](structure_type& structure)
+                        {
+                            position* value = structure.try_get(key);
+                            value->x = idx;
+                            value->y = idx;
+                        });
+                }
+                done = true;
+            });
+
+        bool all_match = true;
+        while (done == false)
+        {
+            const position found = reader.read(
+                [&](const structure_type& structure) { return *structure.try_get(key); });
+            all_match &= (found.x == found.y);
+        }
+        thread.join();
+
+        REQUIRE(all_match);
+        REQUIRE(reader.version() == 20001);
+    }
+}
+
+namespace test_snapshot
+{
+    /// <summary>
+    /// A temporary file, removed again when this goes out of scope.
+    /// </summary>
+    struct temp_file
+    {
+        temp_file()
+            : path("/tmp/nonstd_snapshot_XXXXXX")
+        {
+            fd = ::mkstemp(path.data());
+            REQUIRE(fd >= 0);
+        }
+
+        ~temp_file()
+        {
+            ::close(fd);
+            ::unlink(path.c_str());
+        }
+
+        void rewind() { REQUIRE(::lseek(fd, 0, SEEK_SET) == 0); }
+
+        std::string path;
+        int         fd;
+    };
+
+    TEMPLATE_TEST_CASE(
+        "nonstd snapshots restore keyed containers",
+        "[nonstd][snapshot]",
+        (nonstd::slot_array<int64_t, 1000>),
+        (nonstd::keyed_array<int64_t, 1000>),
+        (nonstd::slot_array<int64_t, 1000, nonstd::versioned_key, deferred_policy>),
+        (nonstd::keyed_array<int64_t, 1000, nonstd::wide_versioned_key, lowest_index_policy>))
+    {
+        using key_type = typename TestType::key_type;
+
+        auto structure = std::make_unique<TestType>();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 900; ++idx)
+            keys.push_back(structure->template emplace_back<int64_t>(std::move(idx)));
+        for (size_t idx = 0; idx < 900; idx += 3)
+            REQUIRE(structure->try_remove(keys[idx]));
+
+        auto file = temp_file();
+        nonstd::save_snapshot(file.fd, *structure);
+
+        auto matches = [&](const TestType& restored)
+        {
+            bool all_match = (restored.size() == structure->size());
+            for (size_t idx = 0; idx < keys.size(); ++idx)
+            {
+                const int64_t* value = restored.try_get(keys[idx]);
+                if ((idx % 3) == 0)
+                    all_match &= (value == nullptr);
+                else
+                    all_match &= ((value != nullptr) && (*value == int64_t(idx)));
+            }
+            return all_match;
+        };
+
+        SECTION("loading restores every key")
+        {
+            auto restored = std::make_unique<TestType>();
+            restored->template emplace_back<int64_t>(-1);
+
+            file.rewind();
+            nonstd::load_snapshot(file.fd, *restored);
+            REQUIRE(matches(*restored));
+
+            // The restored free list hands out the same slots as the original
+            const key_type original = structure->template emplace_back<int64_t>(5);
+            const key_type copy = restored->template emplace_back<int64_t>(5);
+            REQUIRE(original == copy);
+        }
+
+        SECTION("a mapped view resolves every key")
+        {
+            auto view = nonstd::view_snapshot<TestType>(file.path);
+            REQUIRE(matches(*view));
+        }
+    }
+
+    TEST_CASE(
+        "nonstd snapshots restore packed_array",
+        "[nonstd][snapshot]")
+    {
+        auto structure = std::make_unique<nonstd::packed_array<int64_t, 500>>();
+        for (int64_t idx = 0; idx < 300; ++idx)
+            structure->emplace_back(std::move(idx));
+
+        auto file = temp_file();
+        nonstd::save_snapshot(file.fd, *structure);
+        file.rewind();
+
+        auto restored = std::make_unique<nonstd::packed_array<int64_t, 500>>();
+        nonstd::load_snapshot(file.fd, *restored);
+        REQUIRE(restored->size() == 300);
+        REQUIRE(std::equal(structure->begin(), structure->end(), restored->begin(), restored->end()));
+
+        auto view = nonstd::view_snapshot<nonstd::packed_array<int64_t, 500>>(file.path);
+        REQUIRE(std::equal(structure->begin(), structure->end(), view->begin(), view->end()));
+    }
+
+    TEST_CASE(
+        "nonstd snapshots refuse bad files",
+        "[nonstd][snapshot]")
+    {
+        using structure_type = nonstd::slot_array<int64_t, 100>;
+
+        auto structure = std::make_unique<structure_type>();
+        const auto key = structure->emplace_back<int64_t>(7);
+
+        auto file = temp_file();
+        nonstd::save_snapshot(file.fd, *structure);
+
+        SECTION("another container type is refused")
+        {
+            file.rewind();
+            auto other = std::make_unique<nonstd::slot_array<int32_t, 100>>();
+            REQUIRE_THROWS_AS(nonstd::load_snapshot(file.fd, *other), std::runtime_error);
+            REQUIRE_THROWS_AS(
+                (nonstd::view_snapshot<nonstd::keyed_array<int64_t, 100>>(file.path)),
+                std::runtime_error);
+        }
+
+        SECTION("the same layout under another policy is refused")
+        {
+            using fifo_type = nonstd::slot_array<int64_t, 100, nonstd::versioned_key, fifo_policy>;
+            static_assert(sizeof(fifo_type) == sizeof(structure_type), "layouts differ");
+
+            file.rewind();
+            auto other = std::make_unique<fifo_type>();
+            REQUIRE_THROWS_AS(nonstd::load_snapshot(file.fd, *other), std::runtime_error);
+            REQUIRE_THROWS_AS(nonstd::view_snapshot<fifo_type>(file.path), std::runtime_error);
+        }
+
+        SECTION("a truncated file leaves the container empty")
+        {
+            REQUIRE(::ftruncate(file.fd, 200) == 0);
+            file.rewind();
+
+            auto restored = std::make_unique<structure_type>();
+            restored->emplace_back<int64_t>(1);
+            REQUIRE_THROWS_AS(nonstd::load_snapshot(file.fd, *restored), std::runtime_error);
+            REQUIRE(restored->size() == 0);
+            REQUIRE(restored->try_get(key) == nullptr);
+            REQUIRE_THROWS_AS(nonstd::view_snapshot<structure_type>(file.path), std::runtime_error);
+        }
+
+        SECTION("a missing file is refused")
+        {
+            REQUIRE_THROWS_AS(
+                nonstd::view_snapshot<structure_type>("/tmp/nonstd_snapshot_missing"),
+                std::system_error);
+        }
+    }
+
+    inline size_t file_size(int fd)
+    {
+        return static_cast<size_t>(::lseek(fd, 0, SEEK_END));
+    }
+
+    inline std::vector<unsigned char> file_bytes(int fd)
+    {
+        auto bytes = std::vector<unsigned char>(file_size(fd));
+        REQUIRE(::pread(fd, bytes.data(), bytes.size(), 0) == ssize_t(bytes.size()));
+        return bytes;
+    }
+
+    template<typename Container>
+    void fill_and_thin(Container& structure)
+    {
+        auto keys = std::vector<typename Container::key_type>();
+        for (int64_t idx = 0; idx < 20; ++idx)
+            keys.push_back(structure.template emplace_back<int64_t>(std::move(idx)));
+        for (size_t idx = 0; idx < 20; idx += 4)
+            REQUIRE(structure.try_remove(keys[idx]));
+    }
+
+    template<typename T, size_t N>
+    void fill_and_thin(nonstd::packed_array<T, N>& structure)
+    {
+        for (int64_t idx = 0; idx < 20; ++idx)
+            structure.emplace_back(std::move(idx));
+        for (int64_t idx = 0; idx < 5; ++idx)
+            structure.pop_back();
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd snapshots leave out bytes the container never set",
+        "[nonstd][snapshot]",
+        (nonstd::slot_array<int64_t, 1000>),
+        (nonstd::keyed_array<int64_t, 1000>),
+        (nonstd::keyed_array<int64_t, 1000, nonstd::versioned_key, lowest_index_policy>),
+        (nonstd::packed_array<int64_t, 1000>))
+    {
+        // Build the same contents in memory that starts out as zeros and
+        // as garbage; the two snapshots must not tell them apart
+        auto build = [](unsigned char fill)
+        {
+            auto memory = std::make_unique<std::aligned_storage_t<sizeof(TestType), alignof(TestType)>>();
+            // Volatile, or the compiler drops these stores as dead once
+            // the container's lifetime begins
+            auto* bytes = reinterpret_cast<volatile unsigned char*>(memory.get());
+            for (size_t idx = 0; idx < sizeof(TestType); ++idx)
+                bytes[idx] = fill;
+
+            TestType* structure = new (memory.get()) TestType();
+            fill_and_thin(*structure);
+
+            auto file = std::make_unique<temp_file>();
+            nonstd::save_snapshot(file->fd, *structure);
+            structure->~TestType();
+            return file;
+        };
+
+        auto zeroed = build(0x00);
+        auto dirty = build(0xAB);
+        REQUIRE(file_size(dirty->fd) == (nonstd::detail::snapshot_data_offset<TestType>() + sizeof(TestType)));
+        REQUIRE(file_bytes(zeroed->fd) == file_bytes(dirty->fd));
+
+        auto view = nonstd::view_snapshot<TestType>(dirty->path);
+        REQUIRE(view->size() == 15);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd delta snapshots keep a replica in step",
+        "[nonstd][snapshot][delta]",
+        testing::tracking_policy,
+        testing::fifo_tracking_policy,
+        testing::lowest_index_tracking_policy)
+    {
+        using structure_type = nonstd::keyed_array<int64_t, 5000, nonstd::versioned_key, TestType>;
+        using key_type = typename structure_type::key_type;
+
+        auto source = std::make_unique<structure_type>();
+        auto replica = std::make_unique<structure_type>();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 3000; ++idx)
+            keys.push_back(source->template emplace_back<int64_t>(std::move(idx)));
+
+        // Start a checkpoint, so that the first delta holds only later changes
+        source->write_delta([](const void*, size_t) {});
+        auto snapshot = temp_file();
+        nonstd::save_snapshot(snapshot.fd, *source);
+        snapshot.rewind();
+        nonstd::load_snapshot(snapshot.fd, *replica);
+        REQUIRE(replica->checkpoint() == 1);
+
+        uint32_t state = 777;
+        auto next = [&] { return (state = (state * 1103515245u) + 12345u) >> 8; };
+
+        for (uint64_t round = 1; round <= 6; ++round)
+        {
+            if (round == 4)
+                source->clear();
+
+            for (size_t op = 0; op < 50; ++op)
+            {
+                const key_type key = keys[next() % keys.size()];
+                switch (next() % 3)
+                {
+                case 0:
+                    keys.push_back(source->template emplace_back<int64_t>(int64_t(next())));
+                    break;
+                case 1:
+                    source->try_remove(key);
+                    break;
+                default:
+                    if (int64_t* value = source->try_get(key))
                     {
-                        auto val = arr[idx] + offset;
-                        test_emplace(structure, val, &refcount[idx]);
+                        *value = -*value;
+                        REQUIRE(source->mark_dirty(key));
                     }
+                    break;
+                }
+            }
 
-                    REQUIRE(ref_proxy::test_refs(refcount, 1));
-                    REQUIRE(structure.size() == size);
+            auto delta = temp_file();
+            nonstd::write_delta(delta.fd, *source);
+            if (round != 4)
+                REQUIRE(file_size(delta.fd) < (file_size(snapshot.fd) / 10));
+            delta.rewind();
+            nonstd::apply_delta(delta.fd, *replica);
+            REQUIRE(source->checkpoint() == round + 1);
+            REQUIRE(replica->checkpoint() == round + 1);
+
+            bool all_match = (source->size() == replica->size());
+            for (const key_type& key : keys)
+            {
+                const int64_t* expected = source->try_get(key);
+                const int64_t* found = replica->try_get(key);
+                all_match &= ((expected == nullptr) == (found == nullptr));
+                all_match &= ((expected == nullptr) || (*expected == *found));
+            }
+            REQUIRE(all_match);
+        }
 
-                    SECTION("iterating the structure matches expectations")
-                    {
-                        int64_t sum_expected = 0;
-                        int64_t sum_computed = 0;
+        // Both hand out the same slots from here on
+        for (int64_t idx = 0; idx < 100; ++idx)
+            REQUIRE(source->template emplace_back<int64_t>(0) == replica->template emplace_back<int64_t>(0));
+    }
 
-                        for (auto& val : arr)
-                            sum_expected += val + offset;
-                        for (auto& val : structure)
-                            sum_computed += val.value();
+    TEST_CASE(
+        "nonstd delta snapshots refuse the wrong checkpoint",
+        "[nonstd][snapshot][delta]")
+    {
+        using structure_type = nonstd::keyed_array<int64_t, 100, nonstd::versioned_key, tracking_policy>;
+
+        auto source = std::make_unique<structure_type>();
+        auto replica = std::make_unique<structure_type>();
+        const auto key = source->emplace_back<int64_t>(5);
+
+        auto first = temp_file();
+        nonstd::write_delta(first.fd, *source);
+        auto second = temp_file();
+        REQUIRE(source->try_remove(key));
+        nonstd::write_delta(second.fd, *source);
+
+        // The second delta can't skip the first
+        second.rewind();
+        REQUIRE_THROWS_AS(nonstd::apply_delta(second.fd, *replica), std::runtime_error);
+        REQUIRE(replica->checkpoint() == 0);
+
+        first.rewind();
+        nonstd::apply_delta(first.fd, *replica);
+        REQUIRE(*replica->try_get(key) == 5);
+
+        // Nor can the first be applied twice
+        first.rewind();
+        REQUIRE_THROWS_AS(nonstd::apply_delta(first.fd, *replica), std::runtime_error);
+
+        second.rewind();
+        nonstd::apply_delta(second.fd, *replica);
+        REQUIRE(replica->try_get(key) == nullptr);
+        REQUIRE(replica->size() == 0);
+
+        auto other = std::make_unique<nonstd::keyed_array<int32_t, 100, nonstd::versioned_key, tracking_policy>>();
+        first.rewind();
+        REQUIRE_THROWS_AS(nonstd::apply_delta(first.fd, *other), std::runtime_error);
+    }
 
-                        REQUIRE(sum_expected == sum_computed);
-                    }
+    TEST_CASE(
+        "nonstd delta snapshots refuse out-of-range fields before changing anything",
+        "[nonstd][snapshot][delta]")
+    {
+        using structure_type = nonstd::keyed_array<int64_t, 1000, nonstd::versioned_key, tracking_policy>;
+
+        auto source = std::make_unique<structure_type>();
+        auto replica = std::make_unique<structure_type>();
+        const auto first = source->emplace_back<int64_t>(10);
+        const auto second = source->emplace_back<int64_t>(20);
+        const auto third = source->emplace_back<int64_t>(30);
+        REQUIRE(source->try_remove(second));
+
+        std::vector<unsigned char> delta;
+        source->write_delta(
+            [&](const void* data, size_t bytes)
+            {
+                const unsigned char* first = static_cast<const unsigned char*>(data);
+                delta.insert(delta.end(), first, first + bytes);
+            });
 
-                    SECTION("the structure throws if added to")
+        auto apply = [&](const std::vector<unsigned char>& bytes)
+        {
+            size_t offset = 0;
+            replica->apply_delta(
+                [&](void* data, size_t count)
+                {
+                    if (count > (bytes.size() - offset))
+                        throw std::runtime_error("delta is truncated");
+                    std::memcpy(data, bytes.data() + offset, count);
+                    offset += count;
+                });
+        };
+
+        // Five counters, the free list head, then slot 0's record word,
+        // dirty bits and occupancy, then each slot's version, link and value
+        auto patched = [&](size_t offset, auto value)
+        {
+            std::vector<unsigned char> bytes = delta;
+            std::memcpy(bytes.data() + offset, &value, sizeof(value));
+            return bytes;
+        };
+
+        const size_t high_water = 3 * sizeof(uint64_t);
+        const size_t free_head = 5 * sizeof(uint64_t);
+        const size_t record = free_head + sizeof(uint16_t);
+        const size_t second_link = record + (3 * sizeof(uint64_t)) + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(int64_t) + sizeof(uint32_t);
+
+        REQUIRE_THROWS_AS(apply(patched(high_water, uint64_t(1001))), std::runtime_error);
+        REQUIRE_THROWS_AS(apply(patched(free_head, uint16_t(50))), std::runtime_error);
+        REQUIRE_THROWS_AS(apply(patched(record, uint64_t(5))), std::runtime_error);
+        REQUIRE_THROWS_AS(apply(patched(second_link, uint16_t(40))), std::runtime_error);
+        REQUIRE_THROWS_AS(apply(std::vector<unsigned char>(delta.begin(), delta.end() - 1)), std::runtime_error);
+
+        REQUIRE(replica->checkpoint() == 0);
+        REQUIRE(replica->size() == 0);
+        REQUIRE(replica->try_get(first) == nullptr);
+
+        apply(delta);
+        REQUIRE(replica->checkpoint() == 1);
+        REQUIRE(replica->size() == 2);
+        REQUIRE(*replica->try_get(first) == 10);
+        REQUIRE(replica->try_get(second) == nullptr);
+        REQUIRE(*replica->try_get(third) == 30);
+        REQUIRE(replica->emplace_back<int64_t>(0) == source->emplace_back<int64_t>(0));
+    }
+}
+
+namespace test_journal
+{
+    int64_t journaled_value(uint64_t version, uint32_t index)
+    {
+        return int64_t(index) * 1000 + int64_t(version);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd journals replay onto a follower with identical keys",
+        "[nonstd][journal]",
+        (nonstd::slot_array<int64_t, 500, nonstd::versioned_key, journal_policy>),
+        (nonstd::slot_array<int64_t, 500, nonstd::versioned_key, deferred_journal_policy>),
+        (nonstd::keyed_array<int64_t, 500, nonstd::versioned_key, journal_policy>),
+        (nonstd::keyed_array<int64_t, 500, nonstd::wide_versioned_key, lowest_index_journal_policy>))
+    {
+        using key_type = typename TestType::key_type;
+        using traits   = nonstd::key_traits<key_type>;
+        constexpr bool batches = nonstd::detail::has_compact<TestType>::value;
+
+        auto leader_records = std::vector<nonstd::journal_record>(1024);
+        auto follower_records = std::vector<nonstd::journal_record>(1024);
+        auto leader_journal = nonstd::op_journal(leader_records.data(), leader_records.size());
+        auto follower_journal = nonstd::op_journal(follower_records.data(), follower_records.size());
+
+        auto leader = std::make_unique<TestType>();
+        auto follower = std::make_unique<TestType>();
+        leader->attach_journal(&leader_journal);
+        REQUIRE(leader->journal() == &leader_journal);
+
+        auto make_value = [](const nonstd::journal_record& record)
+        {
+            return journaled_value(record.version, record.index);
+        };
+
+        auto rng = std::mt19937(1234);
+        auto live = std::vector<key_type>();
+        auto gone = std::vector<key_type>();
+
+        for (int round = 0; round < 40; ++round)
+        {
+            for (int op = 0; op < 100; ++op)
+            {
+                const uint32_t roll = rng() % 100;
+                if ((roll < 55) && (live.size() < 250))
+                {
+                    const key_type key = leader->template emplace_back<int64_t>(0);
+                    *leader->try_get(key) = journaled_value(traits::version(key), traits::index(key));
+                    live.push_back(key);
+                }
+                else if ((roll < 97) && (live.empty() == false))
+                {
+                    const size_t pick = rng() % live.size();
+                    REQUIRE(leader->try_remove(live[pick]));
+                    gone.push_back(live[pick]);
+                    live.erase(live.begin() + pick);
+                }
+                else if (roll < 99)
+                {
+                    if constexpr (batches)
                     {
-                        int32_t dummy = 0;
-                        REQUIRE_THROWS_AS(
-                            test_emplace(structure, 0, &dummy),
-                            std::out_of_range);
+                        // Removes a run of keys in one pass, out of dense order
+                        const size_t count = std::min<size_t>(live.size(), 8);
+                        REQUIRE(leader->remove_many(live.data(), count) == count);
+                        gone.insert(gone.end(), live.begin(), live.begin() + count);
+                        live.erase(live.begin(), live.begin() + count);
                     }
                 }
+                else
+                {
+                    leader->clear();
+                    gone.insert(gone.end(), live.begin(), live.end());
+                    live.clear();
+                }
+            }
+
+            if constexpr (batches)
+                leader->compact();
+
+            // Ship the records across, as a transport would
+            auto shipped = std::vector<nonstd::journal_record>(leader_journal.size());
+            REQUIRE(leader_journal.read(shipped.data(), shipped.size()) == shipped.size());
+            REQUIRE(leader_journal.empty());
+            follower_journal.write(shipped.data(), shipped.size());
+
+            REQUIRE(nonstd::replay(follower_journal, *follower, make_value) == shipped.size());
+            REQUIRE(follower_journal.empty());
+            REQUIRE(follower->size() == leader->size());
+
+            bool all_match = true;
+            for (const key_type& key : live)
+            {
+                const int64_t* value = follower->try_get(key);
+                all_match &= (value != nullptr) && (*value == *leader->try_get(key));
             }
+            for (const key_type& key : gone)
+                all_match &= (follower->try_get(key) == nullptr);
+            REQUIRE(all_match);
         }
 
-        REQUIRE(ref_proxy::test_refs(refcount, 0));
+        // Both free lists hand out the same slots from here on
+        for (int idx = 0; idx < 20; ++idx)
+            REQUIRE(leader->template emplace_back<int64_t>(idx) == follower->template emplace_back<int64_t>(idx));
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd journals replay a keyed_array clear with matching keys after it",
+        "[nonstd][journal]",
+        (nonstd::keyed_array<int64_t, 100, nonstd::versioned_key, journal_policy>),
+        (nonstd::keyed_array<int64_t, 100, nonstd::wide_versioned_key, lowest_index_journal_policy>))
+    {
+        using key_type = typename TestType::key_type;
+        using traits   = nonstd::key_traits<key_type>;
+
+        auto records = std::vector<nonstd::journal_record>(256);
+        auto journal = nonstd::op_journal(records.data(), records.size());
+        auto leader = std::make_unique<TestType>();
+        auto follower = std::make_unique<TestType>();
+        leader->attach_journal(&journal);
+
+        auto make_value = [](const nonstd::journal_record& record)
+        {
+            return journaled_value(record.version, record.index);
+        };
+        auto emplace = [&]
+        {
+            const key_type key = leader->template emplace_back<int64_t>(0);
+            *leader->try_get(key) = journaled_value(traits::version(key), traits::index(key));
+            return key;
+        };
+
+        auto before = std::vector<key_type>();
+        for (int idx = 0; idx < 40; ++idx)
+            before.push_back(emplace());
+        REQUIRE(leader->try_remove(before[3]));
+        REQUIRE(leader->try_remove(before[17]));
+        leader->clear();
+
+        auto after = std::vector<key_type>();
+        for (int idx = 0; idx < 30; ++idx)
+            after.push_back(emplace());
+
+        SECTION("a follower in step issues the same keys")
+        {
+            REQUIRE(nonstd::replay(journal, *follower, make_value) > 0);
+            REQUIRE(follower->size() == leader->size());
+
+            bool all_match = true;
+            for (const key_type& key : before)
+                all_match &= (follower->try_get(key) == nullptr);
+            for (const key_type& key : after)
+            {
+                const int64_t* value = follower->try_get(key);
+                all_match &= (value != nullptr) && (*value == *leader->try_get(key));
+            }
+            REQUIRE(all_match);
+
+            for (int idx = 0; idx < 20; ++idx)
+                REQUIRE(leader->template emplace_back<int64_t>(idx) == follower->template emplace_back<int64_t>(idx));
+        }
+
+        SECTION("a follower missing a cleared value is detected")
+        {
+            // Replay up to the clear, then lose a value the clear removes
+            auto head = std::vector<nonstd::journal_record>(42);
+            REQUIRE(journal.read(head.data(), head.size()) == head.size());
+            auto shipped = head;
+            auto head_journal = nonstd::op_journal(shipped.data(), shipped.size());
+            head_journal.write(head.data(), head.size());
+            REQUIRE(nonstd::replay(head_journal, *follower, make_value) == head.size());
+
+            REQUIRE(follower->try_remove(before[20]));
+            REQUIRE_THROWS_AS(nonstd::replay(journal, *follower, make_value), std::logic_error);
+        }
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd journals stay in step when a constructor throws",
+        "[nonstd][journal]",
+        (nonstd::slot_array<picky_value, 100, nonstd::versioned_key, journal_policy>),
+        (nonstd::keyed_array<picky_value, 100, nonstd::versioned_key, journal_policy>))
+    {
+        using key_type = typename TestType::key_type;
+
+        auto records = std::vector<nonstd::journal_record>(64);
+        auto journal = nonstd::op_journal(records.data(), records.size());
+        auto leader = std::make_unique<TestType>();
+        auto follower = std::make_unique<TestType>();
+        leader->attach_journal(&journal);
+
+        auto make_value = [](const nonstd::journal_record& record)
+        {
+            return journaled_value(record.version, record.index);
+        };
+        auto emplace = [&](int64_t value)
+        {
+            return leader->template emplace_back<int64_t>(std::move(value));
+        };
+
+        auto keys = std::vector<key_type>();
+        for (uint32_t idx = 0; idx < 4; ++idx)
+            keys.push_back(emplace(journaled_value(1, idx)));
+        REQUIRE(leader->try_remove(keys[1]));
+
+        // A failed insertion into a reused slot and into a fresh one
+        REQUIRE_THROWS_AS(emplace(-1), std::invalid_argument);
+        const key_type reused = emplace(journaled_value(2, 1));
+        REQUIRE_THROWS_AS(emplace(-1), std::invalid_argument);
+        const key_type fresh = emplace(journaled_value(1, 4));
+        REQUIRE(journal.size() == 7);
+
+        REQUIRE(nonstd::replay(journal, *follower, make_value) == 7);
+        REQUIRE(follower->size() == leader->size());
+        REQUIRE(follower->try_get(reused)->value() == leader->try_get(reused)->value());
+        REQUIRE(follower->try_get(fresh)->value() == leader->try_get(fresh)->value());
+        REQUIRE(follower->try_get(keys[1]) == nullptr);
+
+        for (int64_t idx = 0; idx < 10; ++idx)
+            REQUIRE(emplace(idx) == follower->template emplace_back<int64_t>(std::move(idx)));
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd journals refuse to replay incomplete or diverged records",
+        "[nonstd][journal]",
+        (nonstd::slot_array<int64_t, 100, nonstd::versioned_key, journal_policy>),
+        (nonstd::keyed_array<int64_t, 100, nonstd::versioned_key, journal_policy>))
+    {
+        auto records = std::vector<nonstd::journal_record>(4);
+        auto journal = nonstd::op_journal(records.data(), records.size());
+        auto leader = std::make_unique<TestType>();
+        auto follower = std::make_unique<TestType>();
+        leader->attach_journal(&journal);
+
+        auto make_value = [](const nonstd::journal_record&) { return int64_t(7); };
+
+        SECTION("a full journal drops and counts records")
+        {
+            for (int64_t idx = 0; idx < 6; ++idx)
+                leader->template emplace_back<int64_t>(std::move(idx));
+
+            REQUIRE(journal.full());
+            REQUIRE(journal.dropped() == 2);
+            REQUIRE_THROWS_AS(nonstd::replay(journal, *follower, make_value), std::overflow_error);
+            REQUIRE(journal.size() == 4);
+            REQUIRE(follower->size() == 0);
+        }
+
+        SECTION("a follower that has diverged is detected")
+        {
+            follower->template emplace_back<int64_t>(1);
+            leader->template emplace_back<int64_t>(1);
+            REQUIRE_THROWS_AS(nonstd::replay(journal, *follower, make_value), std::logic_error);
+        }
+
+        SECTION("a removal the follower can't apply is detected")
+        {
+            const auto key = leader->template emplace_back<int64_t>(1);
+            REQUIRE(leader->try_remove(key));
+
+            nonstd::journal_record removal;
+            REQUIRE(journal.pop(removal));
+            REQUIRE(removal.op == nonstd::journal_op::emplace);
+            REQUIRE_THROWS_AS(nonstd::replay(journal, *follower, make_value), std::logic_error);
+        }
+
+        SECTION("detaching stops recording")
+        {
+            leader->attach_journal(nullptr);
+            leader->template emplace_back<int64_t>(1);
+            REQUIRE(journal.empty());
+        }
+
+        SECTION("loading a snapshot keeps the attached journal")
+        {
+            auto file = test_snapshot::temp_file();
+            nonstd::save_snapshot(file.fd, *follower);
+
+            file.rewind();
+            nonstd::load_snapshot(file.fd, *leader);
+            REQUIRE(leader->journal() == &journal);
+        }
+    }
+}
+
+namespace test_versioned_key
+{
+    using narrow_key = nonstd::basic_versioned_key<16, 2, 4>;
+
+    struct narrow_retire_policy : nonstd::default_policy
+    {
+        using overflow_type = nonstd::retire_on_overflow;
+    };
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::basic_versioned_key supports large structures",
+        "[nonstd][versioned-key]",
+        (nonstd::slot_array<int64_t, 200000, nonstd::wide_versioned_key>),
+        (nonstd::keyed_array<int64_t, 200000, nonstd::wide_versioned_key>))
+    {
+        using key_type = typename TestType::key_type;
+        static_assert(sizeof(key_type) == sizeof(uint64_t), "key should be one word");
+
+        auto structure = std::make_unique<TestType>();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < 200000; ++idx)
+            keys.push_back(structure->template emplace_back<int64_t>(
+                std::move(idx), uint16_t(idx)));
+
+        REQUIRE_THROWS_AS(
+            structure->template emplace_back<int64_t>(0),
+            std::out_of_range);
+
+        bool all_match = true;
+        for (size_t idx = 0; idx < keys.size(); idx += 7)
+            all_match &= structure->try_remove(keys[idx]);
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+        {
+            auto* value = structure->try_get(keys[idx]);
+            if ((idx % 7) == 0)
+                all_match &= (value == nullptr);
+            else
+                all_match &= (value != nullptr) && (*value == int64_t(idx));
+            all_match &= (keys[idx].meta() == (idx & 0xFFF));
+        }
+        REQUIRE(all_match);
+
+        auto reused = structure->template emplace_back<int64_t>(-1);
+        REQUIRE(reused != keys.back());
+        REQUIRE(std::hash<key_type>()(reused) == std::hash<uint64_t>()(reused.bits()));
+        REQUIRE(*structure->try_get(reused) == -1);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::basic_versioned_key limits versions to its bit width",
+        "[nonstd][versioned-key]",
+        (nonstd::slot_array<int64_t, 4, narrow_key>),
+        (nonstd::keyed_array<int64_t, 4, narrow_key>))
+    {
+        auto structure = TestType();
+        auto key = structure.template emplace_back<int64_t>(0, uint8_t(0x1F));
+        REQUIRE(key.meta() == 0xF);
+
+        // Two version bits allow three generations per slot
+        for (int64_t idx = 1; idx < 3; ++idx)
+        {
+            REQUIRE(structure.try_remove(key));
+            auto next = structure.template emplace_back<int64_t>(std::move(idx));
+            REQUIRE(next != key);
+            REQUIRE(structure.try_get(key) == nullptr);
+            key = next;
+        }
+
+        REQUIRE(structure.try_remove(key));
+        REQUIRE_THROWS_AS(
+            structure.template emplace_back<int64_t>(0),
+            std::overflow_error);
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd::basic_versioned_key retires slots after a constructor throws",
+        "[nonstd][versioned-key]",
+        (nonstd::slot_array<picky_value, 1, narrow_key, narrow_retire_policy>),
+        (nonstd::keyed_array<picky_value, 1, narrow_key, narrow_retire_policy>))
+    {
+        auto structure = TestType();
+        for (int64_t idx = 0; idx < 2; ++idx)
+            REQUIRE(structure.try_remove(structure.template emplace_back<int64_t>(std::move(idx))));
+
+        // The failed insertion leaves the slot one version short of the
+        // limit, so its last generation is still handed out
+        REQUIRE_THROWS_AS(structure.template emplace_back<int64_t>(-1), std::invalid_argument);
+        const auto key = structure.template emplace_back<int64_t>(5);
+        REQUIRE(structure.try_get(key)->value() == 5);
+
+        REQUIRE(structure.try_remove(key));
+        REQUIRE(structure.retired() == 1);
+        REQUIRE_THROWS_AS(
+            structure.template emplace_back<int64_t>(0),
+            std::out_of_range);
+    }
+
+    TEST_CASE(
+        "nonstd::basic_versioned_key retires slots at its bit width",
+        "[nonstd][versioned-key]")
+    {
+        auto structure = nonstd::keyed_array<int64_t, 1, narrow_key, narrow_retire_policy>();
+        for (int64_t idx = 0; idx < 3; ++idx)
+            REQUIRE(structure.try_remove(structure.emplace_back<int64_t>(std::move(idx))));
+
+        REQUIRE(structure.retired() == 1);
+        REQUIRE_THROWS_AS(
+            structure.emplace_back<int64_t>(0),
+            std::out_of_range);
+    }
+}
+
+namespace test_slot_metadata
+{
+    struct byte_version_policy : nonstd::default_policy
+    {
+        using version_type = uint8_t;
+    };
+
+    struct byte_version_retire_policy : byte_version_policy
+    {
+        using overflow_type = nonstd::retire_on_overflow;
+    };
+
+    static_assert(std::is_same_v<nonstd::slot_array<int, 255>::slot_index_type, uint8_t>);
+    static_assert(std::is_same_v<nonstd::slot_array<int, 256>::slot_index_type, uint16_t>);
+    static_assert(std::is_same_v<nonstd::keyed_array<int, 254>::slot_index_type, uint8_t>);
+    static_assert(std::is_same_v<nonstd::keyed_array<int, 255>::slot_index_type, uint16_t>);
+    static_assert(std::is_same_v<nonstd::keyed_array<int, 32>::slot_version_type, uint32_t>);
+
+    // Narrow versions and indices shrink per-slot metadata to a few bytes
+    static_assert(
+        sizeof(nonstd::slot_array<char, 32, nonstd::versioned_key, byte_version_policy>) <
+        sizeof(nonstd::slot_array<char, 32>));
+    static_assert(
+        sizeof(nonstd::keyed_array<char, 32, nonstd::versioned_key, byte_version_policy>) <
+        sizeof(nonstd::keyed_array<char, 32>));
+
+    // The default stats, tracking and journal hooks are empty bases, so the
+    // containers hold only their counters and slot arrays (64-bit sizes)
+    static_assert((sizeof(size_t) != 8) || (sizeof(nonstd::slot_array<int, 16>) == 248));
+    static_assert((sizeof(size_t) != 8) || (sizeof(nonstd::keyed_array<int, 16>) == 184));
+    static_assert((sizeof(size_t) != 8) || (sizeof(nonstd::multi_slot_array<16, int, float>) == 304));
+    static_assert(
+        sizeof(nonstd::keyed_array<int, 16, nonstd::versioned_key, nonstd::counting_policy>) ==
+        sizeof(nonstd::keyed_array<int, 16>) + sizeof(nonstd::counting_stats));
+
+    TEMPLATE_TEST_CASE(
+        "nonstd containers use every slot with the smallest index type",
+        "[nonstd][metadata]",
+        (nonstd::slot_array<int64_t, 255>),
+        (nonstd::keyed_array<int64_t, 254>))
+    {
+        using key_type = typename TestType::key_type;
+
+        auto structure = TestType();
+        auto keys = std::vector<key_type>();
+        for (int64_t idx = 0; idx < int64_t(TestType::capacity); ++idx)
+            keys.push_back(structure.template emplace_back<int64_t>(std::move(idx)));
+        REQUIRE_THROWS_AS(
+            structure.template emplace_back<int64_t>(0),
+            std::out_of_range);
+
+        bool all_match = true;
+        for (size_t idx = 0; idx < keys.size(); ++idx)
+            all_match &= (*structure.try_get(keys[idx]) == int64_t(idx));
+        for (auto key : keys)
+            all_match &= structure.try_remove(key);
+        for (auto key : keys)
+            all_match &= (structure.try_get(key) == nullptr);
+        REQUIRE(all_match);
+
+        for (int64_t idx = 0; idx < int64_t(TestType::capacity); ++idx)
+            keys[idx] = structure.template emplace_back<int64_t>(std::move(idx));
+        REQUIRE(*structure.try_get(keys.back()) == int64_t(keys.size() - 1));
+    }
+
+    TEMPLATE_TEST_CASE(
+        "nonstd containers wrap versions at the policy's version width",
+        "[nonstd][metadata]",
+        (nonstd::slot_array<int64_t, 1, nonstd::versioned_key, byte_version_policy>),
+        (nonstd::keyed_array<int64_t, 1, nonstd::versioned_key, byte_version_policy>))
+    {
+        auto structure = TestType();
+        auto first = structure.template emplace_back<int64_t>(0);
+        REQUIRE(structure.try_remove(first));
+
+        for (int64_t idx = 1; idx < 255; ++idx)
+            REQUIRE(structure.try_remove(structure.template emplace_back<int64_t>(std::move(idx))));
+
+        REQUIRE_THROWS_AS(
+            structure.template emplace_back<int64_t>(0),
+            std::overflow_error);
+        REQUIRE(structure.try_get(first) == nullptr);
+    }
+
+    TEST_CASE(
+        "nonstd containers retire slots at the policy's version width",
+        "[nonstd][metadata]")
+    {
+        auto structure = nonstd::slot_array<int64_t, 2, nonstd::versioned_key, byte_version_retire_policy>();
+        for (int64_t idx = 0; idx < 255; ++idx)
+            REQUIRE(structure.try_remove(structure.emplace_back<int64_t>(std::move(idx))));
+
+        REQUIRE(structure.retired() == 1);
+        REQUIRE(structure.emplace_back<int64_t>(0));
+        REQUIRE_THROWS_AS(
+            structure.emplace_back<int64_t>(0),
+            std::out_of_range);
     }
 }
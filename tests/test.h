@@ -1,5 +1,8 @@
 #include "catch.h"
 
+#include "../include/policy.h"
+#include "../include/raw_buffer.h"
+
 namespace testing
 {
     class ref_proxy
@@ -95,6 +98,237 @@ namespace testing
         int32_t* m_refcount;
     };
 
+    struct op_counts
+    {
+        int32_t move_constructs = 0;
+        int32_t move_assigns = 0;
+        int32_t destroys = 0;
+        bool throw_on_move = false;
+    };
+
+    /// <summary>
+    /// Counts the moves and destructions performed on it by a container.
+    /// </summary>
+    class counted
+    {
+    public:
+        counted(int64_t value, op_counts* counts)
+            : m_value(value)
+            , m_counts(counts)
+        {
+            // Pass
+        }
+
+        counted(counted&& other) noexcept
+            : m_value(other.m_value)
+            , m_counts(other.m_counts)
+        {
+            ++m_counts->move_constructs;
+        }
+
+        counted& operator=(counted&& rhs) noexcept
+        {
+            m_value = rhs.m_value;
+            m_counts = rhs.m_counts;
+            ++m_counts->move_assigns;
+            return *this;
+        }
+
+        ~counted()
+        {
+            ++m_counts->destroys;
+        }
+
+        int64_t value() const
+        {
+            return m_value;
+        }
+
+        op_counts* counts() const
+        {
+            return m_counts;
+        }
+
+    private:
+        int64_t m_value;
+        op_counts* m_counts;
+    };
+
+    /// <summary>
+    /// A counted type whose moves may throw, and do once throw_on_move is set.
+    /// </summary>
+    class throwing_counted : public counted
+    {
+    public:
+        using counted::counted;
+
+        throwing_counted(throwing_counted&& other) noexcept(false)
+            : counted(check(std::move(other)))
+        {
+            // Pass
+        }
+
+        throwing_counted& operator=(throwing_counted&& rhs) noexcept(false)
+        {
+            counted::operator=(check(std::move(rhs)));
+            return *this;
+        }
+
+    private:
+        static throwing_counted&& check(throwing_counted&& other)
+        {
+            if (other.counts()->throw_on_move)
+                throw std::runtime_error("throwing_counted move");
+            return std::move(other);
+        }
+    };
+
+    /// <summary>
+    /// A counted type that opts in to bytewise relocation.
+    /// </summary>
+    class relocatable_counted : public counted
+    {
+    public:
+        using counted::counted;
+    };
+
+    /// <summary>
+    /// A value whose constructor throws when given a negative number.
+    /// </summary>
+    class picky_value
+    {
+    public:
+        picky_value(int64_t value)
+            : m_value(check(value))
+        {
+            // Pass
+        }
+
+        int64_t value() const noexcept { return m_value; }
+
+    private:
+        static int64_t check(int64_t value)
+        {
+            if (value < 0)
+                throw std::invalid_argument("picky_value");
+            return value;
+        }
+
+        int64_t m_value;
+    };
+
+    /// <summary>
+    /// A key with a tiny version range so that overflow can be reached.
+    /// </summary>
+    struct small_version_key
+    {
+        using version_type = uint8_t;
+        using index_type   = uint16_t;
+        using meta_type    = uint16_t;
+
+        small_version_key() = default;
+
+        small_version_key(
+            version_type version,
+            index_type index,
+            meta_type meta)
+            : m_version(version)
+            , m_index(index)
+            , m_meta(meta)
+        {
+            // Pass
+        }
+
+        operator bool()   const noexcept { return (m_version != 0); }
+        meta_type meta()  const noexcept { return m_meta; }
+
+        version_type m_version;
+        index_type   m_index;
+        meta_type    m_meta;
+    };
+
+    struct retire_policy : nonstd::default_policy
+    {
+        using stats_type    = nonstd::counting_stats;
+        using overflow_type = nonstd::retire_on_overflow;
+    };
+
+    struct deferred_policy : nonstd::default_policy
+    {
+        using stats_type   = nonstd::counting_stats;
+        using removal_type = nonstd::deferred_removal;
+    };
+
+    struct fifo_policy : nonstd::default_policy
+    {
+        using allocation_type = nonstd::fifo_allocation;
+    };
+
+    struct lowest_index_policy : nonstd::default_policy
+    {
+        using allocation_type = nonstd::lowest_index_allocation;
+    };
+
+    struct heap_policy : nonstd::default_policy
+    {
+        using storage_type = nonstd::heap_storage;
+    };
+
+    struct mmap_policy : nonstd::default_policy
+    {
+        using storage_type = nonstd::mmap_storage;
+    };
+
+    struct prefaulted_mmap_policy : nonstd::default_policy
+    {
+        using storage_type = nonstd::prefaulted_mmap_storage;
+    };
+
+    struct tracking_policy : nonstd::default_policy
+    {
+        using tracking_type = nonstd::dirty_tracking;
+    };
+
+    struct fifo_tracking_policy : fifo_policy
+    {
+        using tracking_type = nonstd::dirty_tracking;
+    };
+
+    struct lowest_index_tracking_policy : lowest_index_policy
+    {
+        using tracking_type = nonstd::dirty_tracking;
+    };
+
+    struct journal_policy : nonstd::default_policy
+    {
+        using journal_type = nonstd::op_journaling;
+    };
+
+    struct deferred_journal_policy : deferred_policy
+    {
+        using journal_type = nonstd::op_journaling;
+    };
+
+    struct lowest_index_journal_policy : lowest_index_policy
+    {
+        using journal_type = nonstd::op_journaling;
+    };
+
+    /// <summary>
+    /// The order in which each allocation policy reuses slots 5, 2 and 7,
+    /// freed in that order.
+    /// </summary>
+    template<typename Allocation>
+    inline std::array<size_t, 3> expected_reuse_order()
+    {
+        if constexpr (std::is_same_v<Allocation, nonstd::fifo_allocation>)
+            return { 5, 2, 7 };
+        else if constexpr (std::is_same_v<Allocation, nonstd::lowest_index_allocation>)
+            return { 2, 5, 7 };
+        else
+            return { 7, 2, 5 };
+    }
+
     template<size_t Val>
     struct val_t
     {
@@ -127,3 +361,10 @@ namespace testing
         return std::min<int64_t>(static_cast<int64_t>(size) - 1, index);
     }
 }
+
+namespace nonstd
+{
+    template<>
+    struct is_trivially_relocatable<testing::relocatable_counted>
+        : std::true_type {};
+}